@@ -0,0 +1,2102 @@
+/*
+ * Host benchmark for the ssd1306 driver and graphics library
+ *
+ * Runs the driver against the SSD1306 controller model and reports, per
+ * scenario, the bus traffic and modelled bus time, and the host time taken by
+ * the graphics primitives. Exits non-zero if a check fails.
+ *
+ * usage: bench [-o DIR]
+ *   -o DIR: write the display contents after each scenario to DIR/<name>.pbm
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/i2c.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/spi.h>
+
+#include "systick.h"
+
+#include "i2c.h"
+#include "spi.h"
+
+#include "ssd1306.h"
+#include "ssd1306_transport.h"
+#include "ssd1306_graphics.h"
+#include "ssd1306_console.h"
+#include "ssd1306_display_list.h"
+#include "ssd1306_frame.h"
+#include "profile.h"
+
+#include "font8x8_basic.h"
+#include "periph.h"
+#include "rle.h"
+#include "ssd1306_emu.h"
+
+/* repetitions for host timing of graphics primitives */
+#define PRIMITIVE_REPS 2000
+
+/* wiring of the second display on the SPI bus (shares DC with the first) */
+#define CS2_PORT GPIOA
+#define CS2_PIN GPIO6
+#define RESET2_PORT GPIOA
+#define RESET2_PIN GPIO7
+
+static ssd1306_emu_t emu;
+static ssd1306_emu_t emu2;
+static uint32_t buffer[SSD1306_BUFFER_WORDS];
+static uint32_t buffer2[SSD1306_BUFFER_WORDS];
+static ssd1306_t display;
+static ssd1306_t display2;
+static surface_t *screen; /* display's framebuffer */
+static const char *out_dir = NULL;
+static int failures = 0;
+
+static const ssd1306_config_t config = {
+#ifdef SSD1306_I2C
+    .i2c = I2C1,
+    .addr = SSD1306_ADDR_PRIMARY,
+#elif defined(SSD1306_SPI)
+    .spi = SPI1,
+    .cs_port = CS_PORT,
+    .cs_pin = CS_PIN,
+    .dc_port = DC_PORT,
+    .dc_pin = DC_PIN,
+    .reset_port = RESET_PORT,
+    .reset_pin = RESET_PIN,
+#endif
+    .buffer = buffer,
+};
+
+/* a display on the other bus, driven by the same image */
+static ssd1306_emu_t emu3;
+static uint32_t buffer3[SSD1306_BUFFER_WORDS];
+static ssd1306_t display3;
+
+static const ssd1306_config_t config3 = {
+#ifdef SSD1306_I2C
+    .transport = &ssd1306_spi_transport,
+    .spi = SPI1,
+    .cs_port = CS_PORT,
+    .cs_pin = CS_PIN,
+    .dc_port = DC_PORT,
+    .dc_pin = DC_PIN,
+    .reset_port = RESET_PORT,
+    .reset_pin = RESET_PIN,
+#elif defined(SSD1306_SPI)
+    .transport = &ssd1306_i2c_transport,
+    .i2c = I2C1,
+    .addr = SSD1306_ADDR_PRIMARY,
+#endif
+    .buffer = buffer3,
+};
+
+static const ssd1306_config_t config2 = {
+#ifdef SSD1306_I2C
+    .i2c = I2C1,
+    .addr = SSD1306_ADDR_SECONDARY,
+#elif defined(SSD1306_SPI)
+    .spi = SPI1,
+    .cs_port = CS2_PORT,
+    .cs_pin = CS2_PIN,
+    .dc_port = DC_PORT,
+    .dc_pin = DC_PIN,
+    .reset_port = RESET2_PORT,
+    .reset_pin = RESET2_PIN,
+#endif
+    .buffer = buffer2,
+};
+
+static void setup(void) {
+    screen = ssd1306_surface(&display);
+    periph_reset();
+    emu_set_panel(&emu, DISP_WIDTH, DISP_HEIGHT, DISP_COL_OFFSET);
+    emu_set_panel(&emu2, DISP_WIDTH, DISP_HEIGHT, DISP_COL_OFFSET);
+    emu_set_panel(&emu3, DISP_WIDTH, DISP_HEIGHT, DISP_COL_OFFSET);
+    emu_reset(&emu);
+    emu_reset(&emu2);
+    emu_reset(&emu3);
+#ifdef SSD1306_I2C
+    periph_attach_i2c(&emu, config.addr);
+    periph_attach_i2c(&emu2, config2.addr);
+    periph_attach_spi(&emu3, config3.cs_port, config3.cs_pin,
+            config3.dc_port, config3.dc_pin, config3.reset_port,
+            config3.reset_pin);
+#elif defined(SSD1306_SPI)
+    periph_attach_spi(&emu, config.cs_port, config.cs_pin, config.dc_port,
+            config.dc_pin, config.reset_port, config.reset_pin);
+    periph_attach_spi(&emu2, config2.cs_port, config2.cs_pin,
+            config2.dc_port, config2.dc_pin, config2.reset_port,
+            config2.reset_pin);
+    periph_attach_i2c(&emu3, config3.addr);
+#endif
+
+    rcc_osc_bypass_enable(RCC_HSE);
+    rcc_clock_setup_in_hse_8mhz_out_48mhz();
+
+    systick_setup();
+    i2c_setup();
+    spi_setup();
+}
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void dump(const char *name) {
+    if (!out_dir) {
+        return;
+    }
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.pbm", out_dir, name);
+    for (char *c = path + strlen(out_dir) + 1; *c; c++) {
+        if (*c == ' ') {
+            *c = '_';
+        }
+    }
+    check(emu_write_pbm(&emu, path), "write pbm");
+}
+
+/* print bus traffic since the last call */
+static void report(const char *name) {
+    const emu_stats_t *s = &emu.stats;
+    printf("%-24s %6u %8u %8u %8u %10.1f\n", name,
+            (unsigned) s->transactions, (unsigned) s->bus_bytes,
+            (unsigned) s->command_bytes, (unsigned) s->data_bytes,
+            (double) s->bus_ps / 1e6);
+    dump(name);
+    emu_clear_stats(&emu);
+}
+
+/* true if the displayed RAM is what a full refresh would produce */
+static bool matches_full_refresh(ssd1306_t *dev, ssd1306_emu_t *e) {
+    uint8_t before[EMU_PAGES][EMU_COLUMNS];
+    memcpy(before, e->gddram, sizeof(before));
+
+    emu_stats_t stats = e->stats;
+    ssd1306_set_full_refresh(dev, true);
+    ssd1306_update_display(dev);
+    ssd1306_set_full_refresh(dev, false);
+    e->stats = stats;
+
+    return memcmp(before, e->gddram, sizeof(before)) == 0;
+}
+
+static volatile bool async_done;
+static volatile bool async_ok;
+
+static void flush_done(ssd1306_t *dev, bool success) {
+    (void) dev;
+    async_done = true;
+    async_ok = success;
+}
+
+static void bench_flushes(void) {
+    printf("%-24s %6s %8s %8s %8s %10s\n", "scenario", "txns", "bus B",
+            "cmd B", "data B", "bus us");
+
+    ssd1306_init(&display, &config);
+    ssd1306_update_display(&display);
+    report("init");
+
+    fill_display(screen, PIXEL_OFF);
+    draw_textbox(screen, "12:34", 5, 20, 20, 66, 32, PIXEL_OFF, PIXEL_ON);
+    ssd1306_update_display(&display);
+    report("textbox");
+    check(matches_full_refresh(&display, &emu),
+            "textbox flush matches full refresh");
+
+    ssd1306_set_full_refresh(&display, true);
+    ssd1306_update_display(&display);
+    ssd1306_set_full_refresh(&display, false);
+    report("full refresh");
+
+    ssd1306_update_display(&display);
+    report("no change");
+
+    draw_textbox(screen, "12:35", 5, 20, 20, 66, 32, PIXEL_OFF, PIXEL_ON);
+    ssd1306_update_display(&display);
+    report("one digit");
+    check(matches_full_refresh(&display, &emu),
+            "one digit flush matches full refresh");
+
+    draw_line(screen, 0, 0, 127, 63, PIXEL_ON);
+    draw_line(screen, 0, 63, 127, 0, PIXEL_ON);
+    ssd1306_update_display(&display);
+    report("diagonals");
+    check(matches_full_refresh(&display, &emu),
+            "diagonals flush matches full refresh");
+
+    draw_checkerboard(screen);
+    async_done = false;
+    check(ssd1306_update_display_async(&display, flush_done),
+            "async flush start");
+    while (!async_done);
+    check(async_ok, "async flush result");
+    report("async checkerboard");
+    check(matches_full_refresh(&display, &emu),
+            "async flush matches full refresh");
+
+    fill_display(screen, PIXEL_TOGGLE);
+    async_done = false;
+    check(ssd1306_present(&display, flush_done), "present");
+    while (ssd1306_flush_busy(&display));
+    check(async_done && async_ok, "present result");
+    report("present inverted");
+    check(matches_full_refresh(&display, &emu),
+            "present matches full refresh");
+
+    const ssd1306_flush_stats_t *fs = ssd1306_get_flush_stats(&display);
+    printf("\nflushes %u, framebuffer bytes sent %u, saved %u\n",
+            (unsigned) fs->flushes, (unsigned) fs->bytes_sent,
+            (unsigned) fs->bytes_saved_total);
+}
+
+#ifdef SSD1306_SPI
+/* CPU writes to the SPI data register for a blocking full frame */
+static void bench_spi_writes(void) {
+    uint32_t writes = periph_spi_dr_writes();
+    ssd1306_set_full_refresh(&display, true);
+    ssd1306_update_display(&display);
+    ssd1306_set_full_refresh(&display, false);
+    writes = periph_spi_dr_writes() - writes;
+
+    const emu_stats_t *s = &emu.stats;
+    printf("blocking frame: %u bytes in %u DR writes, %.0f kB/s on the wire\n",
+            (unsigned) s->bus_bytes, (unsigned) writes,
+            (double) s->bus_bytes / ((double) s->bus_ps / 1e12) / 1e3);
+    /* commands one byte per write, data two */
+    check(2 * writes <= s->bus_bytes + s->command_bytes,
+            "SPI data is written two bytes at a time");
+    emu_clear_stats(&emu);
+}
+#endif
+
+#ifdef SSD1306_I2C
+/* a full frame sent, true if the display acknowledged all of it */
+static bool full_frame(void) {
+    ssd1306_set_full_refresh(&display, true);
+    bool ok = ssd1306_update_display(&display);
+    ssd1306_set_full_refresh(&display, false);
+    return ok;
+}
+
+/* full frame time at each bus mode, and calibration to a display's limit */
+static void bench_i2c_speeds(void) {
+    static const struct {
+        const char *name;
+        i2c_clock_t clock;
+        i2c_profile_t profile;
+        uint32_t max_hz;
+    } profiles[] = {
+        { "standard, HSI", I2C_CLOCK_HSI, I2C_STANDARD, 100000 },
+        { "fast, HSI", I2C_CLOCK_HSI, I2C_FAST, 400000 },
+        { "fast plus, HSI", I2C_CLOCK_HSI, I2C_FAST_PLUS, 1000000 },
+        { "standard, SYSCLK", I2C_CLOCK_SYSCLK, I2C_STANDARD, 100000 },
+        { "fast, SYSCLK", I2C_CLOCK_SYSCLK, I2C_FAST, 400000 },
+        { "fast plus, SYSCLK", I2C_CLOCK_SYSCLK, I2C_FAST_PLUS, 1000000 },
+    };
+    /* a display that stops acknowledging above this */
+    const uint32_t limit_hz = 750000;
+
+    printf("\n%-24s %8s %10s\n", "I2C speed", "SCL Hz", "frame us");
+    draw_checkerboard(screen);
+    for (size_t n = 0; n < sizeof(profiles) / sizeof(profiles[0]); n++) {
+        uint32_t hz = i2c_set_profile(I2C1, profiles[n].clock,
+                profiles[n].profile);
+        check(hz > 0 && hz <= profiles[n].max_hz,
+                "I2C profile within its bus mode");
+        /* only the HSI clock is too slow to reach 1 MHz */
+        check(profiles[n].clock == I2C_CLOCK_HSI
+                || hz >= profiles[n].max_hz * 19 / 20,
+                "I2C profile close to its bus mode's SCL");
+        emu_clear_stats(&emu);
+        check(full_frame(), "full frame at each I2C profile");
+        printf("%-24s %8u %10.1f\n", profiles[n].name, (unsigned) hz,
+                (double) emu.stats.bus_ps / 1e6);
+    }
+    check(matches_full_refresh(&display, &emu),
+            "frame at Fast-mode Plus matches full refresh");
+
+    uint8_t probe[] = { CONTROL_BYTE_COMMAND, SSD1306_NOP };
+    emu_set_i2c_max_clock(&emu, limit_hz);
+    uint32_t hz = i2c_calibrate(I2C1, I2C_CLOCK_SYSCLK, config.addr, probe,
+            sizeof(probe), 1000000);
+    check(hz <= limit_hz && hz + 2 * I2C_CALIBRATION_STEP > limit_hz,
+            "calibration backs off below the display's limit");
+    fill_display(screen, PIXEL_TOGGLE);
+    emu_clear_stats(&emu);
+    check(full_frame(), "full frame at the calibrated speed");
+    printf("%-24s %8u %10.1f\n", "calibrated, SYSCLK", (unsigned) hz,
+            (double) emu.stats.bus_ps / 1e6);
+    check(matches_full_refresh(&display, &emu),
+            "frame at the calibrated speed matches full refresh");
+
+    emu_set_i2c_max_clock(&emu, 0);
+    i2c_set_profile(I2C1, I2C_CLOCK_HSI, I2C_STANDARD);
+    emu_clear_stats(&emu);
+}
+
+static volatile bool async_unmasked;
+
+/* as flush_done(), also noting whether interrupts were enabled */
+static void flush_done_unmasked(ssd1306_t *dev, bool success) {
+    uint32_t masked = cm_mask_interrupts(1);
+    cm_mask_interrupts(masked);
+    async_unmasked = !masked;
+    flush_done(dev, success);
+}
+
+/* a slave holding SDA low: flushes time out, the bus recovers, then works */
+static void check_i2c_recovery(void) {
+    const i2c_stats_t *st = i2c_get_stats(I2C1);
+    uint8_t nop = SSD1306_NOP;
+
+    /* the frame and flush state are put back for the scenarios that follow */
+    uint8_t frame[DISP_WIDTH * DISP_PAGES];
+    const ssd1306_t saved = display;
+    memcpy(frame, screen->buffer, sizeof(frame));
+
+    i2c_clear_stats(I2C1);
+    check(!i2c_write_with_header(I2C1, 0x50, &nop, 1, NULL, 0)
+            && st->nacks == 1, "absent device counted as a NACK");
+
+    /* blocking: the flush fails within its deadline, the next one works */
+    fill_display(screen, PIXEL_OFF);
+    draw_textbox(screen, "stuck", 5, 20, 20, 66, 32, PIXEL_OFF, PIXEL_ON);
+    periph_i2c_hold_sda(5);
+    uint32_t t0 = millis();
+    check(!ssd1306_update_display(&display), "flush on a stuck bus fails");
+    uint32_t t = millis() - t0;
+    check(st->timeouts >= 1 && st->recoveries >= 1
+            && periph_i2c_sda_held() == 0, "stuck bus timed out and freed");
+    /* one transaction timed out: at most a full frame's deadline */
+    check(t <= I2C_TIMEOUT_MS + 100, "stuck flush bounded in time");
+    check(ssd1306_update_display(&display), "flush after recovery");
+    check(matches_full_refresh(&display, &emu),
+            "flush after recovery matches full refresh");
+
+    /* asynchronous: ends with failure once polled past the deadline */
+    uint32_t timeouts = st->timeouts;
+    draw_textbox(screen, "again", 5, 20, 20, 66, 32, PIXEL_OFF, PIXEL_ON);
+    periph_i2c_hold_sda(9);
+    async_done = false;
+    async_unmasked = false;
+    check(ssd1306_update_display_async(&display, flush_done_unmasked),
+            "async flush start on a stuck bus");
+    while (ssd1306_flush_busy(&display));
+    check(async_done && !async_ok && st->timeouts == timeouts + 1,
+            "async flush on a stuck bus times out");
+    check(async_unmasked, "timeout reported with interrupts enabled");
+    check(ssd1306_update_display(&display), "flush after async recovery");
+    check(matches_full_refresh(&display, &emu),
+            "flush after async recovery matches full refresh");
+
+    /* held between transactions: the start fails, the next poll frees it */
+    uint32_t recoveries = st->recoveries;
+    draw_textbox(screen, "held", 4, 20, 20, 66, 32, PIXEL_OFF, PIXEL_ON);
+    periph_i2c_hold_bus(9);
+    async_done = false;
+    ssd1306_update_display_async(&display, flush_done);
+    check(async_done && !async_ok && st->recoveries == recoveries
+            && periph_i2c_sda_held() != 0,
+            "async flush on a held bus fails without recovering");
+    ssd1306_flush_busy(&display);
+    check(st->recoveries == recoveries + 1 && periph_i2c_sda_held() == 0,
+            "held bus freed by the next poll");
+    check(ssd1306_update_display(&display), "flush after held bus");
+    check(matches_full_refresh(&display, &emu),
+            "flush after held bus matches full refresh");
+
+    /* a blocking flush frees a held bus itself */
+    recoveries = st->recoveries;
+    draw_textbox(screen, "block", 5, 20, 20, 66, 32, PIXEL_OFF, PIXEL_ON);
+    periph_i2c_hold_bus(9);
+    check(ssd1306_update_display(&display)
+            && st->recoveries == recoveries + 1,
+            "blocking flush frees a held bus");
+    check(matches_full_refresh(&display, &emu),
+            "flush on a held bus matches full refresh");
+
+    printf("\nI2C errors: %u transactions, %u NACKs, %u bus errors, "
+            "%u timeouts, %u recoveries, worst latency %u ms\n",
+            (unsigned) st->transactions, (unsigned) st->nacks,
+            (unsigned) st->bus_errors, (unsigned) st->timeouts,
+            (unsigned) st->recoveries, (unsigned) st->max_latency_ms);
+
+    memcpy(screen->buffer, frame, sizeof(frame));
+    ssd1306_set_full_refresh(&display, true);
+    ssd1306_update_display(&display);
+    memcpy(display.dirty_x0, saved.dirty_x0, sizeof(display.dirty_x0));
+    memcpy(display.dirty_x1, saved.dirty_x1, sizeof(display.dirty_x1));
+    display.full_refresh = saved.full_refresh;
+    display.flush_stats = saved.flush_stats;
+    emu_clear_stats(&emu);
+}
+#endif
+
+static ssd1306_t *done_order[2];
+static uint32_t ndone;
+
+static void queued_flush_done(ssd1306_t *dev, bool success) {
+    if (ndone < 2 && success) {
+        done_order[ndone] = dev;
+    }
+    ndone++;
+}
+
+/* two displays on one bus, flushed back to back through the queue */
+static void bench_two_displays(void) {
+    ssd1306_init(&display2, &config2);
+    ssd1306_update_display(&display2);
+    emu_clear_stats(&emu2);
+
+    draw_checkerboard(screen);
+    fill_display(ssd1306_surface(&display2), PIXEL_OFF);
+    draw_textbox(ssd1306_surface(&display2), "second", 6, 0, 0, 127, 15,
+            PIXEL_OFF, PIXEL_ON);
+
+    /*
+     * interrupts are held off so that the first flush is still running when
+     * the second is requested, as it would be on the target
+     */
+    ndone = 0;
+    cm_mask_interrupts(1);
+    check(ssd1306_update_display_async(&display, queued_flush_done),
+            "first display flush start");
+    check(ssd1306_update_display_async(&display2, queued_flush_done),
+            "second display flush start");
+    check(ndone == 0, "second flush queued behind the first");
+    cm_mask_interrupts(0);
+    while (ssd1306_flush_busy(&display) || ssd1306_flush_busy(&display2));
+    check(ndone == 2 && done_order[0] == &display
+            && done_order[1] == &display2, "queued flushes completed in order");
+
+    /* report the traffic of both displays as one scenario */
+    emu.stats.transactions += emu2.stats.transactions;
+    emu.stats.bus_bytes += emu2.stats.bus_bytes;
+    emu.stats.command_bytes += emu2.stats.command_bytes;
+    emu.stats.data_bytes += emu2.stats.data_bytes;
+    emu.stats.bus_ps += emu2.stats.bus_ps;
+    emu_clear_stats(&emu2);
+    report("two displays");
+
+    check(matches_full_refresh(&display, &emu),
+            "first display matches full refresh");
+    check(matches_full_refresh(&display2, &emu2),
+            "second display matches full refresh");
+}
+
+/* displays on two buses flush at the same time, each through its own queue */
+static void check_mixed_buses(void) {
+    const ssd1306_transport_t *other = config3.transport;
+
+    ssd1306_init(&display3, &config3);
+    ssd1306_update_display(&display3);
+    emu_clear_stats(&emu3);
+
+    draw_checkerboard(screen);
+    fill_display(ssd1306_surface(&display3), PIXEL_OFF);
+    draw_textbox(ssd1306_surface(&display3), "other bus", 9, 0, 0, 127, 15,
+            PIXEL_OFF, PIXEL_ON);
+
+    ndone = 0;
+    cm_mask_interrupts(1);
+    check(ssd1306_update_display_async(&display, queued_flush_done),
+            "first bus flush start");
+    check(ssd1306_update_display_async(&display3, queued_flush_done),
+            "other bus flush start");
+    check(other->bus->current == &display3,
+            "other bus flush not queued behind the first");
+    cm_mask_interrupts(0);
+    while (ssd1306_flush_busy(&display) || ssd1306_flush_busy(&display3));
+    check(ndone == 2, "flushes on both buses completed");
+
+    check(matches_full_refresh(&display, &emu),
+            "first bus display matches full refresh");
+    check(matches_full_refresh(&display3, &emu3),
+            "other bus display matches full refresh");
+    emu_clear_stats(&emu);
+    emu_clear_stats(&emu3);
+}
+
+/* bus transactions of a flush of n windows */
+#ifdef SSD1306_SPI
+#define FLUSH_TRANSACTIONS(n) ((n) > 0 ? 1U : 0U) /* one CS assertion */
+#elif defined(SSD1306_I2C_SINGLE_TRANSACTION)
+#define FLUSH_TRANSACTIONS(n) (n)
+#else
+#define FLUSH_TRANSACTIONS(n) (2U * (n)) /* commands, then data */
+#endif
+
+/* exact number of bus transactions per flush, blocking and asynchronous */
+static void check_flush_transactions(void) {
+    for (int async = 0; async < 2; async++) {
+        /* no windows, one full window, and two far apart */
+        for (uint8_t n = 0; n <= 2; n++) {
+            fill_display(screen, PIXEL_OFF);
+            ssd1306_update_display(&display);
+            emu_clear_stats(&emu);
+
+            if (n == 1) {
+                ssd1306_set_full_refresh(&display, true);
+            } else if (n == 2) {
+                surface_draw_pixel(screen, 0, 0, PIXEL_ON);
+                surface_draw_pixel(screen, DISP_WIDTH - 1, DISP_HEIGHT - 1,
+                        PIXEL_ON);
+            }
+            if (async) {
+                check(ssd1306_update_display_async(&display, NULL),
+                        "async flush start");
+                while (ssd1306_flush_busy(&display));
+            } else {
+                check(ssd1306_update_display(&display), "flush");
+            }
+            ssd1306_set_full_refresh(&display, false);
+
+            check(emu.stats.transactions == FLUSH_TRANSACTIONS(n),
+                    "bus transactions per flush");
+            check(matches_full_refresh(&display, &emu),
+                    "flush in fewest transactions matches full refresh");
+        }
+    }
+    emu_clear_stats(&emu);
+}
+
+/* mock bus timing: 400 kHz I2C, 9 clocks per byte, START/address/STOP */
+#define MOCK_NS_PER_BYTE 22500
+#define MOCK_NS_PER_TRANSFER 25000
+#define MOCK_TRACE_SIZE 64
+#define MOCK_REPS 2000
+
+static ssd1306_mock_event_t mock_trace[MOCK_TRACE_SIZE];
+static ssd1306_mock_event_t mock_blocking[MOCK_TRACE_SIZE];
+static ssd1306_mock_t mock;
+static uint32_t buffer_mock[SSD1306_BUFFER_WORDS];
+static ssd1306_t display_mock;
+
+static const ssd1306_config_t config_mock = {
+    .transport = &ssd1306_mock_transport,
+    .buffer = buffer_mock,
+};
+
+/* redraw the clock from a blank frame and flush it (asynchronously if set) */
+static bool mock_clock_flush(bool async) {
+    surface_t *s = ssd1306_surface(&display_mock);
+    fill_display(s, PIXEL_OFF);
+    ssd1306_update_display(&display_mock);
+    ssd1306_mock_clear(&mock);
+
+    draw_textbox(s, "12:34", 5, 20, 20, 66, 32, PIXEL_OFF, PIXEL_ON);
+    draw_line(s, 0, 63, 127, 60, PIXEL_ON);
+    if (!async) {
+        return ssd1306_update_display(&display_mock);
+    }
+    async_done = false;
+    return ssd1306_update_display_async(&display_mock, flush_done)
+            && async_done && async_ok;
+}
+
+/* true if the trace is in time order, with every write inside a transfer */
+static bool mock_trace_ordered(void) {
+    bool in_transfer = false;
+    for (uint32_t i = 0; i < mock.len && i < mock.size; i++) {
+        const ssd1306_mock_event_t *e = &mock_trace[i];
+        if (i > 0 && e->t_ns < mock_trace[i - 1].t_ns) {
+            return false;
+        }
+        if (e->op == MOCK_BEGIN || e->op == MOCK_END) {
+            if (in_transfer == (e->op == MOCK_BEGIN)) {
+                return false;
+            }
+            in_transfer = e->op == MOCK_BEGIN;
+        } else if (!in_transfer) {
+            return false;
+        }
+    }
+    return !in_transfer;
+}
+
+/* the driver on the mock transport: bus traffic, and host time per flush */
+static void bench_mock(void) {
+    ssd1306_mock_setup(&mock, mock_trace, MOCK_TRACE_SIZE, MOCK_NS_PER_BYTE,
+            MOCK_NS_PER_TRANSFER);
+    ssd1306_init(&display_mock, &config_mock);
+    check(mock.transfers == 1 && mock.command_bytes > 0 && !mock.data_bytes,
+            "mock init is one transfer of commands");
+
+    check(mock_clock_flush(false), "mock flush");
+    uint32_t sent = DISP_WIDTH * DISP_PAGES
+            - ssd1306_get_flush_stats(&display_mock)->bytes_saved_last;
+    printf("\nmock: %u transfers, %u events, cmd %u B, data %u B, "
+            "%.1f us modelled (%.0f kB/s)\n", (unsigned) mock.transfers,
+            (unsigned) mock.len, (unsigned) mock.command_bytes,
+            (unsigned) mock.data_bytes, (double) mock.now_ns / 1e3,
+            (double) mock.data_bytes * 1e6 / (double) mock.now_ns);
+    check(mock.transfers == 1, "mock flush is one transfer");
+    check(mock.data_bytes == sent, "mock data bytes match flush stats");
+    check(mock.len <= mock.size && mock_trace_ordered(),
+            "mock trace in order");
+
+    /* the same frame sent asynchronously makes the same trace */
+    uint32_t len = mock.len;
+    memcpy(mock_blocking, mock_trace, sizeof(mock_blocking));
+    check(mock_clock_flush(true), "mock async flush");
+    bool same = mock.len == len;
+    for (uint32_t i = 0; same && i < len; i++) {
+        same = mock_trace[i].t_ns == mock_blocking[i].t_ns
+                && mock_trace[i].len == mock_blocking[i].len
+                && mock_trace[i].op == mock_blocking[i].op
+                && mock_trace[i].dev == &display_mock
+                && mock_trace[i].async == (mock_trace[i].op == MOCK_COMMANDS
+                        || mock_trace[i].op == MOCK_DATA);
+    }
+    check(same, "mock async trace matches blocking");
+
+    /* a failed flush is resent in full by the next one */
+    ssd1306_mock_clear(&mock);
+    draw_textbox(ssd1306_surface(&display_mock), "56:78", 5, 20, 20, 66, 32,
+            PIXEL_OFF, PIXEL_ON);
+    mock.fail = true;
+    check(!ssd1306_update_display(&display_mock), "mock flush fails");
+    mock.fail = false;
+    check(ssd1306_update_display(&display_mock) && mock.data_bytes > 0,
+            "failed mock flush resent");
+
+    /* driver time alone: plan and hand over a full frame */
+    uint64_t t0 = nanos64();
+    for (uint32_t i = 0; i < MOCK_REPS; i++) {
+        ssd1306_set_full_refresh(&display_mock, true);
+        ssd1306_update_display(&display_mock);
+    }
+    uint64_t t = nanos64() - t0;
+    ssd1306_set_full_refresh(&display_mock, false);
+    printf("mock full frame flush: %.0f ns host time\n",
+            (double) t / MOCK_REPS);
+}
+
+/* per-pixel rectangle, as draw_rectangle(screen, ) used to be drawn */
+static void draw_rectangle_reference(uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1, pixel_t color) {
+    for (uint32_t j = y0; j <= y1; j++) {
+        for (uint32_t i = x0; i <= x1; i++) {
+            ssd1306_draw_pixel(&display, i, j, color);
+        }
+    }
+}
+
+/* display RAM after drawing a rectangle over a checkerboard */
+static void rectangle_result(uint8_t out[EMU_PAGES][EMU_COLUMNS],
+        bool reference, const uint8_t *r, pixel_t color) {
+    draw_checkerboard(screen);
+    if (reference) {
+        draw_rectangle_reference(r[0], r[1], r[2], r[3], color);
+    } else {
+        draw_rectangle(screen, r[0], r[1], r[2], r[3], color);
+    }
+    ssd1306_update_display(&display);
+    memcpy(out, emu.gddram, EMU_PAGES * EMU_COLUMNS);
+}
+
+/*
+ * draw a frame and flush it byte at a time (or normally), then make small
+ * changes flushed in windows: a stale front or back buffer would show
+ * outside them
+ */
+static void slow_flush_frames(bool slow,
+        uint8_t out[EMU_PAGES][EMU_COLUMNS]) {
+    fill_display(screen, PIXEL_OFF);
+    ssd1306_update_display(&display);
+
+    fill_display(screen, PIXEL_ON);
+    draw_textbox(screen, "slow", 4, 20, 20, 66, 32, PIXEL_OFF, PIXEL_ON);
+    if (slow) {
+        ssd1306_update_display_slow(&display);
+    } else {
+        ssd1306_update_display(&display);
+    }
+    draw_line(screen, 0, 0, 7, 7, PIXEL_OFF);
+    ssd1306_update_display(&display);
+    draw_line(screen, DISP_WIDTH - 8, 0, DISP_WIDTH - 1, 7, PIXEL_OFF);
+    ssd1306_update_display(&display);
+    memcpy(out, emu.gddram, EMU_PAGES * EMU_COLUMNS);
+}
+
+/* a byte at a time flush leaves the buffers in step for later flushes */
+static void check_slow_flush(void) {
+    static uint8_t a[EMU_PAGES][EMU_COLUMNS];
+    static uint8_t b[EMU_PAGES][EMU_COLUMNS];
+
+    slow_flush_frames(false, a);
+    slow_flush_frames(true, b);
+    check(memcmp(a, b, sizeof(a)) == 0,
+            "flushes after a slow flush match normal flushes");
+    check(matches_full_refresh(&display, &emu),
+            "flushes after a slow flush match full refresh");
+    emu_clear_stats(&emu);
+}
+
+static void check_rectangles(void) {
+    static const uint8_t rects[][4] = {
+        { 0, 0, 127, 63 }, { 10, 10, 20, 20 }, { 3, 5, 124, 58 },
+        { 0, 3, 0, 4 }, { 5, 8, 9, 15 }, { 100, 60, 200, 200 },
+    };
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+    uint8_t b[EMU_PAGES][EMU_COLUMNS];
+
+    for (size_t i = 0; i < sizeof(rects) / sizeof(rects[0]); i++) {
+        for (pixel_t c = PIXEL_OFF; c <= PIXEL_TOGGLE; c++) {
+            rectangle_result(a, true, rects[i], c);
+            rectangle_result(b, false, rects[i], c);
+            check(!memcmp(a, b, sizeof(a)), "rectangle matches per-pixel");
+        }
+    }
+    emu_clear_stats(&emu);
+}
+
+/* per-pixel checkerboard, as draw_checkerboard(screen) used to be drawn */
+static void draw_checkerboard_reference(void) {
+    for (uint32_t j = 0; j < DISP_HEIGHT; j++) {
+        for (uint32_t i = 0; i < DISP_WIDTH; i++) {
+            ssd1306_draw_pixel(&display, i, j, ((i/8) % 2 == (j/8) % 2));
+        }
+    }
+}
+
+static void check_bulk(void) {
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+
+    fill_display(screen, PIXEL_OFF);
+    draw_checkerboard_reference();
+    ssd1306_update_display(&display);
+    memcpy(a, emu.gddram, sizeof(a));
+    fill_display(screen, PIXEL_ON);
+    draw_checkerboard(screen);
+    ssd1306_update_display(&display);
+    check(!memcmp(a, emu.gddram, sizeof(a)), "checkerboard matches per-pixel");
+
+    /* page 1 of the checkerboard is page 0 inverted */
+    ssd1306_blend_pages(&display, 1, 0, 1, BLEND_COPY);
+    ssd1306_invert_pages(&display, 1, 1);
+    ssd1306_update_display(&display);
+    check(!memcmp(a, emu.gddram, sizeof(a)), "copy and invert pages");
+
+    /* overlapping move down by one page, then back up */
+    ssd1306_blend_pages(&display, 1, 0, DISP_PAGES, BLEND_COPY);
+    ssd1306_update_display(&display);
+    check(!memcmp(a[0], emu.gddram[1], sizeof(a[0]))
+            && !memcmp(a[DISP_PAGES - 2], emu.gddram[DISP_PAGES - 1],
+                sizeof(a[0])), "overlapping page move");
+    ssd1306_blend_pages(&display, 0, 1, DISP_PAGES, BLEND_XOR);
+    ssd1306_update_display(&display);
+    /* page 0 ^ its copy is blank; neighbouring pages are inverses */
+    const uint8_t *p0 = &emu.gddram[0][DISP_COL_OFFSET];
+    const uint8_t *p1 = &emu.gddram[1][DISP_COL_OFFSET];
+    check(p0[0] == 0x00 && p0[8] == 0x00 && p1[0] == 0xFF && p1[8] == 0xFF,
+            "xor pages");
+    emu_clear_stats(&emu);
+}
+
+/* per-pixel character from the row-major font, as it used to be drawn */
+static void draw_character_reference(char c, uint8_t x, uint8_t y,
+        pixel_t color) {
+    for (uint8_t row = 0; row < 8; row++) {
+        uint8_t pixels = font8x8_basic[(size_t) c][row];
+        for (uint8_t col = 0; col < 8; col++) {
+            if ((pixels >> col) & 0x1) {
+                ssd1306_draw_pixel(&display, x + col, y + row, color);
+            }
+        }
+    }
+}
+
+/* every printable character, at every row offset and in every color */
+static void check_characters(void) {
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+    bool ok = true;
+
+    for (pixel_t color = PIXEL_OFF; color <= PIXEL_TOGGLE; color++) {
+        for (int pass = 0; pass < 2; pass++) {
+            draw_checkerboard(screen);
+            for (char c = ' '; c < 0x7F; c++) {
+                uint8_t n = c - ' ';
+                uint8_t x = (n % 16) * 8 + n / 16;
+                uint8_t y = (n / 16) * 8 + n % 8;
+                if (pass) {
+                    draw_character(screen, c, x, y, color);
+                } else {
+                    draw_character_reference(c, x, y, color);
+                }
+            }
+            ssd1306_update_display(&display);
+            if (!pass) {
+                memcpy(a, emu.gddram, sizeof(a));
+            } else {
+                ok = ok && !memcmp(a, emu.gddram, sizeof(a));
+            }
+        }
+    }
+    check(ok, "characters match per-pixel");
+    emu_clear_stats(&emu);
+}
+
+/* per-pixel Bresenham line, as draw_line() used to be drawn */
+static void draw_line_reference(int32_t x0, int32_t y0, int32_t x1,
+        int32_t y1, pixel_t color) {
+    bool steep = abs(y1 - y0) > abs(x1 - x0);
+    if (steep ? y0 > y1 : x0 > x1) {
+        int32_t t = x0;
+        x0 = x1;
+        x1 = t;
+        t = y0;
+        y0 = y1;
+        y1 = t;
+    }
+    int32_t d = steep ? x1 - x0 : y1 - y0; /* minor axis */
+    int32_t n = steep ? y1 - y0 : x1 - x0; /* major axis */
+    int32_t step = d < 0 ? -1 : 1;
+    d = abs(d);
+    int32_t error = 0;
+    int32_t a = 2 * d - n;
+    int32_t minor = steep ? x0 : y0;
+    for (int32_t major = steep ? y0 : x0; major <= (steep ? y1 : x1);
+            major++) {
+        if (steep) {
+            ssd1306_draw_pixel(&display, minor, major, color);
+        } else {
+            ssd1306_draw_pixel(&display, major, minor, color);
+        }
+        if (2 * error + a < 0) {
+            error += d;
+        } else {
+            error += d - n;
+            minor += step;
+        }
+    }
+}
+
+/* lines in every direction and color, against per-pixel drawing */
+static void check_lines(void) {
+    static const uint8_t lines[][4] = {
+        { 0, 0, 127, 63 }, { 127, 63, 0, 0 }, { 0, 63, 127, 0 },
+        { 5, 3, 9, 60 }, { 60, 50, 58, 2 }, { 0, 32, 127, 32 },
+        { 100, 40, 3, 40 }, { 63, 0, 63, 63 }, { 17, 60, 17, 5 },
+        { 40, 9, 41, 9 }, { 70, 20, 70, 20 },
+    };
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+    bool ok = true;
+
+    for (pixel_t color = PIXEL_OFF; color <= PIXEL_TOGGLE; color++) {
+        for (int pass = 0; pass < 2; pass++) {
+            draw_checkerboard(screen);
+            for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+                /* scaled to the panel, so that no line needs clipping */
+                uint8_t x0 = lines[i][0] * (DISP_WIDTH - 1) / 127;
+                uint8_t y0 = lines[i][1] * (DISP_HEIGHT - 1) / 63;
+                uint8_t x1 = lines[i][2] * (DISP_WIDTH - 1) / 127;
+                uint8_t y1 = lines[i][3] * (DISP_HEIGHT - 1) / 63;
+                if (pass) {
+                    draw_line(screen, x0, y0, x1, y1, color);
+                } else {
+                    draw_line_reference(x0, y0, x1, y1, color);
+                }
+            }
+            ssd1306_update_display(&display);
+            if (!pass) {
+                memcpy(a, emu.gddram, sizeof(a));
+            } else {
+                ok = ok && !memcmp(a, emu.gddram, sizeof(a));
+            }
+        }
+    }
+    check(ok, "lines match per-pixel");
+
+    /* drawn again a tile at a time, toggled lines cancel out exactly */
+    static const uint8_t long_lines[][4] = {
+        { 0, 60, 255, 124 }, { 250, 3, 20, 200 }, { 3, 255, 140, 0 },
+        { 90, 10, 200, 30 },
+    };
+    size_t nlines = sizeof(lines) / sizeof(lines[0]);
+    ok = true;
+    for (size_t i = 0; i < nlines + 4; i++) {
+        const uint8_t *l = i < nlines ? lines[i] : long_lines[i - nlines];
+        fill_display(screen, PIXEL_OFF);
+        draw_line(screen, l[0], l[1], l[2], l[3], PIXEL_TOGGLE);
+        for (uint32_t ty = 0; ty < DISP_HEIGHT; ty += 5) {
+            for (uint32_t tx = 0; tx < DISP_WIDTH; tx += 7) {
+                set_clip(screen, tx, ty, tx + 6, ty + 4);
+                draw_line(screen, l[0], l[1], l[2], l[3], PIXEL_TOGGLE);
+            }
+        }
+        reset_viewport(screen);
+        for (size_t b = 0; b < DISP_WIDTH * DISP_PAGES; b++) {
+            ok = ok && screen->buffer[b] == 0;
+        }
+    }
+    check(ok, "lines clipped in tiles match whole lines");
+    emu_clear_stats(&emu);
+}
+
+/* viewport and clip rectangle used by check_clipping(), in display pixels */
+#define VIEW_X 20
+#define VIEW_Y 10
+#define CLIP_X0 (VIEW_X + 5)
+#define CLIP_Y0 (VIEW_Y + 5)
+#define CLIP_X1 (VIEW_X + 60)
+#define CLIP_Y1 (VIEW_Y + 30)
+
+/* per-pixel drawing in viewport coordinates, dropping pixels outside clip */
+static void draw_clipped_pixel(uint32_t x, uint32_t y, pixel_t color) {
+    x += VIEW_X;
+    y += VIEW_Y;
+    if (x >= CLIP_X0 && x <= CLIP_X1 && y >= CLIP_Y0 && y <= CLIP_Y1) {
+        ssd1306_draw_pixel(&display, x, y, color);
+    }
+}
+
+/* shapes drawn through the viewport and clip, or per pixel */
+static void draw_clip_scene(bool reference, pixel_t color) {
+    static const uint8_t rects[][4] = {
+        { 0, 0, 200, 200 }, { 50, 20, 70, 25 }, { 3, 3, 8, 40 },
+    };
+    static const uint8_t chars[][2] = {
+        { 0, 0 }, { 2, 3 }, { 58, 28 }, { 30, 12 }, { 61, 31 },
+    };
+
+    for (size_t i = 0; i < sizeof(rects) / sizeof(rects[0]); i++) {
+        const uint8_t *r = rects[i];
+        if (!reference) {
+            draw_rectangle(screen, r[0], r[1], r[2], r[3], color);
+            continue;
+        }
+        for (uint32_t y = r[1]; y <= r[3]; y++) {
+            for (uint32_t x = r[0]; x <= r[2]; x++) {
+                draw_clipped_pixel(x, y, color);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(chars) / sizeof(chars[0]); i++) {
+        char c = 'A' + i;
+        uint8_t x = chars[i][0];
+        uint8_t y = chars[i][1];
+        if (!reference) {
+            draw_character(screen, c, x, y, color);
+            continue;
+        }
+        for (uint8_t row = 0; row < 8; row++) {
+            for (uint8_t col = 0; col < 8; col++) {
+                if ((font8x8_basic[(size_t) c][row] >> col) & 0x1) {
+                    draw_clipped_pixel(x + col, y + row, color);
+                }
+            }
+        }
+    }
+
+    /* horizontal, vertical and 45 degree lines clip to exact pixels */
+    if (!reference) {
+        draw_line(screen, 0, 20, 99, 20, color);
+        draw_line(screen, 40, 99, 40, 0, color);
+        draw_line(screen, 0, 0, 99, 99, color);
+        draw_line(screen, 90, 0, 0, 90, color);
+    } else {
+        for (uint32_t i = 0; i < 100; i++) {
+            draw_clipped_pixel(i, 20, color);
+            draw_clipped_pixel(40, i, color);
+            draw_clipped_pixel(i, i, color);
+            if (i <= 90) {
+                draw_clipped_pixel(90 - i, i, color);
+            }
+        }
+    }
+}
+
+/* clipped primitives match per-pixel drawing, and stay inside the clip */
+static void check_clipping(void) {
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+    bool ok = true;
+
+    for (pixel_t color = PIXEL_OFF; color <= PIXEL_TOGGLE; color++) {
+        draw_checkerboard(screen);
+        draw_clip_scene(true, color);
+        ssd1306_update_display(&display);
+        memcpy(a, emu.gddram, sizeof(a));
+
+        draw_checkerboard(screen);
+        set_viewport(screen, VIEW_X, VIEW_Y, DISP_WIDTH - 1,
+                DISP_HEIGHT - 1);
+        set_clip(screen, CLIP_X0 - VIEW_X, CLIP_Y0 - VIEW_Y,
+                CLIP_X1 - VIEW_X, CLIP_Y1 - VIEW_Y);
+        draw_clip_scene(false, color);
+        reset_viewport(screen);
+        ssd1306_update_display(&display);
+        ok = ok && !memcmp(a, emu.gddram, sizeof(a));
+    }
+    check(ok, "clipped primitives match per-pixel");
+
+    /* any line, however steep, leaves the outside of the clip alone */
+    fill_display(screen, PIXEL_OFF);
+    ssd1306_update_display(&display);
+    set_viewport(screen, VIEW_X, VIEW_Y, DISP_WIDTH - 1, DISP_HEIGHT - 1);
+    set_clip(screen, CLIP_X0 - VIEW_X, CLIP_Y0 - VIEW_Y, CLIP_X1 - VIEW_X,
+            CLIP_Y1 - VIEW_Y);
+    for (uint32_t n = 0; n < 64; n++) {
+        draw_line(screen, n * 3, 0, 255 - n * 4, 255, PIXEL_ON);
+        draw_line(screen, 0, n * 4, 255, 200 - n * 3, PIXEL_ON);
+    }
+    fill_display(screen, PIXEL_TOGGLE);
+    draw_checkerboard(screen);
+    reset_viewport(screen);
+    ssd1306_update_display(&display);
+    ok = true;
+    for (uint32_t y = 0; y < DISP_HEIGHT; y++) {
+        for (uint32_t x = 0; x < DISP_WIDTH; x++) {
+            bool inside = x >= CLIP_X0 && x <= CLIP_X1 && y >= CLIP_Y0
+                && y <= CLIP_Y1;
+            ok = ok && (inside || !emu_pixel(&emu, x, y));
+        }
+    }
+    check(ok, "clipped lines stay inside the clip");
+    emu_clear_stats(&emu);
+}
+
+/* polygons used by check_shapes(): a concave star and a notched box */
+static const point_t star[] = {
+    { 30, 1 }, { 36, 12 }, { 50, 12 }, { 39, 19 }, { 44, 31 },
+    { 30, 23 }, { 16, 31 }, { 21, 19 }, { 10, 12 }, { 24, 12 },
+};
+static const point_t notched[] = {
+    { 2, 2 }, { 60, 2 }, { 60, 29 }, { 33, 29 }, { 33, 9 }, { 27, 9 },
+    { 27, 29 }, { 2, 29 },
+};
+
+#define SHAPES 8
+
+/* shape i of check_shapes(), outline or filled, with its origin at (x, y) */
+static void draw_shape(uint32_t i, bool filled, uint8_t x, uint8_t y,
+        pixel_t color) {
+    point_t p[sizeof(star) / sizeof(star[0])];
+    const point_t *poly = i == 6 ? star : notched;
+    uint8_t n = i == 6 ? sizeof(star) / sizeof(star[0])
+        : sizeof(notched) / sizeof(notched[0]);
+
+    switch (i) {
+    case 0:
+        (filled ? fill_circle : draw_circle)(screen, x + 32, y + 16, 14,
+                color);
+        break;
+    case 1:
+        (filled ? fill_ellipse : draw_ellipse)(screen, x + 30, y + 15, 29,
+                9, color);
+        break;
+    case 2:
+        (filled ? fill_ellipse : draw_ellipse)(screen, x + 20, y + 15, 3,
+                15, color);
+        break;
+    case 3:
+        (filled ? fill_ellipse : draw_ellipse)(screen, x + 9, y + 9, 0, 6,
+                color);
+        (filled ? fill_ellipse : draw_ellipse)(screen, x + 30, y + 20, 12,
+                0, color);
+        (filled ? fill_circle : draw_circle)(screen, x + 50, y + 5, 0,
+                color);
+        break;
+    case 4:
+        (filled ? fill_triangle : draw_triangle)(screen, x + 3, y + 30,
+                x + 40, y + 2, x + 61, y + 24, color);
+        break;
+    case 5:
+        (filled ? fill_triangle : draw_triangle)(screen, x + 5, y + 5,
+                x + 58, y + 7, x + 6, y + 8, color);
+        break;
+    default:
+        for (uint8_t k = 0; k < n && k < sizeof(p) / sizeof(p[0]); k++) {
+            p[k].x = x + poly[k].x;
+            p[k].y = y + poly[k].y;
+        }
+        (filled ? fill_polygon : draw_polygon)(screen, p, n, color);
+        break;
+    }
+}
+
+/* display RAM after drawing shape i on a blank display */
+static void shape_result(uint8_t out[EMU_PAGES][EMU_COLUMNS], uint32_t i,
+        bool filled, pixel_t color) {
+    fill_display(screen, PIXEL_OFF);
+    draw_shape(i, filled, 0, 0, color);
+    ssd1306_update_display(&display);
+    memcpy(out, emu.gddram, EMU_PAGES * EMU_COLUMNS);
+}
+
+/* per-pixel even-odd fill: a pixel is inside if a ray to its left crosses
+ * an odd number of edges, each edge covering rows ya <= y < yb */
+static void fill_polygon_reference(const point_t *p, uint8_t n) {
+    for (int32_t y = 0; y < DISP_HEIGHT; y++) {
+        for (int32_t x = 0; x < DISP_WIDTH; x++) {
+            bool inside = false;
+            for (uint8_t k = 0; k < n; k++) {
+                const point_t *a = &p[k];
+                const point_t *b = &p[(k + 1) % n];
+                if (a->y > b->y) {
+                    const point_t *t = a;
+                    a = b;
+                    b = t;
+                }
+                if (y < a->y || y >= b->y) {
+                    continue;
+                }
+                /* crossing at or left of the pixel */
+                if ((x - a->x) * (b->y - a->y) >= (y - a->y) * (b->x - a->x)) {
+                    inside = !inside;
+                }
+            }
+            if (inside) {
+                ssd1306_draw_pixel(&display, x, y, PIXEL_ON);
+            }
+        }
+    }
+}
+
+/* circles, ellipses, triangles and polygons */
+static void check_shapes(void) {
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+    uint8_t b[EMU_PAGES][EMU_COLUMNS];
+    bool ok_once = true;
+    bool ok_inside = true;
+
+    for (uint32_t i = 0; i < SHAPES; i++) {
+        for (int filled = 0; filled < 2; filled++) {
+            /* every pixel is drawn once: toggling equals setting */
+            shape_result(a, i, filled, PIXEL_ON);
+            shape_result(b, i, filled, PIXEL_TOGGLE);
+            ok_once = ok_once && !memcmp(a, b, sizeof(a));
+        }
+        /* an ellipse's outline lies within its fill (a filled polygon
+         * leaves out its right and bottom edges, see below) */
+        if (i > 3) {
+            continue;
+        }
+        shape_result(a, i, false, PIXEL_ON);
+        shape_result(b, i, true, PIXEL_ON);
+        const uint8_t *pa = &a[0][0];
+        const uint8_t *pb = &b[0][0];
+        for (size_t k = 0; k < sizeof(a); k++) {
+            ok_inside = ok_inside && !(pa[k] & ~pb[k]);
+        }
+    }
+    check(ok_once, "shapes draw each pixel once");
+    check(ok_inside, "ellipse outlines lie within their fills");
+
+    /* a filled polygon covers the pixels left of and above its far edges,
+     * so shapes sharing an edge tile without gaps or overlaps */
+    static const point_t box[] = { { 2, 3 }, { 40, 3 }, { 40, 20 },
+        { 2, 20 } };
+    fill_display(screen, PIXEL_OFF);
+    draw_rectangle(screen, 2, 3, 39, 19, PIXEL_ON);
+    ssd1306_update_display(&display);
+    memcpy(a, emu.gddram, sizeof(a));
+    fill_display(screen, PIXEL_OFF);
+    fill_polygon(screen, box, 4, PIXEL_ON);
+    ssd1306_update_display(&display);
+    check(!memcmp(a, emu.gddram, sizeof(a)), "filled box matches rectangle");
+    fill_display(screen, PIXEL_OFF);
+    fill_triangle(screen, 2, 3, 40, 3, 40, 20, PIXEL_TOGGLE);
+    fill_triangle(screen, 2, 3, 40, 20, 2, 20, PIXEL_TOGGLE);
+    ssd1306_update_display(&display);
+    check(!memcmp(a, emu.gddram, sizeof(a)), "adjacent triangles tile");
+
+    /* scanline fill against the per-pixel even-odd rule */
+    bool ok = true;
+    for (uint32_t i = 6; i < SHAPES; i++) {
+        fill_display(screen, PIXEL_OFF);
+        fill_polygon_reference(i == 6 ? star : notched,
+                i == 6 ? sizeof(star) / sizeof(star[0])
+                : sizeof(notched) / sizeof(notched[0]));
+        ssd1306_update_display(&display);
+        memcpy(a, emu.gddram, sizeof(a));
+        shape_result(b, i, true, PIXEL_ON);
+        ok = ok && !memcmp(a, b, sizeof(a));
+    }
+    check(ok, "filled polygons match per-pixel");
+
+    /* through a viewport and clip: the unclipped shape, cut to the clip */
+    ok = true;
+    for (uint32_t i = 0; i < SHAPES; i++) {
+        for (int filled = 0; filled < 2; filled++) {
+            fill_display(screen, PIXEL_OFF);
+            draw_shape(i, filled, VIEW_X, VIEW_Y, PIXEL_ON);
+            ssd1306_update_display(&display);
+            fill_display(screen, PIXEL_OFF);
+            for (uint32_t y = CLIP_Y0; y <= CLIP_Y1; y++) {
+                for (uint32_t x = CLIP_X0; x <= CLIP_X1; x++) {
+                    if (x < DISP_WIDTH && y < DISP_HEIGHT
+                            && emu_pixel(&emu, x, y)) {
+                        ssd1306_draw_pixel(&display, x, y, PIXEL_ON);
+                    }
+                }
+            }
+            ssd1306_update_display(&display);
+            memcpy(a, emu.gddram, sizeof(a));
+
+            fill_display(screen, PIXEL_OFF);
+            set_viewport(screen, VIEW_X, VIEW_Y, DISP_WIDTH - 1,
+                    DISP_HEIGHT - 1);
+            set_clip(screen, CLIP_X0 - VIEW_X, CLIP_Y0 - VIEW_Y,
+                    CLIP_X1 - VIEW_X, CLIP_Y1 - VIEW_Y);
+            draw_shape(i, filled, 0, 0, PIXEL_ON);
+            reset_viewport(screen);
+            ssd1306_update_display(&display);
+            ok = ok && !memcmp(a, emu.gddram, sizeof(a));
+        }
+    }
+    check(ok, "clipped shapes match unclipped");
+    emu_clear_stats(&emu);
+}
+
+/* test image for check_bitmaps(): runs, literals, and a partial last page */
+#define IMAGE_W 45
+#define IMAGE_H 21
+
+static int test_image_pixel(const void *ctx, uint8_t x, uint8_t y) {
+    (void) ctx;
+    return y < 6 || x < 3 || (x > 30 && (x * 7 + y * 3) % 5 < 2)
+        || (x - 15) * (x - 15) + (y - 12) * (y - 12) < 40;
+}
+
+static uint8_t test_pages[IMAGE_W * ((IMAGE_H + 7) / 8)];
+static uint8_t test_rle[sizeof(test_pages) + sizeof(test_pages) / 128 + 1];
+static image_t test_image = { IMAGE_W, IMAGE_H, test_rle };
+
+/* full screen image for the benchmark, and its raw page bytes */
+static uint8_t splash_pages[DISP_WIDTH * DISP_PAGES];
+static uint8_t splash_rle[sizeof(splash_pages) + sizeof(splash_pages) / 128
+    + 1];
+static image_t splash_image = { DISP_WIDTH, DISP_HEIGHT, splash_rle };
+static uint8_t splash_raw[sizeof(splash_pages)
+    + (sizeof(splash_pages) + 127) / 128];
+static image_t splash_raw_image = { DISP_WIDTH, DISP_HEIGHT, splash_raw };
+
+static void make_images(void) {
+    rle_pages(IMAGE_W, IMAGE_H, test_pages, test_image_pixel, NULL);
+    rle_encode(test_pages, sizeof(test_pages), test_rle);
+
+    /* a frame of the usual scene */
+    fill_display(screen, PIXEL_OFF);
+    draw_textbox(screen, "splash\nscreen", 13, 2, 2, 60, 26, PIXEL_ON,
+            PIXEL_OFF);
+    fill_circle(screen, 90, 30, 20, PIXEL_ON);
+    draw_line(screen, 0, 40, 127, 63, PIXEL_ON);
+    memcpy(splash_pages, screen->buffer, sizeof(splash_pages));
+    size_t n = rle_encode(splash_pages, sizeof(splash_pages), splash_rle);
+    uint8_t *raw = splash_raw;
+    for (size_t i = 0; i < sizeof(splash_pages); i += 128) {
+        size_t len = sizeof(splash_pages) - i < 128 ? sizeof(splash_pages) - i
+            : 128;
+        *raw++ = len - 1;
+        memcpy(raw, &splash_pages[i], len);
+        raw += len;
+    }
+    printf("\nsplash image: %zu bytes as pages, %zu run-length encoded\n",
+            sizeof(splash_pages), n);
+}
+
+/* per-pixel image, as an uncompressed image would be drawn, clipped */
+static void draw_bitmap_reference(uint8_t x, uint8_t y, blend_t op,
+        bool clipped) {
+    for (uint32_t j = 0; j < IMAGE_H; j++) {
+        for (uint32_t i = 0; i < IMAGE_W; i++) {
+            bool set = test_image_pixel(NULL, i, j);
+            pixel_t color;
+            if (op == BLEND_COPY) {
+                color = set ? PIXEL_ON : PIXEL_OFF;
+            } else if (op == BLEND_OR && set) {
+                color = PIXEL_ON;
+            } else if (op == BLEND_AND && !set) {
+                color = PIXEL_OFF;
+            } else if (op == BLEND_XOR && set) {
+                color = PIXEL_TOGGLE;
+            } else {
+                continue;
+            }
+            if (clipped) {
+                draw_clipped_pixel(x + i, y + j, color);
+            } else if (x + i < DISP_WIDTH && y + j < DISP_HEIGHT) {
+                ssd1306_draw_pixel(&display, x + i, y + j, color);
+            }
+        }
+    }
+}
+
+/* images at page aligned and unaligned rows, off the edges, and clipped */
+static void check_bitmaps(void) {
+    static const uint8_t at[][2] = {
+        { 0, 0 }, { 5, 8 }, { 3, 3 }, { 20, 13 }, { 40, 20 }, { 200, 0 },
+    };
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+    bool ok = true;
+
+    for (blend_t op = BLEND_COPY; op <= BLEND_XOR; op++) {
+        for (size_t k = 0; k < sizeof(at) / sizeof(at[0]); k++) {
+            uint8_t x = at[k][0] * (DISP_WIDTH - 1) / 127;
+            uint8_t y = at[k][1] * (DISP_HEIGHT - 1) / 63;
+            for (int clipped = 0; clipped < 2; clipped++) {
+                draw_checkerboard(screen);
+                draw_bitmap_reference(x, y, op, clipped);
+                ssd1306_update_display(&display);
+                memcpy(a, emu.gddram, sizeof(a));
+
+                draw_checkerboard(screen);
+                if (clipped) {
+                    set_viewport(screen, VIEW_X, VIEW_Y, DISP_WIDTH - 1,
+                            DISP_HEIGHT - 1);
+                    set_clip(screen, CLIP_X0 - VIEW_X, CLIP_Y0 - VIEW_Y,
+                            CLIP_X1 - VIEW_X, CLIP_Y1 - VIEW_Y);
+                }
+                draw_bitmap(screen, &test_image, x, y, op);
+                reset_viewport(screen);
+                ssd1306_update_display(&display);
+                ok = ok && !memcmp(a, emu.gddram, sizeof(a));
+            }
+        }
+    }
+    check(ok, "images match per-pixel");
+
+    /* the splash screen decodes to its pages; drawn again, nothing is sent */
+    draw_bitmap(screen, &splash_image, 0, 0, BLEND_COPY);
+    check(!memcmp(screen->buffer, splash_pages, sizeof(splash_pages)),
+            "splash image decodes");
+    ssd1306_update_display(&display);
+    emu_clear_stats(&emu);
+    draw_bitmap(screen, &splash_image, 0, 0, BLEND_COPY);
+    ssd1306_update_display(&display);
+    check(emu.stats.transactions == 0,
+            "redrawn image sends nothing");
+    emu_clear_stats(&emu);
+}
+
+/* test bitmap for check_blit(), with a mask */
+#define SPRITE_W 37
+#define SPRITE_H 29
+
+static int sprite_pixel(const void *ctx, uint8_t x, uint8_t y) {
+    (void) ctx;
+    return (x * 5 + y * 3) % 7 < 3 || y == 0 || x == SPRITE_W - 1;
+}
+
+static int sprite_mask_pixel(const void *ctx, uint8_t x, uint8_t y) {
+    (void) ctx;
+    return (x - 18) * (x - 18) + (y - 14) * (y - 14) < 150;
+}
+
+static uint8_t sprite_data[SPRITE_W * ((SPRITE_H + 7) / 8)];
+static uint8_t sprite_mask[sizeof(sprite_data)];
+static const bitmap_t sprite = { SPRITE_W, SPRITE_H, sprite_data,
+    sprite_mask };
+
+/* per-pixel blit of the sprite, in viewport coordinates if clipped */
+static void blit_reference(const uint8_t *r, blend_t op, bool clipped) {
+    for (uint32_t j = 0; j < r[3] && r[1] + j < SPRITE_H; j++) {
+        for (uint32_t i = 0; i < r[2] && r[0] + i < SPRITE_W; i++) {
+            uint32_t b = (r[1] + j) / 8 * SPRITE_W + r[0] + i;
+            bool set = (sprite_data[b] >> ((r[1] + j) % 8)) & 0x1;
+            bool masked = (sprite_mask[b] >> ((r[1] + j) % 8)) & 0x1;
+            pixel_t color;
+            if (op == BLEND_COPY || (op == BLEND_MASKED && masked)) {
+                color = set ? PIXEL_ON : PIXEL_OFF;
+            } else if (op == BLEND_OR && set) {
+                color = PIXEL_ON;
+            } else if (op == BLEND_AND && !set) {
+                color = PIXEL_OFF;
+            } else if (op == BLEND_AND_NOT && set) {
+                color = PIXEL_OFF;
+            } else if (op == BLEND_XOR && set) {
+                color = PIXEL_TOGGLE;
+            } else {
+                continue;
+            }
+            uint32_t x = r[4] + i;
+            uint32_t y = r[5] + j;
+            if (clipped) {
+                draw_clipped_pixel(x, y, color);
+            } else if (x < DISP_WIDTH && y < DISP_HEIGHT) {
+                ssd1306_draw_pixel(&display, x, y, color);
+            }
+        }
+    }
+}
+
+/* rectangles at every source and destination row offset, against per-pixel
+ * drawing: { sx, sy, w, h, x, y } */
+static void check_blit(void) {
+    static const uint8_t rects[][6] = {
+        { 0, 0, SPRITE_W, SPRITE_H, 3, 5 }, { 0, 0, SPRITE_W, 16, 8, 8 },
+        { 5, 3, 20, 17, 10, 8 }, { 5, 11, 30, 15, 20, 0 },
+        { 0, 6, 37, 23, 7, 9 }, { 10, 2, 37, 29, 50, 20 },
+        { 20, 20, 100, 100, 0, 1 }, { 1, 9, 1, 1, 30, 30 },
+    };
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+    bool ok = true;
+
+    rle_pages(SPRITE_W, SPRITE_H, sprite_data, sprite_pixel, NULL);
+    rle_pages(SPRITE_W, SPRITE_H, sprite_mask, sprite_mask_pixel, NULL);
+    for (blend_t op = BLEND_COPY; op <= BLEND_MASKED; op++) {
+        for (size_t k = 0; k < sizeof(rects) / sizeof(rects[0]); k++) {
+            const uint8_t *r = rects[k];
+            for (int clipped = 0; clipped < 2; clipped++) {
+                draw_checkerboard(screen);
+                blit_reference(r, op, clipped);
+                ssd1306_update_display(&display);
+                memcpy(a, emu.gddram, sizeof(a));
+
+                draw_checkerboard(screen);
+                if (clipped) {
+                    set_viewport(screen, VIEW_X, VIEW_Y, DISP_WIDTH - 1,
+                            DISP_HEIGHT - 1);
+                    set_clip(screen, CLIP_X0 - VIEW_X, CLIP_Y0 - VIEW_Y,
+                            CLIP_X1 - VIEW_X, CLIP_Y1 - VIEW_Y);
+                }
+                blit(screen, &sprite, r[0], r[1], r[2], r[3], r[4], r[5],
+                        op);
+                reset_viewport(screen);
+                ssd1306_update_display(&display);
+                ok = ok && !memcmp(a, emu.gddram, sizeof(a));
+            }
+        }
+    }
+    check(ok, "blits match per-pixel");
+    emu_clear_stats(&emu);
+}
+
+/* off-screen canvas for check_canvas(), with a stride wider than it */
+#define CANVAS_W 45
+#define CANVAS_H 21
+#define CANVAS_STRIDE 48
+#define CANVAS_X 13
+#define CANVAS_Y 5
+
+static uint8_t canvas_buffer[CANVAS_STRIDE * ((CANVAS_H + 7) / 8)];
+static surface_t canvas;
+
+/* a widget, drawn to any surface */
+static void draw_widget(surface_t *dst, uint32_t n) {
+    char text[4] = { 'A' + n % 26, 'b', '0' + n % 10, '\0' };
+    fill_display(dst, PIXEL_OFF);
+    draw_rectangle(dst, 0, 0, CANVAS_W - 1, 0, PIXEL_ON);
+    draw_textbox(dst, text, 3, 1, 2, 28, 15, PIXEL_ON, PIXEL_OFF);
+    fill_circle(dst, 36, 10, 7, PIXEL_TOGGLE);
+    draw_line(dst, 0, 20, 44, 12, PIXEL_ON);
+    draw_triangle(dst, 30, 19, 44, 19, 40, 2, PIXEL_TOGGLE);
+}
+
+/* widgets drawn off-screen and blitted equal widgets drawn in place */
+static void check_canvas(void) {
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+
+    fill_display(screen, PIXEL_OFF);
+    set_viewport(screen, CANVAS_X, CANVAS_Y, CANVAS_X + CANVAS_W - 1,
+            CANVAS_Y + CANVAS_H - 1);
+    draw_widget(screen, 7);
+    reset_viewport(screen);
+    ssd1306_update_display(&display);
+    memcpy(a, emu.gddram, sizeof(a));
+
+    /* drawing to the canvas leaves the display and the stride padding be */
+    surface_init(&canvas, canvas_buffer, CANVAS_W, CANVAS_H, CANVAS_STRIDE);
+    for (uint32_t p = 0; p < (CANVAS_H + 7) / 8; p++) {
+        memset(&canvas_buffer[p * CANVAS_STRIDE + CANVAS_W], 0xA5,
+                CANVAS_STRIDE - CANVAS_W);
+    }
+    fill_display(screen, PIXEL_OFF);
+    ssd1306_update_display(&display);
+    emu_clear_stats(&emu);
+    draw_widget(&canvas, 7);
+    ssd1306_update_display(&display);
+    bool ok = emu.stats.transactions == 0;
+    for (uint32_t p = 0; p < (CANVAS_H + 7) / 8; p++) {
+        for (uint32_t i = CANVAS_W; i < CANVAS_STRIDE; i++) {
+            ok = ok && canvas_buffer[p * CANVAS_STRIDE + i] == 0xA5;
+        }
+    }
+    check(ok, "canvas drawing stays in the canvas");
+
+    blit_surface(screen, &canvas, 0, 0, CANVAS_W, CANVAS_H, CANVAS_X,
+            CANVAS_Y, BLEND_COPY);
+    ssd1306_update_display(&display);
+    check(!memcmp(a, emu.gddram, sizeof(a)), "blitted canvas matches");
+    emu_clear_stats(&emu);
+}
+
+/* the second display, without a framebuffer */
+static const ssd1306_config_t config_streamed = {
+#ifdef SSD1306_I2C
+    .i2c = I2C1,
+    .addr = SSD1306_ADDR_SECONDARY,
+#elif defined(SSD1306_SPI)
+    .spi = SPI1,
+    .cs_port = CS2_PORT,
+    .cs_pin = CS2_PIN,
+    .dc_port = DC_PORT,
+    .dc_pin = DC_PIN,
+    .reset_port = RESET2_PORT,
+    .reset_pin = RESET2_PIN,
+#endif
+    .buffer = NULL,
+};
+
+static uint8_t list_buffer[192];
+static display_list_t list;
+static uint8_t page_buffers[2 * DISP_WIDTH];
+
+/* a frame of text, lines, rectangles and images, recorded */
+static void record_scene(display_list_t *dl, uint32_t n) {
+    display_list_clear(dl);
+    display_list_fill(dl, PIXEL_OFF);
+    display_list_rectangle(dl, 0, 0, 127, 9, PIXEL_ON);
+    display_list_text(dl, "12:34", 5, 2 + n % 4, 1 + n % 3, PIXEL_OFF);
+    display_list_line(dl, 0, 63, 127, 12, PIXEL_ON);
+    display_list_bitmap(dl, &test_image, 3, 11 + n % 5, BLEND_XOR);
+    display_list_blit(dl, &sprite, 0, 0, SPRITE_W, SPRITE_H, 60, 17,
+            BLEND_MASKED);
+    display_list_rectangle(dl, 50, 20 + n % 7, 100, 40, PIXEL_TOGGLE);
+}
+
+/* ... and drawn directly */
+static void draw_scene(surface_t *dst, uint32_t n) {
+    fill_display(dst, PIXEL_OFF);
+    draw_rectangle(dst, 0, 0, 127, 9, PIXEL_ON);
+    for (uint8_t k = 0; k < 5; k++) {
+        draw_character(dst, "12:34"[k], 2 + n % 4 + 8 * k, 1 + n % 3,
+                PIXEL_OFF);
+    }
+    draw_line(dst, 0, 63, 127, 12, PIXEL_ON);
+    draw_bitmap(dst, &test_image, 3, 11 + n % 5, BLEND_XOR);
+    blit(dst, &sprite, 0, 0, SPRITE_W, SPRITE_H, 60, 17, BLEND_MASKED);
+    draw_rectangle(dst, 50, 20 + n % 7, 100, 40, PIXEL_TOGGLE);
+}
+
+/* true if the panels of both display models show the same pixels */
+static bool panels_match(void) {
+    for (uint32_t p = 0; p < DISP_PAGES; p++) {
+        if (memcmp(&emu.gddram[p][DISP_COL_OFFSET],
+                    &emu2.gddram[p][DISP_COL_OFFSET], DISP_WIDTH)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* display lists rendered a page at a time equal the scene drawn directly */
+static void check_display_list(void) {
+    uint8_t a[EMU_PAGES][EMU_COLUMNS];
+    display_list_init(&list, list_buffer, sizeof(list_buffer));
+    ssd1306_init(&display2, &config_streamed);
+    emu_clear_stats(&emu2);
+
+    bool ok = true;
+    for (uint32_t n = 0; n < 12; n++) {
+        draw_scene(screen, n);
+        ssd1306_update_display(&display);
+        memcpy(a, emu.gddram, sizeof(a));
+
+        record_scene(&list, n);
+        fill_display(screen, PIXEL_TOGGLE);
+        display_list_draw(&list, screen);
+        ssd1306_update_display(&display);
+        ok = ok && !memcmp(a, emu.gddram, sizeof(a));
+
+        ok = ok && display_list_render(&list, &display2, page_buffers,
+                1 + n % 2) && panels_match();
+    }
+    check(ok, "display list matches direct drawing");
+    check(display2.surface.clip.x0 > display2.surface.clip.x1
+            && ssd1306_update_display(&display2),
+            "display without a framebuffer");
+    emu_clear_stats(&emu);
+
+    /* one frame, for its traffic */
+    emu_clear_stats(&emu2);
+    display_list_render(&list, &display2, page_buffers, 2);
+    emu.stats = emu2.stats;
+    emu_clear_stats(&emu2);
+    report("display list render");
+
+    display_list_init(&list, list_buffer, 20);
+    check(display_list_rectangle(&list, 0, 0, 9, 9, PIXEL_ON)
+            && !display_list_text(&list, "0123456789", 10, 0, 0, PIXEL_ON)
+            && list.len == 9, "full display list drops commands");
+    display_list_init(&list, list_buffer, sizeof(list_buffer));
+    record_scene(&list, 0);
+    printf("display list: %u bytes per frame\n", (unsigned) list.len);
+}
+
+/* true if character c is shown with its top left pixel at (x, y) */
+static bool shows_character(char c, uint8_t x, uint8_t y) {
+    for (uint8_t row = 0; row < 8; row++) {
+        for (uint8_t col = 0; col < 8; col++) {
+            bool lit = (font8x8_basic[(size_t) c][row] >> col) & 0x1;
+            if (emu_pixel(&emu, x + col, y + row) != lit) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* bus traffic per line of a scrolling log, one flush per line */
+static void bench_console(void) {
+    const uint32_t lines = 32;
+
+    console_init(&display);
+    for (uint32_t n = 0; n < CONSOLE_ROWS; n++) {
+        console_printf("boot %u\n", (unsigned) n);
+    }
+    console_flush();
+    emu_clear_stats(&emu);
+
+    for (uint32_t n = 0; n < lines; n++) {
+        char line[16];
+        snprintf(line, sizeof(line), "%c log line %u", 'A' + n % 26,
+                (unsigned) n);
+        /* one row per line, however narrow the panel */
+        console_printf("%.*s\n", CONSOLE_COLS, line);
+        console_flush();
+    }
+
+    const emu_stats_t *s = &emu.stats;
+    printf("\n%-24s %6.1f %8.1f %8.1f %8.1f %10.1f\n", "console, per line",
+            (double) s->transactions / lines, (double) s->bus_bytes / lines,
+            (double) s->command_bytes / lines, (double) s->data_bytes / lines,
+            (double) s->bus_ps / 1e6 / lines);
+    dump("console");
+
+    /* last line at the bottom of the panel, the one before just above it */
+    check(shows_character('A' + (lines - 1) % 26, 0, DISP_HEIGHT - 8)
+            && shows_character('A' + (lines - 2) % 26, 0, DISP_HEIGHT - 16),
+            "console scrolled");
+
+    console_init(&display);
+    console_flush();
+    emu_clear_stats(&emu);
+}
+
+static void bench_primitive(const char *name, void (*draw)(uint32_t n)) {
+    uint64_t t0 = nanos64();
+    for (uint32_t n = 0; n < PRIMITIVE_REPS; n++) {
+        draw(n);
+    }
+    uint64_t t1 = nanos64();
+    printf("%-24s %10.0f\n", name, (double) (t1 - t0) / PRIMITIVE_REPS);
+}
+
+static void draw_fill(uint32_t n) {
+    fill_display(screen, n & 1 ? PIXEL_ON : PIXEL_OFF);
+}
+
+static void draw_rect_small(uint32_t n) {
+    (void) n;
+    draw_rectangle(screen, 10, 10, 20, 20, PIXEL_TOGGLE);
+}
+
+static void draw_rect_large(uint32_t n) {
+    (void) n;
+    draw_rectangle(screen, 3, 5, 124, 58, PIXEL_TOGGLE);
+}
+
+static void draw_rect_small_reference(uint32_t n) {
+    (void) n;
+    draw_rectangle_reference(10, 10, 20, 20, PIXEL_TOGGLE);
+}
+
+static void draw_rect_large_reference(uint32_t n) {
+    (void) n;
+    draw_rectangle_reference(3, 5, 124, 58, PIXEL_TOGGLE);
+}
+
+static void draw_fill_reference(uint32_t n) {
+    draw_rectangle_reference(0, 0, DISP_WIDTH - 1, DISP_HEIGHT - 1,
+            n & 1 ? PIXEL_ON : PIXEL_OFF);
+}
+
+static void draw_checkers(uint32_t n) {
+    (void) n;
+    draw_checkerboard(screen);
+}
+
+static void draw_checkers_reference(uint32_t n) {
+    (void) n;
+    draw_checkerboard_reference();
+}
+
+static void draw_invert(uint32_t n) {
+    (void) n;
+    fill_display(screen, PIXEL_TOGGLE);
+}
+
+static void draw_scroll_pages(uint32_t n) {
+    (void) n;
+    ssd1306_blend_pages(&display, 0, 1, DISP_PAGES - 1, BLEND_COPY);
+}
+
+static void draw_chars(uint32_t n) {
+    draw_character(screen, 'A' + n % 26, 8, 16, PIXEL_TOGGLE);
+    draw_character(screen, 'a' + n % 26, 16, 19, PIXEL_TOGGLE);
+}
+
+static void draw_chars_reference(uint32_t n) {
+    draw_character_reference('A' + n % 26, 8, 16, PIXEL_TOGGLE);
+    draw_character_reference('a' + n % 26, 16, 19, PIXEL_TOGGLE);
+}
+
+static void draw_lines(uint32_t n) {
+    (void) n;
+    draw_line(screen, 0, 0, 127, 63, PIXEL_TOGGLE);
+}
+
+static void draw_lines_reference(uint32_t n) {
+    (void) n;
+    draw_line_reference(0, 0, 127, 63, PIXEL_TOGGLE);
+}
+
+static void draw_lines_straight(uint32_t n) {
+    (void) n;
+    draw_line(screen, 0, 20, 127, 20, PIXEL_TOGGLE);
+    draw_line(screen, 40, 0, 40, 63, PIXEL_TOGGLE);
+}
+
+static void draw_lines_offscreen(uint32_t n) {
+    (void) n;
+    draw_line(screen, 0, 60, 255, 124, PIXEL_TOGGLE);
+}
+
+static void draw_circle_filled(uint32_t n) {
+    (void) n;
+    fill_circle(screen, 64, 32, 30, PIXEL_TOGGLE);
+}
+
+/* the filled circle as a stack of horizontal lines */
+static void draw_circle_lines(uint32_t n) {
+    (void) n;
+    for (int32_t dy = -30; dy <= 30; dy++) {
+        int32_t dx = 0;
+        while ((dx + 1) * (dx + 1) + dy * dy <= 30 * 30) {
+            dx++;
+        }
+        draw_line(screen, 64 - dx, 32 + dy, 64 + dx, 32 + dy,
+                PIXEL_TOGGLE);
+    }
+}
+
+static void draw_circle_outline(uint32_t n) {
+    (void) n;
+    draw_circle(screen, 64, 32, 30, PIXEL_TOGGLE);
+}
+
+static void draw_triangle_filled(uint32_t n) {
+    (void) n;
+    fill_triangle(screen, 3, 60, 80, 2, 124, 48, PIXEL_TOGGLE);
+}
+
+static void draw_star_filled(uint32_t n) {
+    (void) n;
+    fill_polygon(screen, star, sizeof(star) / sizeof(star[0]),
+            PIXEL_TOGGLE);
+}
+
+/* alternating with a blank screen, so every call changes every page */
+static void draw_splash(uint32_t n) {
+    if (n & 1) {
+        draw_bitmap(screen, &splash_image, 0, 0, BLEND_COPY);
+    } else {
+        fill_display(screen, PIXEL_OFF);
+    }
+}
+
+static void draw_splash_xor(uint32_t n) {
+    (void) n;
+    draw_bitmap(screen, &splash_image, 0, 0, BLEND_XOR);
+}
+
+/* the same image stored as literal runs only, i.e. uncompressed */
+static void draw_splash_raw(uint32_t n) {
+    if (n & 1) {
+        draw_bitmap(screen, &splash_raw_image, 0, 0, BLEND_COPY);
+    } else {
+        fill_display(screen, PIXEL_OFF);
+    }
+}
+
+static void draw_splash_raw_xor(uint32_t n) {
+    (void) n;
+    draw_bitmap(screen, &splash_raw_image, 0, 0, BLEND_XOR);
+}
+
+static void draw_sprite(uint32_t n) {
+    blit(screen, &sprite, 0, 0, SPRITE_W, SPRITE_H, 40 + n % 8, 11,
+            BLEND_MASKED);
+}
+
+static void draw_sprite_reference(uint32_t n) {
+    static const uint8_t r[] = { 0, 0, SPRITE_W, SPRITE_H, 40, 11 };
+    (void) n;
+    blit_reference(r, BLEND_MASKED, false);
+}
+
+/* the canvas widget, drawn in place */
+static void draw_widget_direct(uint32_t n) {
+    set_viewport(screen, CANVAS_X, CANVAS_Y, CANVAS_X + CANVAS_W - 1,
+            CANVAS_Y + CANVAS_H - 1);
+    draw_widget(screen, n % 2);
+    reset_viewport(screen);
+}
+
+/* ... and composited from the canvas, drawn once */
+static void draw_widget_blit(uint32_t n) {
+    if (n == 0) {
+        draw_widget(&canvas, 0);
+    }
+    blit_surface(screen, &canvas, 0, 0, CANVAS_W, CANVAS_H, CANVAS_X,
+            CANVAS_Y + n % 2, BLEND_COPY);
+}
+
+/* a frame drawn to the framebuffer and flushed ... */
+static void draw_scene_flushed(uint32_t n) {
+    draw_scene(screen, n);
+    ssd1306_update_display(&display);
+}
+
+/* ... and recorded and rendered without a framebuffer */
+static void draw_scene_streamed(uint32_t n) {
+    record_scene(&list, n);
+    display_list_render(&list, &display2, page_buffers, 2);
+}
+
+static void draw_text(uint32_t n) {
+    (void) n;
+    draw_textbox(screen, "three\nlines\nnow!", 16, 2, 30, 46, 62, PIXEL_ON,
+            PIXEL_OFF);
+}
+
+static void bench_primitives(void) {
+    printf("\n%-24s %10s\n", "primitive", "ns/call");
+    bench_primitive("fill_display", draw_fill);
+    bench_primitive("  per-pixel reference", draw_fill_reference);
+    bench_primitive("fill_display toggle", draw_invert);
+    bench_primitive("draw_checkerboard", draw_checkers);
+    bench_primitive("  per-pixel reference", draw_checkers_reference);
+    bench_primitive("blend_pages 7 copy", draw_scroll_pages);
+    bench_primitive("draw_rectangle 11x11", draw_rect_small);
+    bench_primitive("  per-pixel reference", draw_rect_small_reference);
+    bench_primitive("draw_rectangle 122x54", draw_rect_large);
+    bench_primitive("  per-pixel reference", draw_rect_large_reference);
+    bench_primitive("draw_line diagonal", draw_lines);
+    bench_primitive("  per-pixel reference", draw_lines_reference);
+    bench_primitive("draw_line h + v", draw_lines_straight);
+    bench_primitive("draw_line mostly off", draw_lines_offscreen);
+    bench_primitive("fill_circle r30", draw_circle_filled);
+    bench_primitive("  draw_line per row", draw_circle_lines);
+    bench_primitive("draw_circle r30", draw_circle_outline);
+    bench_primitive("fill_triangle", draw_triangle_filled);
+    bench_primitive("fill_polygon star", draw_star_filled);
+    bench_primitive("draw_bitmap + fill", draw_splash);
+    bench_primitive("  uncompressed", draw_splash_raw);
+    bench_primitive("draw_bitmap xor", draw_splash_xor);
+    bench_primitive("  uncompressed", draw_splash_raw_xor);
+    bench_primitive("blit 37x29 masked", draw_sprite);
+    bench_primitive("  per-pixel reference", draw_sprite_reference);
+    bench_primitive("widget 45x21 redrawn", draw_widget_direct);
+    bench_primitive("  blitted from canvas", draw_widget_blit);
+    bench_primitive("scene drawn + flushed", draw_scene_flushed);
+    bench_primitive("  display list render", draw_scene_streamed);
+    bench_primitive("draw_character x2", draw_chars);
+    bench_primitive("  per-pixel reference", draw_chars_reference);
+    bench_primitive("draw_textbox 3 lines", draw_text);
+    ssd1306_update_display(&display);
+    emu_clear_stats(&emu);
+}
+
+/* frame scheduler runs: rate, and frames per run */
+#define FRAME_FPS 500
+#define FRAME_COUNT 40
+
+static uint32_t frame_numbers[FRAME_COUNT];
+static uint32_t nrendered;
+static uint32_t render_busy_us; /* extra render time, to overload */
+
+/* a bar moving one column per frame */
+static void render_bar(surface_t *s, uint32_t frame, void *ctx) {
+    (void) ctx;
+    if (nrendered < FRAME_COUNT) {
+        frame_numbers[nrendered] = frame;
+    }
+    nrendered++;
+
+    uint8_t x = frame % DISP_WIDTH;
+    fill_display(s, PIXEL_OFF);
+    draw_rectangle(s, x, 0, x, DISP_HEIGHT - 1, PIXEL_ON);
+
+    uint64_t t0 = micros64();
+    while (micros64() - t0 < render_busy_us);
+}
+
+/* run the scheduler; true if frames were numbered by the periods dropped */
+static bool run_frames(frame_scheduler_t *fs, const char *name) {
+    nrendered = 0;
+    uint64_t t0 = micros64();
+    check(frame_scheduler_run(fs, FRAME_COUNT), "frame scheduler run");
+    uint64_t t = micros64() - t0;
+    while (ssd1306_flush_busy(&display));
+
+    const frame_stats_t *st = frame_scheduler_stats(fs);
+    printf("%-24s %6u %8u %8u %8.1f  ", name, (unsigned) st->frames,
+            (unsigned) st->dropped, (unsigned) st->render_max_us,
+            (double) t / 1e3);
+    for (uint32_t i = 0; i < FRAME_HISTOGRAM_BINS; i++) {
+        if (st->histogram[i]) {
+            printf(" %u:%u", (unsigned) i, (unsigned) st->histogram[i]);
+        }
+    }
+    printf("\n");
+
+    /* never early: each frame starts on or after its period */
+    uint32_t periods = FRAME_COUNT - 1 + st->dropped;
+    check(t >= (uint64_t) periods * fs->period_us, "frames not early");
+
+    uint32_t counted = 0;
+    for (uint32_t i = 0; i < FRAME_HISTOGRAM_BINS; i++) {
+        counted += st->histogram[i];
+    }
+    check(counted == FRAME_COUNT - 1, "every frame interval counted");
+
+    bool numbered = nrendered == FRAME_COUNT;
+    for (uint32_t i = 1; numbered && i < FRAME_COUNT; i++) {
+        numbered = frame_numbers[i] > frame_numbers[i - 1];
+    }
+    return numbered && frame_numbers[FRAME_COUNT - 1] == periods;
+}
+
+/* frames paced by the scheduler, on time and overloaded */
+static void bench_frames(void) {
+    frame_scheduler_t fs;
+    uint32_t wfi = periph_wfi_count();
+
+    printf("\n%-24s %6s %8s %8s %8s   %s\n", "scheduled frames",
+            "frames", "dropped", "render", "ms", "intervals (1/4 period)");
+
+    render_busy_us = 0;
+    frame_scheduler_init(&fs, &display, FRAME_FPS, render_bar, NULL);
+    check(run_frames(&fs, "on time"), "frames numbered by period");
+    check(periph_wfi_count() > wfi, "scheduler sleeps between frames");
+    check(matches_full_refresh(&display, &emu)
+            && emu_pixel(&emu, frame_numbers[FRAME_COUNT - 1] % DISP_WIDTH,
+                0), "last scheduled frame shown");
+
+    /* each frame takes 2.5 periods: the ones in between are dropped */
+    render_busy_us = 5 * fs.period_us / 2;
+    frame_scheduler_init(&fs, &display, FRAME_FPS, render_bar, NULL);
+    check(run_frames(&fs, "overloaded x2.5"), "dropped frames skipped");
+    check(fs.stats.dropped >= FRAME_COUNT, "overload drops frames");
+    check(matches_full_refresh(&display, &emu),
+            "overloaded frames match full refresh");
+
+    render_busy_us = 0;
+    emu_clear_stats(&emu);
+}
+
+/* a glyph, timed as a profiling region */
+static void draw_glyph_profiled(uint32_t n) {
+    PROF_BEGIN(glyph);
+    draw_character(screen, 'A' + n % 26, (n * 8) % DISP_WIDTH,
+            (n / 16 * 8) % DISP_HEIGHT, PIXEL_ON);
+    PROF_END(glyph);
+}
+
+/* the time base, and the regions profiled over the whole run */
+static void bench_profile(void) {
+    uint64_t us = micros64();
+    uint64_t ns = nanos64();
+    check(ns / 1000 >= us && micros64() >= us, "time base monotonic");
+
+    for (uint32_t n = 0; n < PRIMITIVE_REPS; n++) {
+        draw_glyph_profiled(n);
+    }
+
+    uint32_t nregions;
+    const profile_region_t *r = profile_regions(&nregions);
+    printf("\n%-24s %8s %10s %10s %10s\n", "profile region", "count",
+            "min ns", "mean ns", "max ns");
+    for (uint32_t i = 0; i < nregions; i++) {
+        uint32_t mean = profile_mean_ns(&r[i]);
+        printf("%-24s %8u %10u %10u %10u\n", r[i].name,
+                (unsigned) r[i].count, (unsigned) r[i].min_ns,
+                (unsigned) mean, (unsigned) r[i].max_ns);
+        check(r[i].count > 0 && r[i].min_ns <= mean && mean <= r[i].max_ns,
+                "profile region statistics");
+    }
+    const profile_region_t *glyph = profile_region("glyph");
+    check(glyph && glyph->count == PRIMITIVE_REPS, "glyph region counted");
+    ssd1306_update_display(&display);
+    emu_clear_stats(&emu);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-o DIR]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    setup();
+#ifdef SSD1306_I2C
+    printf("I2C, SCL %u Hz\n\n", (unsigned) periph_i2c_scl_hz());
+#elif defined(SSD1306_SPI)
+    printf("SPI, SCK %u Hz\n\n", (unsigned) periph_spi_sck_hz());
+#endif
+
+    bench_flushes();
+#ifdef SSD1306_I2C
+    bench_i2c_speeds();
+    check_i2c_recovery();
+#elif defined(SSD1306_SPI)
+    bench_spi_writes();
+#endif
+    bench_two_displays();
+    check_mixed_buses();
+    check_flush_transactions();
+    bench_mock();
+    check_slow_flush();
+    check_rectangles();
+    check_bulk();
+    check_characters();
+    check_lines();
+    check_clipping();
+    check_shapes();
+    make_images();
+    check_bitmaps();
+    check_blit();
+    check_canvas();
+    check_display_list();
+    bench_console();
+    bench_frames();
+    bench_primitives();
+    bench_profile();
+
+    if (failures) {
+        printf("\n%d check(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Generate a column-major (page oriented) copy of font8x8_basic
+ *
+ * font8x8_basic stores each glyph as 8 rows, bit n of a row being column n.
+ * The display stores 8 vertical pixels per byte, so drawing from the row
+ * table means a pixel at a time. The generated table stores each glyph as 8
+ * columns, bit n of a column being row n: one glyph column is one page byte.
+ *
+ * usage: fontgen > font8x8_columns.h
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "font8x8_basic.h"
+
+int main(void) {
+    printf("/*\n"
+            " * font8x8_basic, column-major: font8x8_columns[c][x] is column x of\n"
+            " * glyph c, bit n being row n (the layout of a display page byte)\n"
+            " *\n"
+            " * Generated by host/fontgen.c from font8x8_basic.h; do not edit.\n"
+            " */\n\n"
+            "#ifndef FONT8X8_COLUMNS_H\n"
+            "#define FONT8X8_COLUMNS_H\n\n"
+            "#include <stdint.h>\n\n"
+            "static const uint8_t font8x8_columns[128][8] = {\n");
+
+    for (int c = 0; c < 128; c++) {
+        uint8_t columns[8] = { 0 };
+        for (int row = 0; row < 8; row++) {
+            for (int col = 0; col < 8; col++) {
+                if ((font8x8_basic[c][row] >> col) & 0x1) {
+                    columns[col] |= 1 << row;
+                }
+            }
+        }
+
+        printf("    {");
+        for (int col = 0; col < 8; col++) {
+            printf(" 0x%02X%s", columns[col], col < 7 ? "," : "");
+        }
+        if (c >= 0x20 && c < 0x7F) {
+            printf(" }%s /* U+%04X (%c) */\n", c < 127 ? "," : " ", c, c);
+        } else {
+            printf(" }%s /* U+%04X */\n", c < 127 ? "," : " ", c);
+        }
+    }
+
+    printf("};\n\n#endif\n");
+    return 0;
+}
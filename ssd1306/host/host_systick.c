@@ -0,0 +1,48 @@
+/*
+ * Host stand-in for systick.c: time since setup from the monotonic clock
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "systick.h"
+
+static struct timespec t_start;
+
+/* return current value of milliseconds counter (since systick initialized) */
+uint32_t millis(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint32_t) ((t.tv_sec - t_start.tv_sec) * 1000
+            + (t.tv_nsec - t_start.tv_nsec) / 1000000);
+}
+
+/* nanoseconds on the monotonic clock since systick_setup() */
+static uint64_t elapsed_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) (t.tv_sec - t_start.tv_sec) * 1000000000
+        + (uint64_t) t.tv_nsec - (uint64_t) t_start.tv_nsec;
+}
+
+/* return microseconds since systick initialized (does not wrap) */
+uint64_t micros64(void) {
+    return elapsed_ns() / 1000;
+}
+
+/* return nanoseconds since systick initialized */
+uint64_t nanos64(void) {
+    return elapsed_ns();
+}
+
+/* delay (blocking) for ms milliseconds */
+void delay(uint32_t ms) {
+    struct timespec t = { .tv_sec = ms / 1000,
+        .tv_nsec = (long) (ms % 1000) * 1000000 };
+    while (nanosleep(&t, &t) != 0);
+}
+
+/* setup systick to fire every 1 ms */
+void systick_setup(void) {
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
@@ -0,0 +1,18 @@
+#ifndef HOST_CORTEX_H
+#define HOST_CORTEX_H
+
+/*
+ * Host stand-in for libopencm3/cm3/cortex.h
+ *
+ * Interrupt handlers only ever run synchronously inside peripheral calls, so
+ * masking interrupts only has to be remembered, not enforced.
+ */
+
+#include <stdint.h>
+
+uint32_t cm_mask_interrupts(uint32_t mask);
+
+/* wait for interrupt: returns at once, counted by periph_wfi_count() */
+void __WFI(void);
+
+#endif
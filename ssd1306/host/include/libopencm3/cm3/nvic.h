@@ -0,0 +1,24 @@
+#ifndef HOST_NVIC_H
+#define HOST_NVIC_H
+
+/*
+ * Host stand-in for libopencm3/cm3/nvic.h
+ *
+ * Interrupt handlers are called by the peripheral models, synchronously,
+ * whenever an enabled interrupt becomes pending.
+ */
+
+#include <stdint.h>
+
+#define NVIC_DMA1_CHANNEL2_3_IRQ 10
+#define NVIC_I2C1_IRQ 23
+
+void nvic_enable_irq(uint8_t irqn);
+void nvic_disable_irq(uint8_t irqn);
+
+/* handlers defined by the firmware */
+void sys_tick_handler(void);
+void dma1_channel2_3_isr(void);
+void i2c1_isr(void);
+
+#endif
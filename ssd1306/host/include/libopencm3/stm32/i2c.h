@@ -0,0 +1,113 @@
+#ifndef HOST_I2C_H
+#define HOST_I2C_H
+
+/*
+ * Host stand-in for libopencm3/stm32/i2c.h
+ *
+ * Models the STM32F0 I2C master transmitter at the register level: CR2
+ * NBYTES/RELOAD/AUTOEND sequencing, the TXIS/TCR/TC/STOPF/NACKF/ARLO flags in
+ * ISR, write-1-to-clear ICR, and the enabled interrupts. Each byte written to
+ * TXDR is delivered to the addressed display immediately.
+ *
+ * Register macros go through host_i2c_reg(), which first applies any pending
+ * ICR writes, so flag reads always see the effect of earlier writes.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define I2C1 0U
+
+#define HOST_I2C_CR1 0x00
+#define HOST_I2C_CR2 0x04
+#define HOST_I2C_TIMINGR 0x10
+#define HOST_I2C_ISR 0x18
+#define HOST_I2C_ICR 0x1C
+#define HOST_I2C_TXDR 0x28
+
+uint32_t *host_i2c_reg(uint32_t i2c, uint32_t offset);
+
+#define I2C_CR1(i2c) (*host_i2c_reg((i2c), HOST_I2C_CR1))
+#define I2C_CR2(i2c) (*host_i2c_reg((i2c), HOST_I2C_CR2))
+#define I2C_TIMINGR(i2c) (*host_i2c_reg((i2c), HOST_I2C_TIMINGR))
+#define I2C_ISR(i2c) (*host_i2c_reg((i2c), HOST_I2C_ISR))
+#define I2C_ICR(i2c) (*host_i2c_reg((i2c), HOST_I2C_ICR))
+#define I2C_TXDR(i2c) (*host_i2c_reg((i2c), HOST_I2C_TXDR))
+
+#define I2C_CR1_PE (1 << 0)
+#define I2C_CR1_TXIE (1 << 1)
+#define I2C_CR1_RXIE (1 << 2)
+#define I2C_CR1_ADDRIE (1 << 3)
+#define I2C_CR1_NACKIE (1 << 4)
+#define I2C_CR1_STOPIE (1 << 5)
+#define I2C_CR1_TCIE (1 << 6)
+#define I2C_CR1_ERRIE (1 << 7)
+#define I2C_CR1_ANFOFF (1 << 12)
+
+#define I2C_CR2_RD_WRN (1 << 10)
+#define I2C_CR2_START (1 << 13)
+#define I2C_CR2_STOP (1 << 14)
+#define I2C_CR2_NBYTES_SHIFT 16
+#define I2C_CR2_NBYTES_MASK (0xFF << I2C_CR2_NBYTES_SHIFT)
+#define I2C_CR2_RELOAD (1 << 24)
+#define I2C_CR2_AUTOEND (1 << 25)
+
+#define I2C_ISR_TXE (1 << 0)
+#define I2C_ISR_TXIS (1 << 1)
+#define I2C_ISR_NACKF (1 << 4)
+#define I2C_ISR_STOPF (1 << 5)
+#define I2C_ISR_TC (1 << 6)
+#define I2C_ISR_TCR (1 << 7)
+#define I2C_ISR_BERR (1 << 8)
+#define I2C_ISR_ARLO (1 << 9)
+#define I2C_ISR_BUSY (1 << 15)
+
+#define I2C_ICR_NACKCF (1 << 4)
+#define I2C_ICR_STOPCF (1 << 5)
+#define I2C_ICR_BERRCF (1 << 8)
+#define I2C_ICR_ARLOCF (1 << 9)
+
+#define I2C_TIMINGR_PRESC_SHIFT 28
+#define I2C_TIMINGR_SCLDEL_SHIFT 20
+#define I2C_TIMINGR_SDADEL_SHIFT 16
+#define I2C_TIMINGR_SCLH_SHIFT 8
+#define I2C_TIMINGR_SCLL_SHIFT 0
+
+enum i2c_speeds {
+    i2c_speed_sm_100k,
+    i2c_speed_fm_400k,
+    i2c_speed_fmp_1m,
+    i2c_speed_unknown
+};
+
+void i2c_reset(uint32_t i2c);
+void i2c_peripheral_enable(uint32_t i2c);
+void i2c_peripheral_disable(uint32_t i2c);
+void i2c_enable_analog_filter(uint32_t i2c);
+void i2c_set_digital_filter(uint32_t i2c, uint8_t dnf_setting);
+void i2c_set_speed(uint32_t i2c, enum i2c_speeds speed, uint32_t clock_megahz);
+void i2c_set_prescaler(uint32_t i2c, uint8_t presc);
+void i2c_set_data_setup_time(uint32_t i2c, uint8_t s_time);
+void i2c_set_data_hold_time(uint32_t i2c, uint8_t h_time);
+void i2c_set_scl_high_period(uint32_t i2c, uint8_t period);
+void i2c_set_scl_low_period(uint32_t i2c, uint8_t period);
+void i2c_set_7bit_addr_mode(uint32_t i2c);
+void i2c_set_7bit_address(uint32_t i2c, uint8_t addr);
+void i2c_set_write_transfer_dir(uint32_t i2c);
+void i2c_set_bytes_to_transfer(uint32_t i2c, uint32_t n_bytes);
+void i2c_enable_autoend(uint32_t i2c);
+void i2c_disable_autoend(uint32_t i2c);
+void i2c_send_start(uint32_t i2c);
+void i2c_send_stop(uint32_t i2c);
+bool i2c_busy(uint32_t i2c);
+bool i2c_nack(uint32_t i2c);
+bool i2c_transmit_int_status(uint32_t i2c);
+bool i2c_transfer_complete(uint32_t i2c);
+void i2c_send_data(uint32_t i2c, uint8_t data);
+void i2c_enable_interrupt(uint32_t i2c, uint32_t interrupt);
+void i2c_disable_interrupt(uint32_t i2c, uint32_t interrupt);
+void i2c_transfer7(uint32_t i2c, uint8_t addr, uint8_t *w, size_t wn,
+        uint8_t *r, size_t rn);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef HOST_RCC_H
+#define HOST_RCC_H
+
+/*
+ * Host stand-in for libopencm3/stm32/rcc.h
+ *
+ * Only the calls used by the ssd1306 project are provided. Clocks are
+ * modelled as plain frequencies; enabling peripheral clocks is a no-op.
+ */
+
+#include <stdint.h>
+
+enum rcc_osc {
+    RCC_HSI14, RCC_HSI, RCC_HSE, RCC_PLL, RCC_LSI, RCC_LSE, RCC_HSI48
+};
+
+enum rcc_periph_clken {
+    RCC_DMA,
+    RCC_GPIOA,
+    RCC_GPIOB,
+    RCC_GPIOC,
+    RCC_I2C1,
+    RCC_SPI1,
+    RCC_SYSCFG_COMP
+};
+
+extern uint32_t rcc_ahb_frequency;
+extern uint32_t rcc_apb1_frequency;
+
+void rcc_periph_clock_enable(enum rcc_periph_clken clken);
+void rcc_osc_bypass_enable(enum rcc_osc osc);
+void rcc_clock_setup_in_hse_8mhz_out_48mhz(void);
+void rcc_set_i2c_clock_hsi(uint32_t i2c);
+void rcc_set_i2c_clock_sysclk(uint32_t i2c);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+/*
+ * Host stand-in for libopencm3/stm32/spi.h
+ *
+ * The modelled SPI shifts bytes out instantly: SR always reads as idle (TXE
+ * set, BSY clear, TX FIFO empty). Bytes are delivered to whichever display
+ * has its CS pin low.
+ */
+
+#include <stdint.h>
+
+#define SPI1 0U
+
+struct host_spi_regs {
+    uint32_t cr1;
+    uint32_t cr2;
+    uint32_t sr;
+    uint32_t dr;
+};
+
+struct host_spi_regs *host_spi(uint32_t spi);
+
+#define SPI_CR1(spi) (host_spi(spi)->cr1)
+#define SPI_CR2(spi) (host_spi(spi)->cr2)
+#define SPI_SR(spi) (host_spi(spi)->sr)
+#define SPI_DR(spi) (host_spi(spi)->dr)
+
+#define SPI_CR1_CPHA_CLK_TRANSITION_1 (0 << 0)
+#define SPI_CR1_CPHA_CLK_TRANSITION_2 (1 << 0)
+#define SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE (0 << 1)
+#define SPI_CR1_CPOL_CLK_TO_1_WHEN_IDLE (1 << 1)
+#define SPI_CR1_MSTR (1 << 2)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_2 (0x00 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_4 (0x01 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_8 (0x02 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_16 (0x03 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_32 (0x04 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_64 (0x05 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_128 (0x06 << 3)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_256 (0x07 << 3)
+#define SPI_CR1_BR_MASK (0x07 << 3)
+#define SPI_CR1_BR_SHIFT 3
+#define SPI_CR1_SPE (1 << 6)
+#define SPI_CR1_MSBFIRST (0 << 7)
+#define SPI_CR1_LSBFIRST (1 << 7)
+#define SPI_CR1_SSI (1 << 8)
+#define SPI_CR1_SSM (1 << 9)
+
+#define SPI_CR2_TXDMAEN (1 << 1)
+#define SPI_CR2_DS_8BIT (0x7 << 8)
+#define SPI_CR2_DS_16BIT (0xF << 8)
+
+#define SPI_SR_TXE (1 << 1)
+#define SPI_SR_BSY (1 << 7)
+#define SPI_SR_FTLVL_FIFO_EMPTY (0x0 << 11)
+#define SPI_SR_FTLVL_QUARTER_FIFO (0x1 << 11)
+#define SPI_SR_FTLVL_HALF_FIFO (0x2 << 11)
+#define SPI_SR_FTLVL_FIFO_FULL (0x3 << 11)
+
+int spi_init_master(uint32_t spi, uint32_t br, uint32_t cpol, uint32_t cpha,
+        uint32_t lsbfirst);
+void spi_enable(uint32_t spi);
+void spi_disable(uint32_t spi);
+void spi_enable_software_slave_management(uint32_t spi);
+void spi_set_nss_high(uint32_t spi);
+void spi_set_data_size(uint32_t spi, uint16_t data_s);
+void spi_send8(uint32_t spi, uint8_t data);
+void spi_send(uint32_t spi, uint16_t data);
+void spi_enable_tx_dma(uint32_t spi);
+void spi_disable_tx_dma(uint32_t spi);
+
+#endif
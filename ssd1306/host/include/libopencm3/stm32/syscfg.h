@@ -0,0 +1,19 @@
+#ifndef HOST_SYSCFG_H
+#define HOST_SYSCFG_H
+
+/*
+ * Host stand-in for libopencm3/stm32/syscfg.h
+ *
+ * Only CFGR1 is modelled, for the Fast-mode Plus drive of the I2C pins.
+ */
+
+#include <stdint.h>
+
+extern uint32_t host_syscfg_cfgr1;
+
+#define SYSCFG_CFGR1 host_syscfg_cfgr1
+
+#define SYSCFG_CFGR1_I2C_PA9_FMP (1 << 22)
+#define SYSCFG_CFGR1_I2C_PA10_FMP (1 << 23)
+
+#endif
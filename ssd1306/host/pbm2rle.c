@@ -0,0 +1,148 @@
+/*
+ * Convert a PBM image to a run-length encoded image for draw_bitmap()
+ *
+ * Reads a plain (P1) or raw (P4) PBM image of up to 255 x 255 pixels and
+ * writes a C definition of an image_t named NAME to stdout. Black (1) PBM
+ * pixels become set display pixels.
+ *
+ * usage: pbm2rle IN.pbm NAME > NAME.h
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ssd1306.h"
+#include "ssd1306_graphics.h"
+
+#include "rle.h"
+
+typedef struct {
+    unsigned width;
+    unsigned height;
+    uint8_t *pixels; /* one byte per pixel, row by row */
+} pbm_t;
+
+/* next header number, skipping whitespace and comments; -1 on error */
+static long read_number(FILE *f) {
+    int c = fgetc(f);
+    while (c == '#' || isspace(c)) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(f);
+            }
+        }
+        c = fgetc(f);
+    }
+    if (!isdigit(c)) {
+        return -1;
+    }
+    long n = 0;
+    while (isdigit(c)) {
+        n = n * 10 + (c - '0');
+        c = fgetc(f);
+    }
+    return n;
+}
+
+static int read_pbm(FILE *f, pbm_t *pbm) {
+    int m0 = fgetc(f);
+    int m1 = fgetc(f);
+    if (m0 != 'P' || (m1 != '1' && m1 != '4')) {
+        return -1;
+    }
+    long w = read_number(f);
+    long h = read_number(f);
+    if (w <= 0 || h <= 0 || w > 255 || h > 255) {
+        return -1;
+    }
+    pbm->width = w;
+    pbm->height = h;
+    pbm->pixels = malloc(w * h);
+    if (!pbm->pixels) {
+        return -1;
+    }
+
+    int byte = 0;
+    for (long y = 0; y < h; y++) {
+        for (long x = 0; x < w; x++) {
+            int bit;
+            if (m1 == '4') {
+                if (x % 8 == 0) {
+                    byte = fgetc(f);
+                    if (byte == EOF) {
+                        return -1;
+                    }
+                }
+                bit = (byte >> (7 - x % 8)) & 0x1;
+            } else {
+                int c;
+                do {
+                    c = fgetc(f);
+                } while (isspace(c));
+                if (c != '0' && c != '1') {
+                    return -1;
+                }
+                bit = c == '1';
+            }
+            pbm->pixels[y * w + x] = bit;
+        }
+    }
+    return 0;
+}
+
+static int pbm_pixel(const void *ctx, uint8_t x, uint8_t y) {
+    const pbm_t *pbm = ctx;
+    return pbm->pixels[y * pbm->width + x];
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s IN.pbm NAME > NAME.h\n", argv[0]);
+        return 2;
+    }
+    FILE *f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    pbm_t pbm;
+    if (read_pbm(f, &pbm)) {
+        fprintf(stderr, "%s: not a PBM image of up to 255x255 pixels\n",
+                argv[1]);
+        return 1;
+    }
+    fclose(f);
+
+    size_t n = pbm.width * ((pbm.height + 7) / 8);
+    uint8_t *pages = malloc(n);
+    uint8_t *rle = malloc(n + n / IMAGE_RLE_MAX_LITERAL + 1);
+    if (!pages || !rle) {
+        return 1;
+    }
+    rle_pages(pbm.width, pbm.height, pages, pbm_pixel, &pbm);
+    size_t len = rle_encode(pages, n, rle);
+
+    const char *name = argv[2];
+    printf("/*\n"
+            " * %ux%u image, %zu bytes run-length encoded (%zu as pages)\n"
+            " *\n"
+            " * Generated by host/pbm2rle.c from %s; do not edit.\n"
+            " */\n\n"
+            "#ifndef IMAGE_%s_H\n"
+            "#define IMAGE_%s_H\n\n"
+            "#include <stdint.h>\n\n"
+            "#include \"ssd1306_graphics.h\"\n\n"
+            "static const uint8_t %s_data[%zu] = {",
+            pbm.width, pbm.height, len, n, argv[1], name, name, name, len);
+    for (size_t i = 0; i < len; i++) {
+        printf("%s0x%02X,", i % 12 ? " " : "\n    ", rle[i]);
+    }
+    printf("\n};\n\n"
+            "static const image_t %s = { %u, %u, %s_data };\n\n"
+            "#endif\n",
+            name, pbm.width, pbm.height, name);
+    return 0;
+}
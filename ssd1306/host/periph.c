@@ -0,0 +1,906 @@
+/*
+ * Host models of the STM32F0 peripherals used by the ssd1306 project
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/i2c.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/syscfg.h>
+
+#include "periph.h"
+
+#define MAX_DISPLAYS 4
+#define GPIO_PORTS 3
+#define DMA_CHANNELS 8
+#define HSI_HZ 8000000
+
+/* give up if interrupts keep firing without the handler clearing them */
+#define IRQ_STORM_LIMIT 10000000
+
+typedef enum {
+    BUS_NONE,
+    BUS_I2C,
+    BUS_SPI
+} bus_t;
+
+typedef struct {
+    ssd1306_emu_t *emu;
+    bus_t bus;
+    uint8_t addr;
+    uint32_t cs_port;
+    uint16_t cs_pin;
+    uint32_t dc_port;
+    uint16_t dc_pin;
+    uint32_t reset_port;
+    uint16_t reset_pin;
+} display_t;
+
+static display_t displays[MAX_DISPLAYS];
+
+uint32_t rcc_ahb_frequency = HSI_HZ;
+uint32_t rcc_apb1_frequency = HSI_HZ;
+static bool i2c_clock_sysclk = false;
+
+uint32_t host_syscfg_cfgr1 = 0;
+
+/* I2C1 pins (AF4) */
+#define I2C1_PORT GPIOA
+#define I2C1_SCL GPIO9
+#define I2C1_SDA GPIO10
+
+/* SYSCFG_CFGR1 bits that give PA9/PA10 the Fast-mode Plus drive */
+#define I2C_FMP_DRIVE (SYSCFG_CFGR1_I2C_PA9_FMP | SYSCFG_CFGR1_I2C_PA10_FMP)
+
+static uint16_t gpio_odr[GPIO_PORTS];
+
+static struct host_spi_regs spi1;
+
+static struct {
+    bool enabled;
+    bool tcie;
+    uintptr_t cmar;
+    uint16_t cndtr;
+    uint32_t flags;
+} dma[DMA_CHANNELS];
+
+static struct {
+    uint32_t cr1;
+    uint32_t cr2;
+    uint32_t timingr;
+    uint32_t isr;
+    uint32_t icr;
+    uint32_t txdr;
+    uint32_t scratch; /* unmodelled registers */
+    bool active; /* between START and STOP */
+    uint32_t nbytes_left; /* bytes left in current NBYTES chunk */
+    ssd1306_emu_t *target; /* addressed display, NULL if NACKed */
+} i2c1;
+
+/* SCL pulses until a stuck slave lets go of SDA (0: SDA not held) */
+static uint32_t sda_held_clocks = 0;
+
+static bool nvic_enabled[32];
+static uint32_t primask = 0;
+static uint32_t irq_count = 0;
+static uint32_t spi_dr_writes = 0;
+static uint32_t wfi_count = 0;
+
+static void pump_interrupts(void);
+
+/*
+ * Displays
+ */
+
+/* attach a display model to I2C1 at a 7 bit address */
+void periph_attach_i2c(ssd1306_emu_t *emu, uint8_t addr) {
+    for (int i = 0; i < MAX_DISPLAYS; i++) {
+        if (displays[i].bus == BUS_NONE) {
+            displays[i].emu = emu;
+            displays[i].bus = BUS_I2C;
+            displays[i].addr = addr;
+            emu->i2c_addr = addr;
+            return;
+        }
+    }
+    fprintf(stderr, "periph: too many displays\n");
+    abort();
+}
+
+/* attach a display model to SPI1, selected by its CS pin (active low) */
+void periph_attach_spi(ssd1306_emu_t *emu, uint32_t cs_port, uint16_t cs_pin,
+        uint32_t dc_port, uint16_t dc_pin, uint32_t reset_port,
+        uint16_t reset_pin) {
+    for (int i = 0; i < MAX_DISPLAYS; i++) {
+        if (displays[i].bus == BUS_NONE) {
+            displays[i].emu = emu;
+            displays[i].bus = BUS_SPI;
+            displays[i].cs_port = cs_port;
+            displays[i].cs_pin = cs_pin;
+            displays[i].dc_port = dc_port;
+            displays[i].dc_pin = dc_pin;
+            displays[i].reset_port = reset_port;
+            displays[i].reset_pin = reset_pin;
+            return;
+        }
+    }
+    fprintf(stderr, "periph: too many displays\n");
+    abort();
+}
+
+/* reset all peripheral models and detach all displays */
+void periph_reset(void) {
+    memset(displays, 0, sizeof(displays));
+    memset(gpio_odr, 0, sizeof(gpio_odr));
+    memset(&spi1, 0, sizeof(spi1));
+    memset(dma, 0, sizeof(dma));
+    memset(&i2c1, 0, sizeof(i2c1));
+    memset(nvic_enabled, 0, sizeof(nvic_enabled));
+    primask = 0;
+    rcc_ahb_frequency = HSI_HZ;
+    rcc_apb1_frequency = HSI_HZ;
+    i2c_clock_sysclk = false;
+    host_syscfg_cfgr1 = 0;
+    sda_held_clocks = 0;
+    irq_count = 0;
+    spi_dr_writes = 0;
+    wfi_count = 0;
+}
+
+/* number of interrupt handler calls since reset */
+uint32_t periph_irq_count(void) {
+    return irq_count;
+}
+
+/* number of SPI1 DR writes by the CPU (not by DMA) since reset */
+uint32_t periph_spi_dr_writes(void) {
+    return spi_dr_writes;
+}
+
+/* number of WFI instructions executed since reset */
+uint32_t periph_wfi_count(void) {
+    return wfi_count;
+}
+
+/* hold I2C1 SDA low, as a slave stuck mid-byte, for `clocks` SCL pulses */
+void periph_i2c_hold_sda(uint32_t clocks) {
+    sda_held_clocks = clocks;
+}
+
+/* hold SDA low between transactions: the peripheral takes it for a START */
+void periph_i2c_hold_bus(uint32_t clocks) {
+    sda_held_clocks = clocks;
+    if (clocks && (i2c1.cr1 & I2C_CR1_PE)) {
+        i2c1.isr |= I2C_ISR_BUSY;
+    }
+}
+
+/* SCL pulses still needed before SDA is released (0 if it isn't held) */
+uint32_t periph_i2c_sda_held(void) {
+    return sda_held_clocks;
+}
+
+/*
+ * RCC
+ */
+
+void rcc_periph_clock_enable(enum rcc_periph_clken clken) {
+    (void) clken;
+}
+
+void rcc_osc_bypass_enable(enum rcc_osc osc) {
+    (void) osc;
+}
+
+void rcc_clock_setup_in_hse_8mhz_out_48mhz(void) {
+    rcc_ahb_frequency = 48000000;
+    rcc_apb1_frequency = 48000000;
+}
+
+void rcc_set_i2c_clock_hsi(uint32_t i2c) {
+    (void) i2c;
+    i2c_clock_sysclk = false;
+}
+
+void rcc_set_i2c_clock_sysclk(uint32_t i2c) {
+    (void) i2c;
+    i2c_clock_sysclk = true;
+}
+
+/*
+ * GPIO
+ */
+
+static bool pin_high(uint32_t port, uint16_t pin) {
+    return port < GPIO_PORTS && (gpio_odr[port] & pin);
+}
+
+/* update pin levels, and pass CS and RESET edges to the SPI displays */
+static void gpio_write(uint32_t port, uint16_t value) {
+    if (port >= GPIO_PORTS) {
+        return;
+    }
+    uint16_t old = gpio_odr[port];
+    gpio_odr[port] = value;
+
+    /* a stuck slave shifts out a bit on each SCL pulse driven by software */
+    if (port == I2C1_PORT && (~old & value & I2C1_SCL) && sda_held_clocks) {
+        sda_held_clocks--;
+    }
+
+    for (int i = 0; i < MAX_DISPLAYS; i++) {
+        display_t *d = &displays[i];
+        if (d->bus != BUS_SPI) {
+            continue;
+        }
+        if (d->cs_port == port && ((old ^ value) & d->cs_pin)) {
+            emu_spi_select(d->emu, !(value & d->cs_pin));
+        }
+        if (d->reset_port == port && ((old ^ value) & d->reset_pin)
+                && !(value & d->reset_pin)) {
+            emu_reset(d->emu);
+        }
+    }
+}
+
+void gpio_set(uint32_t gpioport, uint16_t gpios) {
+    if (gpioport < GPIO_PORTS) {
+        gpio_write(gpioport, gpio_odr[gpioport] | gpios);
+    }
+}
+
+void gpio_clear(uint32_t gpioport, uint16_t gpios) {
+    if (gpioport < GPIO_PORTS) {
+        gpio_write(gpioport, gpio_odr[gpioport] & ~gpios);
+    }
+}
+
+uint16_t gpio_get(uint32_t gpioport, uint16_t gpios) {
+    if (gpioport >= GPIO_PORTS) {
+        return 0;
+    }
+    uint16_t level = gpio_odr[gpioport];
+    if (gpioport == I2C1_PORT && sda_held_clocks) {
+        level &= ~I2C1_SDA; /* open drain: the slave wins */
+    }
+    return level & gpios;
+}
+
+void gpio_mode_setup(uint32_t gpioport, uint8_t mode, uint8_t pull_up_down,
+        uint16_t gpios) {
+    (void) gpioport;
+    (void) mode;
+    (void) pull_up_down;
+    (void) gpios;
+}
+
+void gpio_set_output_options(uint32_t gpioport, uint8_t otype, uint8_t speed,
+        uint16_t gpios) {
+    (void) gpioport;
+    (void) otype;
+    (void) speed;
+    (void) gpios;
+}
+
+void gpio_set_af(uint32_t gpioport, uint8_t alt_func_num, uint16_t gpios) {
+    (void) gpioport;
+    (void) alt_func_num;
+    (void) gpios;
+}
+
+/*
+ * Cortex
+ */
+
+void __WFI(void) {
+    /* the clock advances on its own: nothing to wait for */
+    wfi_count++;
+}
+
+uint32_t cm_mask_interrupts(uint32_t mask) {
+    uint32_t old = primask;
+    primask = mask;
+    if (!mask) {
+        pump_interrupts(); /* deliver what became pending while masked */
+    }
+    return old;
+}
+
+/*
+ * NVIC
+ */
+
+void nvic_enable_irq(uint8_t irqn) {
+    nvic_enabled[irqn] = true;
+    pump_interrupts();
+}
+
+void nvic_disable_irq(uint8_t irqn) {
+    nvic_enabled[irqn] = false;
+}
+
+/*
+ * SPI
+ */
+
+struct host_spi_regs *host_spi(uint32_t spi) {
+    (void) spi;
+    /* transfers are instant: always ready for more, never busy */
+    spi1.sr = SPI_SR_TXE;
+    return &spi1;
+}
+
+/* SCK frequency (Hz) produced by the current SPI1 baud rate prescaler */
+uint32_t periph_spi_sck_hz(void) {
+    uint32_t br = (spi1.cr1 & SPI_CR1_BR_MASK) >> SPI_CR1_BR_SHIFT;
+    return rcc_apb1_frequency >> (br + 1);
+}
+
+int spi_init_master(uint32_t spi, uint32_t br, uint32_t cpol, uint32_t cpha,
+        uint32_t lsbfirst) {
+    (void) spi;
+    spi1.cr1 = br | cpol | cpha | lsbfirst | SPI_CR1_MSTR;
+    spi1.cr2 = SPI_CR2_DS_8BIT;
+    return 0;
+}
+
+void spi_enable(uint32_t spi) {
+    (void) spi;
+    spi1.cr1 |= SPI_CR1_SPE;
+}
+
+void spi_disable(uint32_t spi) {
+    (void) spi;
+    spi1.cr1 &= ~SPI_CR1_SPE;
+}
+
+void spi_enable_software_slave_management(uint32_t spi) {
+    (void) spi;
+    spi1.cr1 |= SPI_CR1_SSM;
+}
+
+void spi_set_nss_high(uint32_t spi) {
+    (void) spi;
+    spi1.cr1 |= SPI_CR1_SSI;
+}
+
+void spi_set_data_size(uint32_t spi, uint16_t data_s) {
+    (void) spi;
+    spi1.cr2 = (spi1.cr2 & ~SPI_CR2_DS_16BIT) | data_s;
+}
+
+void spi_enable_tx_dma(uint32_t spi) {
+    (void) spi;
+    spi1.cr2 |= SPI_CR2_TXDMAEN;
+}
+
+void spi_disable_tx_dma(uint32_t spi) {
+    (void) spi;
+    spi1.cr2 &= ~SPI_CR2_TXDMAEN;
+}
+
+/* put one byte on the wire, to every display whose CS is low */
+static void spi_shift_out(uint8_t data) {
+    if (!(spi1.cr1 & SPI_CR1_SPE)) {
+        return;
+    }
+    for (int i = 0; i < MAX_DISPLAYS; i++) {
+        display_t *d = &displays[i];
+        if (d->bus == BUS_SPI && !pin_high(d->cs_port, d->cs_pin)) {
+            emu_set_spi_clock(d->emu, periph_spi_sck_hz());
+            emu_spi_byte(d->emu, data, pin_high(d->dc_port, d->dc_pin));
+        }
+    }
+}
+
+void spi_send8(uint32_t spi, uint8_t data) {
+    (void) spi;
+    spi_dr_writes++;
+    spi_shift_out(data);
+}
+
+/* 16 bit write to DR: with 8 bit frames, packs two frames, low byte first */
+void spi_send(uint32_t spi, uint16_t data) {
+    (void) spi;
+    spi_dr_writes++;
+    if ((spi1.cr2 & SPI_CR2_DS_16BIT) == SPI_CR2_DS_16BIT) {
+        spi_shift_out(data >> 8);
+        spi_shift_out(data & 0xFF);
+    } else {
+        spi_shift_out(data & 0xFF);
+        spi_shift_out(data >> 8);
+    }
+}
+
+/*
+ * DMA
+ */
+
+void dma_channel_reset(uint32_t dma_, uint8_t channel) {
+    (void) dma_;
+    memset(&dma[channel], 0, sizeof(dma[channel]));
+}
+
+void dma_set_peripheral_address(uint32_t dma_, uint8_t channel,
+        uintptr_t address) {
+    /* the peripheral is implied by the channel */
+    (void) dma_;
+    (void) channel;
+    (void) address;
+}
+
+void dma_set_memory_address(uint32_t dma_, uint8_t channel, uintptr_t address) {
+    (void) dma_;
+    dma[channel].cmar = address;
+}
+
+void dma_set_number_of_data(uint32_t dma_, uint8_t channel, uint16_t number) {
+    (void) dma_;
+    dma[channel].cndtr = number;
+}
+
+void dma_set_read_from_memory(uint32_t dma_, uint8_t channel) {
+    (void) dma_;
+    (void) channel;
+}
+
+void dma_enable_memory_increment_mode(uint32_t dma_, uint8_t channel) {
+    (void) dma_;
+    (void) channel;
+}
+
+void dma_set_peripheral_size(uint32_t dma_, uint8_t channel, uint32_t size) {
+    (void) dma_;
+    (void) channel;
+    (void) size;
+}
+
+void dma_set_memory_size(uint32_t dma_, uint8_t channel, uint32_t size) {
+    (void) dma_;
+    (void) channel;
+    (void) size;
+}
+
+void dma_set_priority(uint32_t dma_, uint8_t channel, uint32_t prio) {
+    (void) dma_;
+    (void) channel;
+    (void) prio;
+}
+
+void dma_enable_transfer_complete_interrupt(uint32_t dma_, uint8_t channel) {
+    (void) dma_;
+    dma[channel].tcie = true;
+    pump_interrupts();
+}
+
+void dma_enable_channel(uint32_t dma_, uint8_t channel) {
+    (void) dma_;
+    dma[channel].enabled = true;
+
+    /* channel 3 is SPI1_TX: move everything as soon as SPI requests it */
+    if (channel == DMA_CHANNEL3 && (spi1.cr2 & SPI_CR2_TXDMAEN)) {
+        const uint8_t *p = (const uint8_t *) dma[channel].cmar;
+        while (dma[channel].cndtr > 0) {
+            spi_shift_out(*p++);
+            dma[channel].cndtr--;
+        }
+        dma[channel].flags |= DMA_TCIF | DMA_GIF;
+    }
+    pump_interrupts();
+}
+
+void dma_disable_channel(uint32_t dma_, uint8_t channel) {
+    (void) dma_;
+    dma[channel].enabled = false;
+}
+
+bool dma_get_interrupt_flag(uint32_t dma_, uint8_t channel,
+        uint32_t interrupts) {
+    (void) dma_;
+    return dma[channel].flags & interrupts;
+}
+
+void dma_clear_interrupt_flags(uint32_t dma_, uint8_t channel,
+        uint32_t interrupts) {
+    (void) dma_;
+    dma[channel].flags &= ~interrupts;
+    if (!(dma[channel].flags & (DMA_TCIF | DMA_HTIF | DMA_TEIF))) {
+        dma[channel].flags &= ~DMA_GIF;
+    }
+}
+
+/*
+ * I2C
+ */
+
+/* apply write-1-to-clear ICR writes to ISR */
+static void i2c_sync(void) {
+    if (i2c1.icr) {
+        i2c1.isr &= ~(i2c1.icr & (I2C_ISR_NACKF | I2C_ISR_STOPF
+                    | I2C_ISR_BERR | I2C_ISR_ARLO));
+        i2c1.icr = 0;
+    }
+}
+
+uint32_t *host_i2c_reg(uint32_t i2c, uint32_t offset) {
+    (void) i2c;
+    i2c_sync();
+    switch (offset) {
+    case HOST_I2C_CR1:
+        return &i2c1.cr1;
+    case HOST_I2C_CR2:
+        return &i2c1.cr2;
+    case HOST_I2C_TIMINGR:
+        return &i2c1.timingr;
+    case HOST_I2C_ISR:
+        return &i2c1.isr;
+    case HOST_I2C_ICR:
+        return &i2c1.icr;
+    case HOST_I2C_TXDR:
+        return &i2c1.txdr;
+    default:
+        return &i2c1.scratch;
+    }
+}
+
+/* SCL frequency (Hz) produced by the current I2C1 TIMINGR and kernel clock */
+uint32_t periph_i2c_scl_hz(void) {
+    uint32_t kernel_hz = i2c_clock_sysclk ? rcc_ahb_frequency : HSI_HZ;
+    uint32_t presc = (i2c1.timingr >> I2C_TIMINGR_PRESC_SHIFT) & 0xF;
+    uint32_t sclh = (i2c1.timingr >> I2C_TIMINGR_SCLH_SHIFT) & 0xFF;
+    uint32_t scll = (i2c1.timingr >> I2C_TIMINGR_SCLL_SHIFT) & 0xFF;
+
+    /* SCL low + high periods, plus ~4 kernel clocks of SCL synchronization */
+    uint64_t cycles = (uint64_t) (scll + 1 + sclh + 1) * (presc + 1) + 4;
+    return kernel_hz / cycles;
+}
+
+/* generate a STOP and end the transaction */
+static void i2c_stop_condition(void) {
+    if (i2c1.target) {
+        emu_i2c_stop(i2c1.target);
+    }
+    i2c1.active = false;
+    i2c1.target = NULL;
+    i2c1.isr &= ~(I2C_ISR_BUSY | I2C_ISR_TXIS | I2C_ISR_TCR | I2C_ISR_TC);
+    i2c1.isr |= I2C_ISR_STOPF;
+    i2c1.cr2 &= ~(I2C_CR2_START | I2C_CR2_STOP);
+}
+
+/* end of an NBYTES chunk: reload, stop or wait for software */
+static void i2c_chunk_done(void) {
+    if (i2c1.cr2 & I2C_CR2_RELOAD) {
+        i2c1.isr |= I2C_ISR_TCR;
+    } else if (i2c1.cr2 & I2C_CR2_AUTOEND) {
+        i2c_stop_condition();
+    } else {
+        i2c1.isr |= I2C_ISR_TC;
+    }
+}
+
+/* slave did not acknowledge: STOP is automatic in autoend mode */
+static void i2c_nacked(void) {
+    i2c1.isr |= I2C_ISR_NACKF;
+    i2c1.isr &= ~I2C_ISR_TXIS;
+    if ((i2c1.cr2 & I2C_CR2_AUTOEND) && !(i2c1.cr2 & I2C_CR2_RELOAD)) {
+        i2c_stop_condition();
+    }
+}
+
+void i2c_reset(uint32_t i2c) {
+    (void) i2c;
+    memset(&i2c1, 0, sizeof(i2c1));
+}
+
+void i2c_peripheral_enable(uint32_t i2c) {
+    (void) i2c;
+    i2c1.cr1 |= I2C_CR1_PE;
+}
+
+void i2c_peripheral_disable(uint32_t i2c) {
+    (void) i2c;
+    /* clearing PE resets the state machine and the flags */
+    i2c1.cr1 &= ~I2C_CR1_PE;
+    i2c1.isr = 0;
+    i2c1.active = false;
+    i2c1.target = NULL;
+}
+
+void i2c_enable_analog_filter(uint32_t i2c) {
+    (void) i2c;
+    i2c1.cr1 &= ~I2C_CR1_ANFOFF;
+}
+
+void i2c_set_digital_filter(uint32_t i2c, uint8_t dnf_setting) {
+    (void) i2c;
+    i2c1.cr1 = (i2c1.cr1 & ~(0xF << 8)) | ((dnf_setting & 0xF) << 8);
+}
+
+void i2c_set_prescaler(uint32_t i2c, uint8_t presc) {
+    (void) i2c;
+    i2c1.timingr = (i2c1.timingr & ~(0xFU << I2C_TIMINGR_PRESC_SHIFT))
+        | ((uint32_t) (presc & 0xF) << I2C_TIMINGR_PRESC_SHIFT);
+}
+
+void i2c_set_data_setup_time(uint32_t i2c, uint8_t s_time) {
+    (void) i2c;
+    i2c1.timingr = (i2c1.timingr & ~(0xFU << I2C_TIMINGR_SCLDEL_SHIFT))
+        | ((uint32_t) (s_time & 0xF) << I2C_TIMINGR_SCLDEL_SHIFT);
+}
+
+void i2c_set_data_hold_time(uint32_t i2c, uint8_t h_time) {
+    (void) i2c;
+    i2c1.timingr = (i2c1.timingr & ~(0xFU << I2C_TIMINGR_SDADEL_SHIFT))
+        | ((uint32_t) (h_time & 0xF) << I2C_TIMINGR_SDADEL_SHIFT);
+}
+
+void i2c_set_scl_high_period(uint32_t i2c, uint8_t period) {
+    (void) i2c;
+    i2c1.timingr = (i2c1.timingr & ~(0xFFU << I2C_TIMINGR_SCLH_SHIFT))
+        | ((uint32_t) period << I2C_TIMINGR_SCLH_SHIFT);
+}
+
+void i2c_set_scl_low_period(uint32_t i2c, uint8_t period) {
+    (void) i2c;
+    i2c1.timingr = (i2c1.timingr & ~(0xFFU << I2C_TIMINGR_SCLL_SHIFT))
+        | ((uint32_t) period << I2C_TIMINGR_SCLL_SHIFT);
+}
+
+/* same TIMINGR values as libopencm3 */
+void i2c_set_speed(uint32_t i2c, enum i2c_speeds speed, uint32_t clock_megahz) {
+    switch (speed) {
+    case i2c_speed_fmp_1m:
+        i2c_set_prescaler(i2c, clock_megahz / 8 - 1);
+        i2c_set_scl_low_period(i2c, 0x4);
+        i2c_set_scl_high_period(i2c, 0x2);
+        i2c_set_data_hold_time(i2c, 0x0);
+        i2c_set_data_setup_time(i2c, 0x1);
+        break;
+    case i2c_speed_fm_400k:
+        i2c_set_prescaler(i2c, clock_megahz / 8 - 1);
+        i2c_set_scl_low_period(i2c, 0x9);
+        i2c_set_scl_high_period(i2c, 0x3);
+        i2c_set_data_hold_time(i2c, 0x3);
+        i2c_set_data_setup_time(i2c, 0x3);
+        break;
+    default:
+        i2c_set_prescaler(i2c, clock_megahz / 4 - 1);
+        i2c_set_scl_low_period(i2c, 0x13);
+        i2c_set_scl_high_period(i2c, 0xF);
+        i2c_set_data_hold_time(i2c, 0x2);
+        i2c_set_data_setup_time(i2c, 0x4);
+        break;
+    }
+}
+
+void i2c_set_7bit_addr_mode(uint32_t i2c) {
+    (void) i2c;
+    i2c1.cr2 &= ~(1 << 11);
+}
+
+void i2c_set_7bit_address(uint32_t i2c, uint8_t addr) {
+    (void) i2c;
+    i2c1.cr2 = (i2c1.cr2 & ~(0x7F << 1)) | ((addr & 0x7F) << 1);
+}
+
+void i2c_set_write_transfer_dir(uint32_t i2c) {
+    (void) i2c;
+    i2c1.cr2 &= ~I2C_CR2_RD_WRN;
+}
+
+void i2c_set_bytes_to_transfer(uint32_t i2c, uint32_t n_bytes) {
+    (void) i2c;
+    i2c_sync();
+    i2c1.cr2 = (i2c1.cr2 & ~I2C_CR2_NBYTES_MASK)
+        | ((n_bytes << I2C_CR2_NBYTES_SHIFT) & I2C_CR2_NBYTES_MASK);
+
+    /* writing a non-zero NBYTES clears TCR and continues the transfer */
+    if ((i2c1.isr & I2C_ISR_TCR) && n_bytes > 0) {
+        i2c1.isr &= ~I2C_ISR_TCR;
+        i2c1.nbytes_left = n_bytes;
+        i2c1.isr |= I2C_ISR_TXIS;
+    }
+    pump_interrupts();
+}
+
+void i2c_enable_autoend(uint32_t i2c) {
+    (void) i2c;
+    i2c1.cr2 |= I2C_CR2_AUTOEND;
+}
+
+void i2c_disable_autoend(uint32_t i2c) {
+    (void) i2c;
+    i2c1.cr2 &= ~I2C_CR2_AUTOEND;
+}
+
+void i2c_send_start(uint32_t i2c) {
+    (void) i2c;
+    i2c_sync();
+    if (!(i2c1.cr1 & I2C_CR1_PE) || i2c1.active) {
+        return;
+    }
+
+    uint8_t addr = (i2c1.cr2 >> 1) & 0x7F;
+    i2c1.active = true;
+    i2c1.target = NULL;
+    i2c1.isr |= I2C_ISR_BUSY;
+
+    /* with SDA held low the START never completes: the transfer stalls */
+    if (sda_held_clocks) {
+        return;
+    }
+    i2c1.nbytes_left = (i2c1.cr2 & I2C_CR2_NBYTES_MASK) >> I2C_CR2_NBYTES_SHIFT;
+
+    /*
+     * above Fast-mode, SCL and SDA rise too slowly without the Fast-mode Plus
+     * drive: nothing on the bus acknowledges
+     */
+    uint32_t scl_hz = periph_i2c_scl_hz();
+    bool bus_ok = scl_hz <= 400000
+        || (host_syscfg_cfgr1 & I2C_FMP_DRIVE) == I2C_FMP_DRIVE;
+
+    for (int n = 0; n < MAX_DISPLAYS && bus_ok; n++) {
+        display_t *d = &displays[n];
+        if (d->bus == BUS_I2C && d->addr == addr) {
+            emu_set_i2c_clock(d->emu, scl_hz);
+            if (emu_i2c_start(d->emu, addr)) {
+                i2c1.target = d->emu;
+            }
+        }
+    }
+
+    if (!i2c1.target) {
+        i2c_nacked();
+    } else if (i2c1.nbytes_left > 0) {
+        i2c1.isr |= I2C_ISR_TXIS;
+    } else {
+        i2c_chunk_done();
+    }
+    pump_interrupts();
+}
+
+void i2c_send_stop(uint32_t i2c) {
+    (void) i2c;
+    i2c_sync();
+    if (i2c1.active) {
+        i2c_stop_condition();
+    }
+    pump_interrupts();
+}
+
+bool i2c_busy(uint32_t i2c) {
+    return I2C_ISR(i2c) & I2C_ISR_BUSY;
+}
+
+bool i2c_nack(uint32_t i2c) {
+    return I2C_ISR(i2c) & I2C_ISR_NACKF;
+}
+
+bool i2c_transmit_int_status(uint32_t i2c) {
+    return I2C_ISR(i2c) & I2C_ISR_TXIS;
+}
+
+bool i2c_transfer_complete(uint32_t i2c) {
+    return I2C_ISR(i2c) & I2C_ISR_TC;
+}
+
+void i2c_send_data(uint32_t i2c, uint8_t data) {
+    (void) i2c;
+    i2c_sync();
+    i2c1.txdr = data;
+    if (!i2c1.active || !(i2c1.isr & I2C_ISR_TXIS)) {
+        return; /* not expecting data: dropped */
+    }
+
+    i2c1.isr &= ~I2C_ISR_TXIS;
+    emu_i2c_byte(i2c1.target, data);
+    if (--i2c1.nbytes_left > 0) {
+        i2c1.isr |= I2C_ISR_TXIS;
+    } else {
+        i2c_chunk_done();
+    }
+    pump_interrupts();
+}
+
+void i2c_enable_interrupt(uint32_t i2c, uint32_t interrupt) {
+    (void) i2c;
+    i2c1.cr1 |= interrupt;
+    pump_interrupts();
+}
+
+void i2c_disable_interrupt(uint32_t i2c, uint32_t interrupt) {
+    (void) i2c;
+    i2c1.cr1 &= ~interrupt;
+}
+
+/* polled write, as libopencm3 does it (reads are not modelled) */
+void i2c_transfer7(uint32_t i2c, uint8_t addr, uint8_t *w, size_t wn,
+        uint8_t *r, size_t rn) {
+    (void) r;
+    (void) rn;
+    if (!wn) {
+        return;
+    }
+
+    i2c_set_7bit_address(i2c, addr);
+    i2c_set_write_transfer_dir(i2c);
+    i2c_set_bytes_to_transfer(i2c, wn);
+    I2C_CR2(i2c) &= ~I2C_CR2_RELOAD;
+    i2c_enable_autoend(i2c);
+    i2c_send_start(i2c);
+
+    while (wn--) {
+        if (i2c_nack(i2c)) {
+            return;
+        }
+        i2c_send_data(i2c, *w++);
+    }
+}
+
+/*
+ * Interrupt dispatch
+ */
+
+static bool i2c_irq_pending(void) {
+    i2c_sync();
+    uint32_t cr1 = i2c1.cr1;
+    uint32_t isr = i2c1.isr;
+    return ((cr1 & I2C_CR1_TXIE) && (isr & I2C_ISR_TXIS))
+        || ((cr1 & I2C_CR1_TCIE) && (isr & (I2C_ISR_TC | I2C_ISR_TCR)))
+        || ((cr1 & I2C_CR1_NACKIE) && (isr & I2C_ISR_NACKF))
+        || ((cr1 & I2C_CR1_STOPIE) && (isr & I2C_ISR_STOPF))
+        || ((cr1 & I2C_CR1_ERRIE) && (isr & (I2C_ISR_BERR | I2C_ISR_ARLO)));
+}
+
+static bool dma_irq_pending(void) {
+    for (int ch = DMA_CHANNEL2; ch <= DMA_CHANNEL3; ch++) {
+        if (dma[ch].tcie && (dma[ch].flags & DMA_TCIF)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * call interrupt handlers until none are pending
+ *
+ * Handlers start further transfers, which call back into here; only the
+ * outermost call dispatches, so the stack stays flat.
+ */
+static void pump_interrupts(void) {
+    static bool running = false;
+    if (running || primask) {
+        return;
+    }
+    running = true;
+
+    for (uint32_t n = 0; ; n++) {
+        if (n > IRQ_STORM_LIMIT) {
+            fprintf(stderr, "periph: interrupt never cleared\n");
+            abort();
+        }
+
+        if (nvic_enabled[NVIC_I2C1_IRQ] && i2c_irq_pending()) {
+            irq_count++;
+            i2c1_isr();
+        } else if (nvic_enabled[NVIC_DMA1_CHANNEL2_3_IRQ]
+                && dma_irq_pending()) {
+            irq_count++;
+            dma1_channel2_3_isr();
+        } else {
+            break;
+        }
+    }
+
+    running = false;
+}
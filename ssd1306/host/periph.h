@@ -0,0 +1,64 @@
+#ifndef PERIPH_H
+#define PERIPH_H
+
+/*
+ * Host models of the STM32F0 peripherals used by the ssd1306 project
+ *
+ * Implements the host stand-ins for the libopencm3 calls in include/, and
+ * connects the modelled I2C1 and SPI1 buses to SSD1306 controller models.
+ * Transfers complete instantly; interrupt handlers are called synchronously
+ * whenever an enabled interrupt is pending, so asynchronous code runs to
+ * completion inside the call that started it. Bus time is accounted by the
+ * controller models from the configured bus clocks.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ssd1306_emu.h"
+
+/* attach a display model to I2C1 at a 7 bit address */
+void periph_attach_i2c(ssd1306_emu_t *emu, uint8_t addr);
+
+/* attach a display model to SPI1, selected by its CS pin (active low) */
+void periph_attach_spi(ssd1306_emu_t *emu, uint32_t cs_port, uint16_t cs_pin,
+        uint32_t dc_port, uint16_t dc_pin, uint32_t reset_port,
+        uint16_t reset_pin);
+
+/* reset all peripheral models and detach all displays */
+void periph_reset(void);
+
+/*
+ * hold I2C1 SDA low, as a slave stuck mid-byte, for `clocks` SCL pulses
+ *
+ * While SDA is held, a START never completes and the transfer stalls. Only
+ * pulses driven on the SCL pin as a GPIO (bus recovery) release it.
+ */
+void periph_i2c_hold_sda(uint32_t clocks);
+
+/*
+ * as periph_i2c_hold_sda(), but with the bus idle: the peripheral sees SDA
+ * fall as a START by another master and reports the bus busy until it is
+ * disabled
+ */
+void periph_i2c_hold_bus(uint32_t clocks);
+
+/* SCL pulses still needed before SDA is released (0 if it isn't held) */
+uint32_t periph_i2c_sda_held(void);
+
+/* SCL frequency (Hz) produced by the current I2C1 TIMINGR and kernel clock */
+uint32_t periph_i2c_scl_hz(void);
+
+/* SCK frequency (Hz) produced by the current SPI1 baud rate prescaler */
+uint32_t periph_spi_sck_hz(void);
+
+/* number of interrupt handler calls since reset */
+uint32_t periph_irq_count(void);
+
+/* number of SPI1 DR writes by the CPU (not by DMA) since reset */
+uint32_t periph_spi_dr_writes(void);
+
+/* number of WFI instructions executed since reset */
+uint32_t periph_wfi_count(void);
+
+#endif
@@ -0,0 +1,58 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ssd1306.h"
+#include "ssd1306_graphics.h"
+
+#include "rle.h"
+
+void rle_pages(uint8_t w, uint8_t h, uint8_t *out,
+        int (*pixel)(const void *ctx, uint8_t x, uint8_t y), const void *ctx) {
+    for (uint8_t p = 0; p < (h + 7) / 8; p++) {
+        for (uint8_t x = 0; x < w; x++) {
+            uint8_t b = 0;
+            for (uint8_t r = 0; r < 8 && p * 8 + r < h; r++) {
+                if (pixel(ctx, x, p * 8 + r)) {
+                    b |= 1 << r;
+                }
+            }
+            *out++ = b;
+        }
+    }
+}
+
+/* length of the run of equal bytes at in[0], up to the longest repeat */
+static size_t repeat_length(const uint8_t *in, size_t n) {
+    size_t r = 1;
+    while (r < n && r < IMAGE_RLE_MAX_REPEAT && in[r] == in[0]) {
+        r++;
+    }
+    return r;
+}
+
+size_t rle_encode(const uint8_t *in, size_t n, uint8_t *out) {
+    size_t len = 0;
+    size_t i = 0;
+    while (i < n) {
+        size_t r = repeat_length(&in[i], n - i);
+        if (r >= IMAGE_RLE_MIN_REPEAT) {
+            out[len++] = IMAGE_RLE_REPEAT + r - IMAGE_RLE_MIN_REPEAT;
+            out[len++] = in[i];
+            i += r;
+            continue;
+        }
+
+        /* literal bytes, up to the next repeat worth encoding */
+        size_t start = i;
+        while (i < n && i - start < IMAGE_RLE_MAX_LITERAL
+                && repeat_length(&in[i], n - i) < IMAGE_RLE_MIN_REPEAT) {
+            i++;
+        }
+        out[len++] = i - start - 1;
+        for (size_t k = start; k < i; k++) {
+            out[len++] = in[k];
+        }
+    }
+    return len;
+}
@@ -0,0 +1,26 @@
+#ifndef RLE_H
+#define RLE_H
+
+/*
+ * Run-length encoder for the image format of ssd1306_graphics.h
+ *
+ * Shared by pbm2rle and the benchmark.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * page bytes of a w x h image, pixel(x, y) giving its pixels; out must hold
+ * w * ((h + 7) / 8) bytes
+ */
+void rle_pages(uint8_t w, uint8_t h, uint8_t *out,
+        int (*pixel)(const void *ctx, uint8_t x, uint8_t y), const void *ctx);
+
+/*
+ * encode n page bytes into out, which must hold n + n / 128 + 1 bytes;
+ * returns the encoded length
+ */
+size_t rle_encode(const uint8_t *in, size_t n, uint8_t *out);
+
+#endif
@@ -0,0 +1,429 @@
+/*
+ * Software model of the SSD1306 controller, for host builds
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ssd1306.h"
+#include "ssd1306_emu.h"
+
+/* frames per scroll step, indexed by the 3 bit interval setting */
+static const uint16_t scroll_interval_frames[8] = {
+    5, 64, 128, 256, 3, 4, 25, 2
+};
+
+/* power-on reset: RAM cleared, registers at their reset values */
+void emu_reset(ssd1306_emu_t *emu) {
+    uint8_t panel_width = emu->panel_width ? emu->panel_width : EMU_COLUMNS;
+    uint8_t panel_height = emu->panel_height ? emu->panel_height : EMU_ROWS;
+    uint8_t panel_col_offset = emu->panel_col_offset;
+    uint8_t i2c_addr = emu->i2c_addr;
+    uint32_t i2c_hz = emu->i2c_hz;
+    uint32_t i2c_max_hz = emu->i2c_max_hz;
+    uint32_t spi_hz = emu->spi_hz;
+
+    memset(emu, 0, sizeof(*emu));
+
+    emu->addr_mode = SSD1306_MEM_ADDR_MODE_PAGE;
+    emu->col_end = EMU_COLUMNS - 1;
+    emu->page_end = EMU_PAGES - 1;
+    emu->mux_ratio = EMU_ROWS - 1;
+    emu->com_pins = 0x12;
+    emu->contrast = 0x7F;
+    emu->clock_div = 0x80;
+    emu->precharge = 0x22;
+    emu->vcomh = 0x20;
+    emu->vert_area_rows = EMU_ROWS;
+
+    emu->panel_width = panel_width;
+    emu->panel_height = panel_height;
+    emu->panel_col_offset = panel_col_offset;
+    emu->i2c_addr = i2c_addr;
+    emu->i2c_hz = i2c_hz ? i2c_hz : 100000;
+    emu->i2c_max_hz = i2c_max_hz;
+    emu->spi_hz = spi_hz ? spi_hz : 1000000;
+}
+
+/* set the visible glass size and its first column in GDDRAM */
+void emu_set_panel(ssd1306_emu_t *emu, uint8_t width, uint8_t height,
+        uint8_t col_offset) {
+    emu->panel_width = width;
+    emu->panel_height = height;
+    emu->panel_col_offset = col_offset;
+}
+
+/* set bus clocks (Hz) used for the bus time model */
+void emu_set_i2c_clock(ssd1306_emu_t *emu, uint32_t hz) {
+    emu->i2c_hz = hz;
+}
+
+void emu_set_spi_clock(ssd1306_emu_t *emu, uint32_t hz) {
+    emu->spi_hz = hz;
+}
+
+/* set the fastest SCL (Hz) the display keeps up with, 0 for no limit */
+void emu_set_i2c_max_clock(ssd1306_emu_t *emu, uint32_t hz) {
+    emu->i2c_max_hz = hz;
+}
+
+/* clear the traffic counters */
+void emu_clear_stats(ssd1306_emu_t *emu) {
+    memset(&emu->stats, 0, sizeof(emu->stats));
+}
+
+/* add `bits` bit times at `hz` to the modelled bus time */
+static void add_bus_time(ssd1306_emu_t *emu, uint32_t bits, uint32_t hz) {
+    emu->stats.bus_ps += (uint64_t) bits * 1000000000000ULL / hz;
+}
+
+/* number of parameter bytes following a command byte */
+static uint8_t command_params(uint8_t c) {
+    switch (c) {
+    case SSD1306_SET_CONTRAST:
+    case SSD1306_SET_MEM_ADDR_MODE:
+    case SSD1306_SET_MUX_RATIO:
+    case SSD1306_SET_DISPLAY_OFFSET:
+    case SSD1306_SET_COM_HW_CONFIG:
+    case SSD1306_SET_CLOCK_DIV:
+    case SSD1306_SET_PRECHARGE_PERIOD:
+    case SSD1306_SET_VCOMH_DESELECT_LEV:
+    case SSD1306_SET_CHARGE_PUMP:
+        return 1;
+    case SSD1306_SET_COL_ADDR:
+    case SSD1306_SET_PAGE_ADDR:
+    case SSD1306_SCROLL_SET_VERT_AREA:
+        return 2;
+    case SSD1306_SCROLL_VERT_RIGHT:
+    case SSD1306_SCROLL_VERT_LEFT:
+        return 5;
+    case SSD1306_SCROLL_RIGHT:
+    case SSD1306_SCROLL_LEFT:
+        return 6;
+    default:
+        return 0;
+    }
+}
+
+/* execute a complete command (emu->cmd[0..cmd_len-1]) */
+static void execute_command(ssd1306_emu_t *emu) {
+    uint8_t c = emu->cmd[0];
+    uint8_t *arg = &emu->cmd[1];
+
+    if (c <= 0x0F) {
+        emu->col = (emu->col & 0xF0) | (c & 0x0F);
+        return;
+    }
+    if (c >= 0x10 && c <= 0x1F) {
+        emu->col = ((c & 0x07) << 4) | (emu->col & 0x0F);
+        return;
+    }
+    if (c >= SSD1306_SET_DISP_START_LINE && c <= 0x7F) {
+        emu->start_line = c & 0x3F;
+        return;
+    }
+    if (c >= SSD1306_SET_PAGE_START_ADDRESS && c <= 0xB7) {
+        emu->page = c & 0x07;
+        return;
+    }
+
+    switch (c) {
+    case SSD1306_SET_CONTRAST:
+        emu->contrast = arg[0];
+        break;
+    case SSD1306_DISPLAY_ON_FOLLOW_RAM:
+    case SSD1306_DISPLAY_ON_IGNORE_RAM:
+        emu->entire_on = c & 0x1;
+        break;
+    case SSD1306_DISPLAY_NOT_INVERTED:
+    case SSD1306_DISPLAY_INVERTED:
+        emu->inverted = c & 0x1;
+        break;
+    case SSD1306_DISPLAY_OFF:
+    case SSD1306_DISPLAY_ON:
+        emu->display_on = c & 0x1;
+        break;
+    case SSD1306_SCROLL_RIGHT:
+    case SSD1306_SCROLL_LEFT:
+    case SSD1306_SCROLL_VERT_RIGHT:
+    case SSD1306_SCROLL_VERT_LEFT:
+        emu->scroll_cmd = c;
+        emu->scroll_start_page = arg[1] & 0x07;
+        emu->scroll_interval = arg[2] & 0x07;
+        emu->scroll_end_page = arg[3] & 0x07;
+        emu->scroll_vert_offset = (c == SSD1306_SCROLL_VERT_RIGHT
+                || c == SSD1306_SCROLL_VERT_LEFT) ? arg[4] & 0x3F : 0;
+        break;
+    case SSD1306_SCROLL_DEACTIVATE:
+        emu->scroll_active = false;
+        break;
+    case SSD1306_SCROLL_ACTIVATE:
+        emu->scroll_active = true;
+        emu->scroll_frames = 0;
+        break;
+    case SSD1306_SCROLL_SET_VERT_AREA:
+        emu->vert_area_top = arg[0] & 0x3F;
+        emu->vert_area_rows = arg[1] & 0x7F;
+        break;
+    case SSD1306_SET_MEM_ADDR_MODE:
+        emu->addr_mode = arg[0] & 0x03;
+        break;
+    case SSD1306_SET_COL_ADDR:
+        emu->col_start = arg[0] & 0x7F;
+        emu->col_end = arg[1] & 0x7F;
+        emu->col = emu->col_start;
+        break;
+    case SSD1306_SET_PAGE_ADDR:
+        emu->page_start = arg[0] & 0x07;
+        emu->page_end = arg[1] & 0x07;
+        emu->page = emu->page_start;
+        break;
+    case SSD1306_SET_SEG_REMAP:
+    case SSD1306_SET_SEG_REMAP | 0x1:
+        emu->seg_remap = c & 0x1;
+        break;
+    case SSD1306_SET_MUX_RATIO:
+        emu->mux_ratio = arg[0] & 0x3F;
+        break;
+    case SSD1306_SET_COM_SCAN_DIR_NORM:
+        emu->com_remap = false;
+        break;
+    case SSD1306_SET_COM_SCAN_DIR_REMAPPED:
+        emu->com_remap = true;
+        break;
+    case SSD1306_SET_DISPLAY_OFFSET:
+        emu->display_offset = arg[0] & 0x3F;
+        break;
+    case SSD1306_SET_COM_HW_CONFIG:
+        emu->com_pins = arg[0];
+        break;
+    case SSD1306_SET_CLOCK_DIV:
+        emu->clock_div = arg[0];
+        break;
+    case SSD1306_SET_PRECHARGE_PERIOD:
+        emu->precharge = arg[0];
+        break;
+    case SSD1306_SET_VCOMH_DESELECT_LEV:
+        emu->vcomh = arg[0];
+        break;
+    case SSD1306_SET_CHARGE_PUMP:
+        emu->charge_pump = (arg[0] == SSD1306_CHARGE_PUMP_ON);
+        break;
+    default:
+        /* NOP and unknown commands */
+        break;
+    }
+}
+
+/* controller level: one command (or parameter) byte */
+void emu_command(ssd1306_emu_t *emu, uint8_t b) {
+    emu->stats.command_bytes++;
+
+    if (emu->cmd_len == 0) {
+        emu->cmd_need = command_params(b);
+    }
+    emu->cmd[emu->cmd_len++] = b;
+    if (emu->cmd_len > emu->cmd_need) {
+        execute_command(emu);
+        emu->cmd_len = 0;
+    }
+}
+
+/* controller level: one data byte, written to GDDRAM at the pointer */
+void emu_data(ssd1306_emu_t *emu, uint8_t b) {
+    emu->stats.data_bytes++;
+    emu->gddram[emu->page & 0x07][emu->col & 0x7F] = b;
+
+    switch (emu->addr_mode) {
+    case SSD1306_MEM_ADDR_MODE_HORIZ:
+        if (emu->col >= emu->col_end) {
+            emu->col = emu->col_start;
+            emu->page = emu->page >= emu->page_end ?
+                emu->page_start : emu->page + 1;
+        } else {
+            emu->col++;
+        }
+        break;
+    case SSD1306_MEM_ADDR_MODE_VERT:
+        if (emu->page >= emu->page_end) {
+            emu->page = emu->page_start;
+            emu->col = emu->col >= emu->col_end ?
+                emu->col_start : emu->col + 1;
+        } else {
+            emu->page++;
+        }
+        break;
+    default:
+        /* page mode: column wraps, page stays */
+        emu->col = emu->col >= emu->col_end ? emu->col_start : emu->col + 1;
+        break;
+    }
+}
+
+/* I2C: START followed by the address byte; returns true on ACK */
+bool emu_i2c_start(ssd1306_emu_t *emu, uint8_t addr) {
+    emu->i2c_addressed = (addr == emu->i2c_addr)
+        && (!emu->i2c_max_hz || emu->i2c_hz <= emu->i2c_max_hz);
+    if (!emu->i2c_addressed) {
+        return false;
+    }
+
+    emu->stats.transactions++;
+    emu->stats.bus_bytes++;
+    add_bus_time(emu, 1 + 9, emu->i2c_hz); /* START + address + ACK */
+    emu->i2c_expect_control = true;
+    return true;
+}
+
+/* I2C: one byte after the address byte */
+void emu_i2c_byte(ssd1306_emu_t *emu, uint8_t b) {
+    if (!emu->i2c_addressed) {
+        return;
+    }
+
+    emu->stats.bus_bytes++;
+    add_bus_time(emu, 9, emu->i2c_hz);
+
+    if (emu->i2c_expect_control) {
+        emu->i2c_continuation = b & 0x80;
+        emu->i2c_dc = b & 0x40;
+        emu->i2c_expect_control = false;
+        return;
+    }
+
+    if (emu->i2c_dc) {
+        emu_data(emu, b);
+    } else {
+        emu_command(emu, b);
+    }
+    /* Co set: only one byte follows each control byte */
+    if (emu->i2c_continuation) {
+        emu->i2c_expect_control = true;
+    }
+}
+
+/* I2C: STOP */
+void emu_i2c_stop(ssd1306_emu_t *emu) {
+    if (emu->i2c_addressed) {
+        add_bus_time(emu, 1, emu->i2c_hz);
+    }
+    emu->i2c_addressed = false;
+}
+
+/* SPI: CS edge */
+void emu_spi_select(ssd1306_emu_t *emu, bool selected) {
+    if (selected) {
+        emu->stats.transactions++;
+    }
+}
+
+/* SPI: one byte, DC high = data */
+void emu_spi_byte(ssd1306_emu_t *emu, uint8_t b, bool dc) {
+    emu->stats.bus_bytes++;
+    add_bus_time(emu, 8, emu->spi_hz);
+
+    if (dc) {
+        emu_data(emu, b);
+    } else {
+        emu_command(emu, b);
+    }
+}
+
+/* rotate the columns of the scrolled pages by one, in the scroll direction */
+static void scroll_step(ssd1306_emu_t *emu) {
+    bool right = (emu->scroll_cmd == SSD1306_SCROLL_RIGHT
+            || emu->scroll_cmd == SSD1306_SCROLL_VERT_RIGHT);
+
+    for (uint8_t p = emu->scroll_start_page; p <= emu->scroll_end_page; p++) {
+        uint8_t *row = emu->gddram[p];
+        if (right) {
+            uint8_t last = row[EMU_COLUMNS - 1];
+            memmove(&row[1], &row[0], EMU_COLUMNS - 1);
+            row[0] = last;
+        } else {
+            uint8_t first = row[0];
+            memmove(&row[0], &row[1], EMU_COLUMNS - 1);
+            row[EMU_COLUMNS - 1] = first;
+        }
+    }
+
+    if (emu->scroll_vert_offset && emu->vert_area_rows) {
+        emu->vert_scroll = (emu->vert_scroll + emu->scroll_vert_offset)
+            % emu->vert_area_rows;
+    }
+}
+
+/* advance horizontal/vertical scrolling by a number of display frames */
+void emu_advance_frames(ssd1306_emu_t *emu, uint32_t frames) {
+    if (!emu->scroll_active) {
+        return;
+    }
+
+    uint16_t interval = scroll_interval_frames[emu->scroll_interval];
+    emu->scroll_frames += frames;
+    while (emu->scroll_frames >= interval) {
+        emu->scroll_frames -= interval;
+        scroll_step(emu);
+    }
+}
+
+/* value of a pixel as it appears on the panel (row 0 = COM0 at top) */
+bool emu_pixel(const ssd1306_emu_t *emu, uint8_t x, uint8_t y) {
+    uint8_t rows = emu->mux_ratio + 1;
+
+    if (!emu->display_on || x >= emu->panel_width || y >= emu->panel_height) {
+        return false;
+    }
+
+    if (y >= rows) {
+        return false;
+    }
+    uint8_t scan = emu->com_remap ? rows - 1 - y : y;
+
+    /* vertical scroll shifts the rows inside the scroll area */
+    if (scan >= emu->vert_area_top
+            && scan < emu->vert_area_top + emu->vert_area_rows) {
+        scan = emu->vert_area_top
+            + (scan - emu->vert_area_top + emu->vert_scroll)
+            % emu->vert_area_rows;
+    }
+
+    uint8_t ram_row = (scan + emu->start_line + emu->display_offset)
+        % EMU_ROWS;
+    uint8_t seg = x + emu->panel_col_offset;
+    uint8_t ram_col = emu->seg_remap ? EMU_COLUMNS - 1 - seg : seg;
+
+    bool on = (emu->gddram[ram_row / 8][ram_col & 0x7F] >> (ram_row % 8)) & 0x1;
+    if (emu->entire_on) {
+        on = true;
+    }
+    return on != emu->inverted;
+}
+
+/* write the panel image as a binary PBM (1 = lit pixel); true on success */
+bool emu_write_pbm(const ssd1306_emu_t *emu, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+
+    fprintf(f, "P4\n%u %u\n", emu->panel_width, emu->panel_height);
+    for (uint8_t y = 0; y < emu->panel_height; y++) {
+        uint8_t byte = 0;
+        for (uint8_t x = 0; x < emu->panel_width; x++) {
+            byte = (byte << 1) | emu_pixel(emu, x, y);
+            if (x % 8 == 7) {
+                fputc(byte, f);
+                byte = 0;
+            }
+        }
+        if (emu->panel_width % 8) {
+            fputc(byte << (8 - emu->panel_width % 8), f);
+        }
+    }
+
+    return fclose(f) == 0;
+}
@@ -0,0 +1,149 @@
+#ifndef SSD1306_EMU_H
+#define SSD1306_EMU_H
+
+/*
+ * Software model of the SSD1306 controller, for host builds
+ *
+ * Interprets the command set in ssd1306.h (addressing modes, column/page
+ * windows, start line, remap, offset, scrolling, contrast, ...) into its own
+ * 128x64 GDDRAM, and counts what crosses the bus. Bus time is modelled as
+ * bits on the wire times the bit time at the configured clock:
+ *   I2C: START + address byte + 9 bits per byte + STOP
+ *   SPI: 8 bits per byte
+ *
+ * The bus side is fed by the host peripheral models (periph.c), or directly
+ * with emu_command()/emu_data().
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EMU_COLUMNS 128
+#define EMU_PAGES 8
+#define EMU_ROWS (EMU_PAGES * 8)
+
+/* bus traffic counters */
+typedef struct {
+    uint32_t transactions; /* I2C START..STOP, or SPI CS low..high */
+    uint32_t bus_bytes; /* every byte on the bus, incl. address/control */
+    uint32_t command_bytes; /* commands and command parameters */
+    uint32_t data_bytes; /* bytes written to GDDRAM */
+    uint64_t bus_ps; /* modelled time on the wire, in picoseconds */
+} emu_stats_t;
+
+typedef struct {
+    /* display RAM, indexed [page][column] */
+    uint8_t gddram[EMU_PAGES][EMU_COLUMNS];
+
+    /* addressing */
+    uint8_t addr_mode;
+    uint8_t col;
+    uint8_t page;
+    uint8_t col_start;
+    uint8_t col_end;
+    uint8_t page_start;
+    uint8_t page_end;
+
+    /* hardware configuration */
+    uint8_t start_line;
+    bool seg_remap;
+    bool com_remap;
+    uint8_t mux_ratio;
+    uint8_t display_offset;
+    uint8_t com_pins;
+    uint8_t contrast;
+    bool display_on;
+    bool inverted;
+    bool entire_on;
+    bool charge_pump;
+    uint8_t clock_div;
+    uint8_t precharge;
+    uint8_t vcomh;
+
+    /* scrolling */
+    bool scroll_active;
+    uint8_t scroll_cmd;
+    uint8_t scroll_start_page;
+    uint8_t scroll_end_page;
+    uint8_t scroll_interval;
+    uint8_t scroll_vert_offset;
+    uint8_t vert_area_top;
+    uint8_t vert_area_rows;
+    uint8_t vert_scroll; /* accumulated vertical scroll, in rows */
+    uint32_t scroll_frames; /* frames since the last scroll step */
+
+    /* command parser */
+    uint8_t cmd[8];
+    uint8_t cmd_len;
+    uint8_t cmd_need;
+
+    /* panel: visible part of GDDRAM */
+    uint8_t panel_width;
+    uint8_t panel_height;
+    uint8_t panel_col_offset;
+
+    /* bus */
+    uint8_t i2c_addr;
+    uint32_t i2c_hz;
+    uint32_t i2c_max_hz; /* fastest SCL acknowledged, 0 for any */
+    uint32_t spi_hz;
+    bool i2c_addressed; /* address byte matched in current transaction */
+    bool i2c_expect_control;
+    bool i2c_continuation; /* Co bit of last control byte */
+    bool i2c_dc; /* D/C# bit of last control byte */
+
+    emu_stats_t stats;
+} ssd1306_emu_t;
+
+/* power-on reset: RAM cleared, registers at their reset values */
+void emu_reset(ssd1306_emu_t *emu);
+
+/* set the visible glass size and its first column in GDDRAM */
+void emu_set_panel(ssd1306_emu_t *emu, uint8_t width, uint8_t height,
+        uint8_t col_offset);
+
+/* set bus clocks (Hz) used for the bus time model */
+void emu_set_i2c_clock(ssd1306_emu_t *emu, uint32_t hz);
+void emu_set_spi_clock(ssd1306_emu_t *emu, uint32_t hz);
+
+/*
+ * set the fastest SCL (Hz) the display keeps up with, 0 for no limit
+ *
+ * Above it the address byte is not acknowledged, as a display that can't
+ * follow the bus would fail; kept over emu_reset().
+ */
+void emu_set_i2c_max_clock(ssd1306_emu_t *emu, uint32_t hz);
+
+/* controller level: one command (or parameter) byte / one data byte */
+void emu_command(ssd1306_emu_t *emu, uint8_t b);
+void emu_data(ssd1306_emu_t *emu, uint8_t b);
+
+/*
+ * I2C bus level
+ *
+ * emu_i2c_start() returns true if the address matches and the clock is within
+ * the display's limit (ACK); traffic is only counted for transactions
+ * addressed to this display. emu_i2c_byte() interprets control bytes (Co and
+ * D/C# bits) and the bytes that follow.
+ */
+bool emu_i2c_start(ssd1306_emu_t *emu, uint8_t addr);
+void emu_i2c_byte(ssd1306_emu_t *emu, uint8_t b);
+void emu_i2c_stop(ssd1306_emu_t *emu);
+
+/* SPI bus level: CS edges and one byte with the level of the DC pin */
+void emu_spi_select(ssd1306_emu_t *emu, bool selected);
+void emu_spi_byte(ssd1306_emu_t *emu, uint8_t b, bool dc);
+
+/* advance horizontal/vertical scrolling by a number of display frames */
+void emu_advance_frames(ssd1306_emu_t *emu, uint32_t frames);
+
+/* value of a pixel as it appears on the panel (row 0 = COM0 at top) */
+bool emu_pixel(const ssd1306_emu_t *emu, uint8_t x, uint8_t y);
+
+/* write the panel image as a binary PBM (1 = lit pixel); true on success */
+bool emu_write_pbm(const ssd1306_emu_t *emu, const char *path);
+
+/* clear the traffic counters */
+void emu_clear_stats(ssd1306_emu_t *emu);
+
+#endif
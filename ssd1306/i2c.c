@@ -1,11 +1,76 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/nvic.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/i2c.h>
+#include <libopencm3/stm32/syscfg.h>
 
 #include "i2c.h"
+#include "systick.h"
+
+#define HSI_HZ 8000000
+
+/* kernel clocks of SCL synchronization per SCL period (tSYNC1 + tSYNC2) */
+#define SCL_SYNC_CLOCKS 4
+
+/* analog filter delay, minimum (ns) */
+#define ANALOG_FILTER_NS 50
+
+/* timing limits of a bus mode (ns), from the I2C-bus specification */
+typedef struct {
+    uint32_t max_hz;
+    uint16_t low_ns; /* SCL low period, minimum */
+    uint16_t high_ns; /* SCL high period, minimum */
+    uint16_t setup_ns; /* data setup time, minimum */
+    uint16_t rise_ns; /* rise time, maximum */
+    uint16_t fall_ns; /* fall time, maximum */
+} bus_mode_t;
+
+static const bus_mode_t bus_modes[] = {
+    [I2C_STANDARD] = { 100000, 4700, 4000, 250, 1000, 300 },
+    [I2C_FAST] = { 400000, 1300, 600, 100, 300, 300 },
+    [I2C_FAST_PLUS] = { 1000000, 500, 260, 50, 120, 120 },
+};
+
+#define BUS_MODES (sizeof(bus_modes) / sizeof(bus_modes[0]))
+
+/* SCL pulses that clock out any byte a slave is stuck in, plus its ACK */
+#define RECOVERY_CLOCKS 9
+
+/* bus clocks per byte: 8 data bits and the ACK */
+#define CLOCKS_PER_BYTE 9
+
+/* interrupts used by the transmit engine */
+#define I2C_XFER_INTERRUPTS (I2C_CR1_TXIE | I2C_CR1_TCIE | I2C_CR1_NACKIE \
+        | I2C_CR1_STOPIE | I2C_CR1_ERRIE)
+
+/* state of the interrupt driven transmit engine (I2C1 only) */
+static struct {
+    uint32_t i2c;
+    volatile i2c_xfer_status_t status;
+    i2c_xfer_callback_t callback;
+    size_t remaining; /* bytes left in the whole transaction */
+    size_t nbytes; /* bytes left in the current NBYTES chunk */
+    const uint8_t *p; /* next byte to send */
+    size_t run; /* bytes left before p has to move to the next row */
+    const uint8_t *row; /* start of current buffer row */
+    size_t rows; /* buffer rows left, including the current one */
+    size_t row_len;
+    size_t stride;
+    bool in_header;
+    uint32_t start_ms; /* millis() when started */
+    uint32_t timeout_ms; /* time allowed from start_ms */
+    volatile bool bus_held; /* a start found the bus held by a slave */
+    volatile bool recovering; /* i2c_check_timeout() is freeing the bus */
+} xfer = { .status = I2C_XFER_OK };
+
+/* SCL frequency set by i2c_set_scl() (Hz) */
+static uint32_t scl_hz_set = 100000;
+
+static i2c_stats_t stats;
 
 /*
  * setup I2C peripheral
@@ -13,6 +78,7 @@
  * I2C peripheral: I2C1
  * SCL: PA9
  * SDA: PA10
+ * speed: Standard-mode, on the HSI clock
  */
 void i2c_setup(void) {
     /* enable I2C
@@ -23,7 +89,7 @@ void i2c_setup(void) {
      */
     rcc_periph_clock_enable(RCC_I2C1);
     rcc_periph_clock_enable(RCC_GPIOA);
-    rcc_set_i2c_clock_hsi(I2C1);
+    rcc_periph_clock_enable(RCC_SYSCFG_COMP);
 
     i2c_reset(I2C1);
 
@@ -36,11 +102,313 @@ void i2c_setup(void) {
     i2c_enable_analog_filter(I2C1);
     i2c_set_digital_filter(I2C1, 0);
 
-    i2c_set_speed(I2C1, i2c_speed_sm_100k, 8); /* 8MHz HSI clock */
+    i2c_set_profile(I2C1, I2C_CLOCK_HSI, I2C_STANDARD);
+    i2c_clear_stats(I2C1);
     i2c_set_7bit_addr_mode(I2C1);
 
     i2c_peripheral_enable(I2C1);
     I2C_CR2(I2C1) &= ~I2C_CR2_RELOAD;
+
+    nvic_enable_irq(NVIC_I2C1_IRQ);
+}
+
+/* periods of `hz` needed to cover ns nanoseconds (rounded up) */
+static uint32_t periods(uint32_t ns, uint32_t hz) {
+    return ((uint64_t) ns * hz + 999999999) / 1000000000;
+}
+
+/*
+ * compute a TIMINGR value for an SCL frequency
+ *
+ * The SCL low and high periods, data setup (SCLDEL) and data hold (SDADEL)
+ * times meet the limits of the slowest bus mode that allows scl_hz, and SCL
+ * is as close to scl_hz as the kernel clock allows without exceeding it.
+ *
+ * kernel_hz: I2C kernel clock (Hz)
+ * scl_hz:    SCL frequency (Hz), 1 MHz at most
+ *
+ * Returns the TIMINGR value, or 0 if scl_hz is 0, above 1 MHz, or too slow
+ * for the kernel clock
+ */
+uint32_t i2c_timing(uint32_t kernel_hz, uint32_t scl_hz) {
+    const bus_mode_t *m = bus_modes;
+    while (m < &bus_modes[BUS_MODES] && scl_hz > m->max_hz) {
+        m++;
+    }
+    if (scl_hz == 0 || m == &bus_modes[BUS_MODES]) {
+        return 0;
+    }
+
+    /* kernel clocks per SCL period, at least; SCL low + high is the rest */
+    uint32_t cycles = (kernel_hz + scl_hz - 1) / scl_hz;
+    cycles = cycles > SCL_SYNC_CLOCKS ? cycles - SCL_SYNC_CLOCKS : 0;
+
+    /*
+     * the data hold time covers the fall time, less what the analog filter
+     * and 3 kernel clocks of input delay already give
+     */
+    int32_t hold_ns = (int32_t) m->fall_ns - ANALOG_FILTER_NS
+        - (int32_t) (3000000000ULL / kernel_hz);
+
+    /* the fastest prescaler whose fields can hold the periods */
+    for (uint32_t presc = 0; presc < 16; presc++) {
+        uint32_t hz = kernel_hz / (presc + 1);
+        uint32_t total = (cycles + presc) / (presc + 1);
+        uint32_t low = periods(m->low_ns, hz);
+        uint32_t high = periods(m->high_ns, hz);
+        uint32_t setup = periods(m->rise_ns + m->setup_ns, hz);
+        uint32_t hold = hold_ns > 0 ? periods(hold_ns, hz) : 0;
+
+        /* spread the rest of the period in the ratio of the minimums */
+        if (total > low + high) {
+            uint32_t share = ((uint64_t) total * m->low_ns + m->low_ns
+                    + m->high_ns - 1) / (m->low_ns + m->high_ns);
+            low = share > low ? share : low;
+            high = total - low > high ? total - low : high;
+        }
+
+        if (low <= 256 && high <= 256 && setup <= 16 && hold <= 15) {
+            return presc << I2C_TIMINGR_PRESC_SHIFT
+                | (setup ? setup - 1 : 0) << I2C_TIMINGR_SCLDEL_SHIFT
+                | hold << I2C_TIMINGR_SDADEL_SHIFT
+                | (high - 1) << I2C_TIMINGR_SCLH_SHIFT
+                | (low - 1) << I2C_TIMINGR_SCLL_SHIFT;
+        }
+    }
+    return 0;
+}
+
+/* SCL frequency (Hz) a TIMINGR value gives with a kernel clock (Hz) */
+uint32_t i2c_timing_scl_hz(uint32_t kernel_hz, uint32_t timingr) {
+    uint32_t presc = (timingr >> I2C_TIMINGR_PRESC_SHIFT) & 0xF;
+    uint32_t sclh = (timingr >> I2C_TIMINGR_SCLH_SHIFT) & 0xFF;
+    uint32_t scll = (timingr >> I2C_TIMINGR_SCLL_SHIFT) & 0xFF;
+    return kernel_hz
+        / ((scll + 1 + sclh + 1) * (presc + 1) + SCL_SYNC_CLOCKS);
+}
+
+/*
+ * select the kernel clock and set the SCL frequency
+ *
+ * TIMINGR can only be written while the peripheral is disabled, so this
+ * waits for the transmit engine to be idle. Above Fast-mode, the Fast-mode
+ * Plus drive of SCL_PIN and SDA_PIN is switched on.
+ *
+ * Returns the SCL frequency set (at most scl_hz), or 0 if i2c_timing() has
+ * no timing for scl_hz; the clock and timing are then left alone
+ */
+uint32_t i2c_set_scl(uint32_t i2c, i2c_clock_t clock, uint32_t scl_hz) {
+    uint32_t kernel_hz = clock == I2C_CLOCK_SYSCLK ? rcc_ahb_frequency : HSI_HZ;
+    uint32_t timingr = i2c_timing(kernel_hz, scl_hz);
+    if (!timingr) {
+        return 0;
+    }
+
+    while (xfer.status == I2C_XFER_BUSY) {
+        i2c_check_timeout(i2c);
+    }
+    bool enabled = I2C_CR1(i2c) & I2C_CR1_PE;
+    i2c_peripheral_disable(i2c);
+
+    if (clock == I2C_CLOCK_SYSCLK) {
+        rcc_set_i2c_clock_sysclk(i2c);
+    } else {
+        rcc_set_i2c_clock_hsi(i2c);
+    }
+    I2C_TIMINGR(i2c) = timingr;
+
+    uint32_t fmp = SYSCFG_CFGR1_I2C_PA9_FMP | SYSCFG_CFGR1_I2C_PA10_FMP;
+    if (scl_hz > bus_modes[I2C_FAST].max_hz) {
+        SYSCFG_CFGR1 |= fmp;
+    } else {
+        SYSCFG_CFGR1 &= ~fmp;
+    }
+
+    if (enabled) {
+        i2c_peripheral_enable(i2c);
+    }
+    scl_hz_set = i2c_timing_scl_hz(kernel_hz, timingr);
+    return scl_hz_set;
+}
+
+/*
+ * set the SCL frequency to the maximum of a bus mode
+ *
+ * The 8 MHz HSI clock is too slow for 1 MHz: Fast-mode Plus gets as close as
+ * the Fast-mode Plus timing limits allow.
+ *
+ * Returns the SCL frequency set, see i2c_set_scl()
+ */
+uint32_t i2c_set_profile(uint32_t i2c, i2c_clock_t clock,
+        i2c_profile_t profile) {
+    return i2c_set_scl(i2c, clock, bus_modes[profile].max_hz);
+}
+
+/*
+ * find the fastest SCL frequency a device keeps up with (blocking)
+ *
+ * Steps SCL up from Standard-mode by I2C_CALIBRATION_STEP Hz, writing the
+ * probe bytes at each step, until the device fails to acknowledge them or
+ * max_hz is passed. Then backs off one step below the fastest frequency that
+ * worked, for margin.
+ *
+ * Returns the SCL frequency set, or 0 if the device doesn't acknowledge in
+ * Standard-mode; the bus is then left in Standard-mode
+ */
+uint32_t i2c_calibrate(uint32_t i2c, i2c_clock_t clock, uint8_t addr,
+        uint8_t *probe, size_t n, uint32_t max_hz) {
+    uint32_t standard_hz = bus_modes[I2C_STANDARD].max_hz;
+    uint32_t good = 0;
+    for (uint32_t hz = standard_hz; hz <= max_hz;
+            hz += I2C_CALIBRATION_STEP) {
+        if (!i2c_set_scl(i2c, clock, hz)
+                || !i2c_write_with_header(i2c, addr, probe, n, NULL, 0)) {
+            break;
+        }
+        good = hz;
+    }
+
+    if (!good) {
+        i2c_set_scl(i2c, clock, standard_hz);
+        return 0;
+    }
+
+    /* back off, and check that the device still answers there */
+    uint32_t hz = good >= standard_hz + I2C_CALIBRATION_STEP
+        ? good - I2C_CALIBRATION_STEP : standard_hz;
+    uint32_t scl_hz = i2c_set_scl(i2c, clock, hz);
+    if (!i2c_write_with_header(i2c, addr, probe, n, NULL, 0)) {
+        i2c_set_scl(i2c, clock, standard_hz);
+        return 0;
+    }
+    return scl_hz;
+}
+
+/* wait at least half an SCL period of Standard-mode (5 us) */
+static void half_scl_period(void) {
+    /* a loop iteration takes at least 4 clocks */
+    for (volatile uint32_t n = rcc_ahb_frequency / 800000; n > 0; n--);
+}
+
+/*
+ * free a bus a slave is holding, and reset the peripheral
+ *
+ * A slave reset or glitched mid-byte can hold SDA low, waiting for clocks
+ * that never come. SCL and SDA are taken over as open-drain GPIOs, SCL is
+ * pulsed (up to 9 times) until SDA is released, and a STOP is generated;
+ * then the peripheral is reset by clearing PE, which keeps its timing.
+ * Any transaction in progress is lost: end it first, see
+ * i2c_check_timeout().
+ *
+ * i2c: I2C peripheral (only I2C1 is supported)
+ */
+void i2c_recover_bus(uint32_t i2c) {
+    i2c_peripheral_disable(i2c);
+
+    gpio_set(I2C_PORT, SCL_PIN | SDA_PIN);
+    gpio_set_output_options(I2C_PORT, GPIO_OTYPE_OD, GPIO_OSPEED_LOW,
+            SCL_PIN | SDA_PIN);
+    gpio_mode_setup(I2C_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE,
+            SCL_PIN | SDA_PIN);
+
+    for (uint32_t i = 0; i < RECOVERY_CLOCKS && !gpio_get(I2C_PORT, SDA_PIN);
+            i++) {
+        gpio_clear(I2C_PORT, SCL_PIN);
+        half_scl_period();
+        gpio_set(I2C_PORT, SCL_PIN);
+        half_scl_period();
+    }
+
+    /* STOP: SDA rises while SCL is high */
+    gpio_clear(I2C_PORT, SCL_PIN);
+    half_scl_period();
+    gpio_clear(I2C_PORT, SDA_PIN);
+    half_scl_period();
+    gpio_set(I2C_PORT, SCL_PIN);
+    half_scl_period();
+    gpio_set(I2C_PORT, SDA_PIN);
+    half_scl_period();
+
+    gpio_mode_setup(I2C_PORT, GPIO_MODE_AF, GPIO_PUPD_NONE, SCL_PIN | SDA_PIN);
+    I2C_CR2(i2c) &= ~I2C_CR2_RELOAD;
+    i2c_peripheral_enable(i2c);
+    stats.recoveries++;
+}
+
+/* end the current transaction and notify the caller */
+static void xfer_finish(i2c_xfer_status_t status) {
+    uint32_t latency = millis() - xfer.start_ms;
+    if (latency > stats.max_latency_ms) {
+        stats.max_latency_ms = latency;
+    }
+    if (status == I2C_XFER_NACK) {
+        stats.nacks++;
+    } else if (status == I2C_XFER_ARLO || status == I2C_XFER_BERR) {
+        stats.bus_errors++;
+    } else if (status == I2C_XFER_TIMEOUT) {
+        stats.timeouts++;
+    }
+
+    i2c_disable_interrupt(xfer.i2c, I2C_XFER_INTERRUPTS);
+    xfer.status = status;
+    if (xfer.callback) {
+        xfer.callback(status);
+    }
+}
+
+/*
+ * end the transaction in progress if it has passed its deadline
+ *
+ * The deadline is the transaction's bytes at the current SCL frequency plus
+ * I2C_TIMEOUT_MS. A late transaction is ended with I2C_XFER_TIMEOUT (its
+ * callback is called from here) and the bus is recovered with
+ * i2c_recover_bus(); so is a bus that a start found held by a slave. The
+ * blocking functions call this while they wait; code waiting for an
+ * asynchronous transaction should too. Call it from thread context: the
+ * recovery busy-waits for about 100 us, with interrupts enabled.
+ *
+ * Returns true if a transaction timed out
+ */
+bool i2c_check_timeout(uint32_t i2c) {
+    /*
+     * only the hand-over is masked: the interrupt handler is kept off the
+     * engine while it is reset, and starts fail until it is free again
+     */
+    uint32_t masked = cm_mask_interrupts(1);
+    bool timed_out = xfer.status == I2C_XFER_BUSY && !xfer.recovering
+        && millis() - xfer.start_ms > xfer.timeout_ms;
+    bool recover = timed_out || (xfer.bus_held && !xfer.recovering
+            && xfer.status != I2C_XFER_BUSY);
+    if (recover) {
+        xfer.recovering = true;
+        xfer.bus_held = false;
+        i2c_disable_interrupt(i2c, I2C_XFER_INTERRUPTS);
+        nvic_disable_irq(NVIC_I2C1_IRQ);
+    }
+    cm_mask_interrupts(masked);
+    if (!recover) {
+        return false;
+    }
+
+    i2c_recover_bus(i2c);
+    nvic_enable_irq(NVIC_I2C1_IRQ);
+    xfer.recovering = false;
+    if (timed_out) {
+        xfer_finish(I2C_XFER_TIMEOUT); /* still busy until now */
+    }
+    return timed_out;
+}
+
+/* error counters and worst-case latency since i2c_setup() or the last clear */
+const i2c_stats_t *i2c_get_stats(uint32_t i2c) {
+    (void) i2c;
+    return &stats;
+}
+
+/* zero the counters of i2c_get_stats() */
+void i2c_clear_stats(uint32_t i2c) {
+    (void) i2c;
+    stats = (i2c_stats_t) { 0 };
 }
 
 /* set RELOAD bit in I2C_CR2 register */
@@ -65,18 +433,19 @@ bool i2c_transfer_complete_reload(uint32_t i2c) {
 
 /* clear NACKF flag in ICR register */
 void i2c_clear_nack(uint32_t i2c) {
-    I2C_ICR(i2c) &= ~I2C_ICR_NACKCF;
+    I2C_ICR(i2c) = I2C_ICR_NACKCF; /* write 1 to clear */
 }
 
 /*
  * Write a header, followed by another buffer, in 1 transaction.
  *
- * Header must be <= 255 bytes. Buffer size is unlimited.
+ * Header and buffer sizes are unlimited. Blocks until the transaction has
+ * finished, or timed out (see i2c_check_timeout()).
  *
  * i2c:  I2C peripheral, e.g. I2C1
  * addr: 7bit I2C device address
  * h:    pointer to header to be written
- * hn:   number of bytes in header to be written (255 bytes or fewer)
+ * hn:   number of bytes in header to be written
  * w:    pointer to primary buffer to be written
  * wn:   number of bytes in buffer to be written
  *
@@ -84,90 +453,221 @@ void i2c_clear_nack(uint32_t i2c) {
  */
 bool i2c_write_with_header(uint32_t i2c, uint8_t addr,
         uint8_t *h, size_t hn, uint8_t *w, size_t wn) {
+    return i2c_write_with_header_2d(i2c, addr, h, hn, w, wn, 1, wn);
+}
 
-    if (hn > 0xFF) {
+/*
+ * Write a header, followed by a strided 2D buffer, in 1 transaction.
+ *
+ * The buffer is sent as `rows` runs of `row_len` bytes; consecutive runs start
+ * `stride` bytes apart. This sends a rectangular window out of a larger
+ * framebuffer without copying it.
+ *
+ * Blocks until the transaction has finished, or timed out (see
+ * i2c_check_timeout()).
+ *
+ * i2c:     I2C peripheral, e.g. I2C1
+ * addr:    7bit I2C device address
+ * h:       pointer to header to be written
+ * hn:      number of bytes in header to be written
+ * w:       pointer to first byte of first row to be written
+ * row_len: number of bytes in each row
+ * rows:    number of rows
+ * stride:  distance (in bytes) between the starts of consecutive rows
+ *
+ * Returns true on success, false otherwise
+ */
+bool i2c_write_with_header_2d(uint32_t i2c, uint8_t addr,
+        uint8_t *h, size_t hn, uint8_t *w, size_t row_len, size_t rows,
+        size_t stride) {
+    bool started = i2c_write_with_header_2d_async(i2c, addr, h, hn, w,
+            row_len, rows, stride, NULL);
+    if (!started && xfer.bus_held) {
+        /* free the bus here, and try again */
+        i2c_check_timeout(i2c);
+        started = i2c_write_with_header_2d_async(i2c, addr, h, hn, w,
+                row_len, rows, stride, NULL);
+    }
+    if (!started) {
         return false;
     }
+    while (xfer.status == I2C_XFER_BUSY) {
+        i2c_check_timeout(i2c);
+    }
+    return xfer.status == I2C_XFER_OK;
+}
 
+/*
+ * Start an interrupt driven write of a header, followed by a strided 2D
+ * buffer, in 1 transaction.
+ *
+ * Returns immediately; the transaction is run by i2c1_isr(). NBYTES is 8 bits
+ * wide, so the transaction goes out in chunks of at most 255 bytes, with
+ * RELOAD set on every chunk but the last. Completion (STOP sent), NACK and
+ * arbitration loss are reported through i2c_xfer_status() and the callback;
+ * so is a timeout, once i2c_check_timeout() finds the deadline passed. If the
+ * bus is held by a slave although no transaction is in progress, this fails;
+ * the next i2c_check_timeout() or blocking write recovers the bus.
+ *
+ * i2c:      I2C peripheral (only I2C1 is supported)
+ * addr:     7bit I2C device address
+ * h:        pointer to header to be written
+ * hn:       number of bytes in header to be written
+ * w:        pointer to first byte of first row to be written
+ * row_len:  number of bytes in each row
+ * rows:     number of rows
+ * stride:   distance (in bytes) between the starts of consecutive rows
+ * callback: called from interrupt context when the transaction ends (may be
+ *           NULL). May start another transaction.
+ *
+ * header and buffer must stay valid until the transaction ends.
+ *
+ * Returns true if the transaction was started, false if the engine is busy
+ * or the bus held
+ */
+bool i2c_write_with_header_2d_async(uint32_t i2c, uint8_t addr,
+        const uint8_t *h, size_t hn, const uint8_t *w, size_t row_len,
+        size_t rows, size_t stride, i2c_xfer_callback_t callback) {
     /* check that any previous transactions have ended before setting RELOAD.
      * If a previous transaction hasn't finished when RELOAD is set, the STOP
      * will never get written because RELOAD disables autoend */
+    if (xfer.status == I2C_XFER_BUSY || xfer.recovering) {
+        return false;
+    }
     if (i2c_busy(i2c)) {
+        /*
+         * none of ours is in progress: a slave is holding the bus. This may
+         * be interrupt context, where the recovery mustn't busy-wait.
+         */
+        xfer.bus_held = true;
         return false;
     }
 
+    xfer.i2c = i2c;
+    xfer.callback = callback;
+    xfer.remaining = hn + row_len * rows;
+    xfer.p = h;
+    xfer.run = hn;
+    xfer.row = w;
+    xfer.rows = rows;
+    xfer.row_len = row_len;
+    xfer.stride = stride;
+    xfer.in_header = true;
+
+    if (xfer.remaining == 0) {
+        xfer.status = I2C_XFER_OK;
+        if (callback) {
+            callback(I2C_XFER_OK);
+        }
+        return true;
+    }
+
+    /* address byte and data at the SCL frequency, rounded up, plus slack */
+    uint64_t clocks = (uint64_t) (xfer.remaining + 1) * CLOCKS_PER_BYTE;
+    xfer.timeout_ms = (clocks * 1000 + scl_hz_set - 1) / scl_hz_set
+        + I2C_TIMEOUT_MS;
+    xfer.start_ms = millis();
+    stats.transactions++;
+
+    xfer.status = I2C_XFER_BUSY;
+    xfer.nbytes = xfer.remaining > 0xFF ? 0xFF : xfer.remaining;
+
+    /* polled transfers (i2c_transfer7) leave STOPF/NACKF set; clear them so
+     * they aren't taken for the end of this transaction */
+    I2C_ICR(i2c) = I2C_ICR_STOPCF | I2C_ICR_NACKCF | I2C_ICR_BERRCF
+        | I2C_ICR_ARLOCF;
+
     i2c_set_7bit_address(i2c, addr);
     i2c_set_write_transfer_dir(i2c);
-    i2c_set_bytes_to_transfer(i2c, hn); /* initially transferring header */
+    i2c_set_bytes_to_transfer(i2c, xfer.nbytes);
     i2c_enable_autoend(i2c); /* has no effect while RELOAD is set */
-    i2c_set_reload(i2c);
+    if (xfer.remaining > 0xFF) {
+        i2c_set_reload(i2c);
+    } else {
+        i2c_clear_reload(i2c);
+    }
+    i2c_enable_interrupt(i2c, I2C_XFER_INTERRUPTS);
     i2c_send_start(i2c);
 
-    /* TODO: collapse into one loop */
-    for (size_t n = 0; n < hn; n++) {
-        /* wait until ready for another byte to be written to data reg */
-        bool wait = true;
-        while (wait) {
-            if (i2c_transmit_int_status(i2c)) {
-                wait = false;
-            }
-            if (i2c_nack(i2c)) {
-                i2c_clear_nack(i2c);
-                return false; /* TODO: handle better? */
-            }
+    return true;
+}
+
+/* return status of the current (or last) interrupt driven transaction */
+i2c_xfer_status_t i2c_xfer_status(void) {
+    return xfer.status;
+}
+
+/* return the next byte of the transaction, stepping through header and rows */
+static uint8_t xfer_next_byte(void) {
+    while (xfer.run == 0) {
+        if (xfer.in_header) {
+            xfer.in_header = false;
+        } else {
+            xfer.row += xfer.stride;
+            xfer.rows--;
         }
+        xfer.p = xfer.row;
+        xfer.run = xfer.rows > 0 ? xfer.row_len : 0;
+    }
+    xfer.run--;
+    return *xfer.p++;
+}
 
-        i2c_send_data(i2c, *(h + n));
+/* I2C1 event and error interrupt: runs the transmit engine */
+void i2c1_isr(void) {
+    uint32_t i2c = xfer.i2c;
+    uint32_t isr = I2C_ISR(i2c);
+
+    if (xfer.status != I2C_XFER_BUSY) {
+        i2c_disable_interrupt(i2c, I2C_XFER_INTERRUPTS);
+        return;
     }
 
-    /* now send main buffer */
-    /* size_t total_bytes = sizeof(framebuffer); */
-    /* uint8_t *p = framebuffer; */
-    uint8_t nbytes = 0;
+    if (isr & I2C_ISR_ARLO) {
+        /* lost the bus to another master; hardware has already released it */
+        I2C_ICR(i2c) = I2C_ICR_ARLOCF;
+        xfer_finish(I2C_XFER_ARLO);
+        return;
+    }
 
-    /* wait for transfer to complete before reloading NBYTES */
-    while (!i2c_transfer_complete_reload(i2c));
-    if (wn > 0xFF) {
-        nbytes = 0xFF;
-        i2c_set_bytes_to_transfer(i2c, nbytes);
-    } else {
-        nbytes = wn;
-        i2c_set_bytes_to_transfer(i2c, nbytes);
-        i2c_clear_reload(i2c);
+    if (isr & I2C_ISR_BERR) {
+        I2C_ICR(i2c) = I2C_ICR_BERRCF;
+        xfer_finish(I2C_XFER_BERR);
+        return;
     }
 
-    do {
-        bool wait = true;
-        while (wait) {
-            if (i2c_transmit_int_status(i2c)) {
-                wait = false;
-            }
-            if (i2c_nack(i2c)) {
-                i2c_clear_nack(i2c);
-                return false; /* TODO: handle better? */
-            }
+    if (isr & I2C_ISR_NACKF) {
+        i2c_clear_nack(i2c);
+        /* autoend doesn't apply while RELOAD is set, so end it by hand */
+        if (I2C_CR2(i2c) & I2C_CR2_RELOAD) {
+            i2c_clear_reload(i2c);
+            i2c_send_stop(i2c);
         }
+        xfer_finish(I2C_XFER_NACK);
+        return;
+    }
 
-        i2c_send_data(i2c, *w++);
-        nbytes--;
-        wn--;
-
-        if (nbytes == 0 && wn != 0) {
-            /* wait for TCR */
-            while (!i2c_transfer_complete_reload(i2c));
-
-            /* reload NBYTES and start transferring the next chunk */
-            if (wn > 0xFF) {
-                nbytes = 0xFF;
-                i2c_set_bytes_to_transfer(i2c, nbytes);
-            } else {
-                nbytes = wn;
-                /* have to set NBYTES before setting RELOAD. Not clear why. */
-                i2c_set_bytes_to_transfer(i2c, nbytes);
-                i2c_clear_reload(i2c);
-            }
+    if (isr & I2C_ISR_TXIS) {
+        i2c_send_data(i2c, xfer_next_byte());
+        xfer.nbytes--;
+        xfer.remaining--;
+    }
+
+    if (isr & I2C_ISR_TCR) {
+        /* reload NBYTES and start transferring the next chunk */
+        if (xfer.remaining > 0xFF) {
+            xfer.nbytes = 0xFF;
+            i2c_set_bytes_to_transfer(i2c, xfer.nbytes);
+        } else {
+            xfer.nbytes = xfer.remaining;
+            /* have to set NBYTES before setting RELOAD. Not clear why. */
+            i2c_set_bytes_to_transfer(i2c, xfer.nbytes);
+            i2c_clear_reload(i2c);
         }
-    } while (wn > 0);
+    }
 
-    return false; /* should never get here */
+    if (isr & I2C_ISR_STOPF) {
+        I2C_ICR(i2c) = I2C_ICR_STOPCF;
+        xfer_finish(xfer.remaining == 0 ? I2C_XFER_OK : I2C_XFER_BERR);
+    }
 }
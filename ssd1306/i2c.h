@@ -5,15 +5,166 @@
 #define SCL_PIN GPIO9
 #define SDA_PIN GPIO10
 
+/* result of an interrupt driven transaction */
+typedef enum {
+    I2C_XFER_OK,    /* all bytes sent and STOP generated */
+    I2C_XFER_BUSY,  /* transaction in progress */
+    I2C_XFER_NACK,  /* slave did not acknowledge address or data */
+    I2C_XFER_ARLO,  /* arbitration lost */
+    I2C_XFER_BERR,  /* misplaced START/STOP on the bus */
+    I2C_XFER_TIMEOUT /* not finished in time; the bus was recovered */
+} i2c_xfer_status_t;
+
+/*
+ * time a transaction may take beyond its bytes at the SCL frequency (ms),
+ * before it is abandoned and the bus recovered
+ */
+#ifndef I2C_TIMEOUT_MS
+#define I2C_TIMEOUT_MS 10
+#endif
+
+/* error counters and worst-case latency of a bus */
+typedef struct {
+    uint32_t transactions; /* started */
+    uint32_t nacks;
+    uint32_t bus_errors; /* arbitration lost or misplaced START/STOP */
+    uint32_t timeouts;
+    uint32_t recoveries;
+    uint32_t max_latency_ms; /* longest start to end of a transaction */
+} i2c_stats_t;
+
+/* SCL frequency steps of i2c_calibrate() (Hz) */
+#ifndef I2C_CALIBRATION_STEP
+#define I2C_CALIBRATION_STEP 50000
+#endif
+
+/* I2C kernel clock sources */
+typedef enum {
+    I2C_CLOCK_HSI,   /* 8 MHz HSI oscillator */
+    I2C_CLOCK_SYSCLK /* system clock, e.g. 48 MHz from the PLL */
+} i2c_clock_t;
+
+/* I2C bus modes, with their maximum SCL frequency */
+typedef enum {
+    I2C_STANDARD,  /* Standard-mode, 100 kHz */
+    I2C_FAST,      /* Fast-mode, 400 kHz */
+    I2C_FAST_PLUS  /* Fast-mode Plus, 1 MHz */
+} i2c_profile_t;
+
+/* called from interrupt context when a transaction ends */
+typedef void (*i2c_xfer_callback_t)(i2c_xfer_status_t status);
+
 /*
  * setup I2C peripheral
  *
  * I2C peripheral: I2C1
  * SCL: PA9
  * SDA: PA10
+ * interrupt: I2C1 (transmit engine)
+ * speed: Standard-mode, on the HSI clock
  */
 void i2c_setup(void);
 
+/*
+ * compute a TIMINGR value for an SCL frequency
+ *
+ * The SCL low and high periods, data setup (SCLDEL) and data hold (SDADEL)
+ * times meet the limits of the slowest bus mode that allows scl_hz, and SCL
+ * is as close to scl_hz as the kernel clock allows without exceeding it.
+ *
+ * kernel_hz: I2C kernel clock (Hz)
+ * scl_hz:    SCL frequency (Hz), 1 MHz at most
+ *
+ * Returns the TIMINGR value, or 0 if scl_hz is 0, above 1 MHz, or too slow
+ * for the kernel clock
+ */
+uint32_t i2c_timing(uint32_t kernel_hz, uint32_t scl_hz);
+
+/* SCL frequency (Hz) a TIMINGR value gives with a kernel clock (Hz) */
+uint32_t i2c_timing_scl_hz(uint32_t kernel_hz, uint32_t timingr);
+
+/*
+ * select the kernel clock and set the SCL frequency
+ *
+ * Waits for the transmit engine to be idle. Above Fast-mode, the Fast-mode
+ * Plus drive of SCL_PIN and SDA_PIN is switched on.
+ *
+ * i2c:    I2C peripheral (only I2C1 is supported)
+ * clock:  kernel clock; SYSCLK is taken from rcc_ahb_frequency
+ * scl_hz: SCL frequency (Hz), 1 MHz at most
+ *
+ * Returns the SCL frequency set (at most scl_hz), or 0 if i2c_timing() has
+ * no timing for scl_hz; the clock and timing are then left alone
+ */
+uint32_t i2c_set_scl(uint32_t i2c, i2c_clock_t clock, uint32_t scl_hz);
+
+/*
+ * set the SCL frequency to the maximum of a bus mode
+ *
+ * The 8 MHz HSI clock is too slow for 1 MHz: Fast-mode Plus gets as close as
+ * the Fast-mode Plus timing limits allow.
+ *
+ * Returns the SCL frequency set, see i2c_set_scl()
+ */
+uint32_t i2c_set_profile(uint32_t i2c, i2c_clock_t clock,
+        i2c_profile_t profile);
+
+/*
+ * find the fastest SCL frequency a device keeps up with (blocking)
+ *
+ * Steps SCL up from Standard-mode by I2C_CALIBRATION_STEP Hz, writing the
+ * probe bytes at each step, until the device fails to acknowledge them or
+ * max_hz is passed. Then backs off one step below the fastest frequency that
+ * worked, for margin.
+ *
+ * i2c:    I2C peripheral (only I2C1 is supported)
+ * clock:  kernel clock, see i2c_set_scl()
+ * addr:   7bit I2C device address
+ * probe:  bytes the device accepts at any time, e.g. a NOP command
+ * n:      number of probe bytes
+ * max_hz: fastest SCL frequency to try (Hz)
+ *
+ * Returns the SCL frequency set, or 0 if the device doesn't acknowledge in
+ * Standard-mode; the bus is then left in Standard-mode
+ */
+uint32_t i2c_calibrate(uint32_t i2c, i2c_clock_t clock, uint8_t addr,
+        uint8_t *probe, size_t n, uint32_t max_hz);
+
+/*
+ * free a bus a slave is holding, and reset the peripheral
+ *
+ * A slave reset or glitched mid-byte can hold SDA low, waiting for clocks
+ * that never come. SCL and SDA are taken over as open-drain GPIOs, SCL is
+ * pulsed (up to 9 times) until SDA is released, and a STOP is generated;
+ * then the peripheral is reset by clearing PE, which keeps its timing.
+ * Any transaction in progress is lost: end it first, see
+ * i2c_check_timeout().
+ *
+ * i2c: I2C peripheral (only I2C1 is supported)
+ */
+void i2c_recover_bus(uint32_t i2c);
+
+/*
+ * end the transaction in progress if it has passed its deadline
+ *
+ * The deadline is the transaction's bytes at the current SCL frequency plus
+ * I2C_TIMEOUT_MS. A late transaction is ended with I2C_XFER_TIMEOUT (its
+ * callback is called from here) and the bus is recovered with
+ * i2c_recover_bus(); so is a bus that a start found held by a slave. The
+ * blocking functions call this while they wait; code waiting for an
+ * asynchronous transaction should too. Call it from thread context: the
+ * recovery busy-waits for about 100 us, with interrupts enabled.
+ *
+ * Returns true if a transaction timed out
+ */
+bool i2c_check_timeout(uint32_t i2c);
+
+/* error counters and worst-case latency since i2c_setup() or the last clear */
+const i2c_stats_t *i2c_get_stats(uint32_t i2c);
+
+/* zero the counters of i2c_get_stats() */
+void i2c_clear_stats(uint32_t i2c);
+
 /* set RELOAD bit in I2C_CR2 register */
 void i2c_set_reload(uint32_t i2c);
 
@@ -34,12 +185,13 @@ void i2c_clear_nack(uint32_t i2c);
 /*
  * Write a header, followed by another buffer, in 1 transaction.
  *
- * Header must be <= 255 bytes. Buffer size is unlimited.
+ * Header and buffer sizes are unlimited. Blocks until the transaction has
+ * finished, or timed out (see i2c_check_timeout()).
  *
  * i2c:  I2C peripheral, e.g. I2C1
  * addr: 7bit I2C device address
  * h:    pointer to header to be written
- * hn:   number of bytes in header to be written (255 bytes or fewer)
+ * hn:   number of bytes in header to be written
  * w:    pointer to primary buffer to be written
  * wn:   number of bytes in buffer to be written
  *
@@ -48,4 +200,59 @@ void i2c_clear_nack(uint32_t i2c);
 bool i2c_write_with_header(uint32_t i2c, uint8_t addr,
         uint8_t *h, size_t hn, uint8_t *w, size_t wn);
 
+/*
+ * Write a header, followed by a strided 2D buffer, in 1 transaction.
+ *
+ * The buffer is sent as `rows` runs of `row_len` bytes; consecutive runs start
+ * `stride` bytes apart. Blocks until the transaction has finished, or timed
+ * out (see i2c_check_timeout()).
+ *
+ * i2c:     I2C peripheral, e.g. I2C1
+ * addr:    7bit I2C device address
+ * h:       pointer to header to be written
+ * hn:      number of bytes in header to be written
+ * w:       pointer to first byte of first row to be written
+ * row_len: number of bytes in each row
+ * rows:    number of rows
+ * stride:  distance (in bytes) between the starts of consecutive rows
+ *
+ * Returns true on success, false otherwise
+ */
+bool i2c_write_with_header_2d(uint32_t i2c, uint8_t addr,
+        uint8_t *h, size_t hn, uint8_t *w, size_t row_len, size_t rows,
+        size_t stride);
+
+/*
+ * Start an interrupt driven write of a header, followed by a strided 2D
+ * buffer, in 1 transaction.
+ *
+ * Returns immediately. Completion, NACK and arbitration loss are reported
+ * through i2c_xfer_status() and the callback; so is a timeout, once
+ * i2c_check_timeout() finds the deadline passed. If the bus is held by a
+ * slave although no transaction is in progress, this fails; the next
+ * i2c_check_timeout() or blocking write recovers the bus.
+ *
+ * i2c:      I2C peripheral (only I2C1 is supported)
+ * addr:     7bit I2C device address
+ * h:        pointer to header to be written
+ * hn:       number of bytes in header to be written
+ * w:        pointer to first byte of first row to be written
+ * row_len:  number of bytes in each row
+ * rows:     number of rows
+ * stride:   distance (in bytes) between the starts of consecutive rows
+ * callback: called from interrupt context when the transaction ends (may be
+ *           NULL). May start another transaction.
+ *
+ * header and buffer must stay valid until the transaction ends.
+ *
+ * Returns true if the transaction was started, false if the engine is busy
+ * or the bus held
+ */
+bool i2c_write_with_header_2d_async(uint32_t i2c, uint8_t addr,
+        const uint8_t *h, size_t hn, const uint8_t *w, size_t row_len,
+        size_t rows, size_t stride, i2c_xfer_callback_t callback);
+
+/* return status of the current (or last) interrupt driven transaction */
+i2c_xfer_status_t i2c_xfer_status(void);
+
 #endif
@@ -1,5 +1,6 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/i2c.h>
+#include <libopencm3/stm32/spi.h>
 
 #include "systick.h"
 
@@ -11,6 +12,58 @@
 
 #include "ssd1306.h"
 #include "ssd1306_graphics.h"
+#include "ssd1306_frame.h"
+
+static uint32_t buffer[SSD1306_BUFFER_WORDS];
+static ssd1306_t display;
+
+static const ssd1306_config_t config = {
+#ifdef SSD1306_I2C
+    .i2c = I2C1,
+    .addr = SSD1306_ADDR_PRIMARY,
+#elif defined(SSD1306_SPI)
+    .spi = SPI1,
+    .cs_port = CS_PORT,
+    .cs_pin = CS_PIN,
+    .dc_port = DC_PORT,
+    .dc_pin = DC_PIN,
+    .reset_port = RESET_PORT,
+    .reset_pin = RESET_PIN,
+#endif
+    .buffer = buffer,
+};
+
+/* test patterns, one per frame */
+static void demo_frame(surface_t *screen, uint32_t frame, void *ctx) {
+    (void) ctx;
+    switch (frame % 5) {
+    case 0:
+        fill_display(screen, PIXEL_ON);
+        break;
+    case 1:
+        draw_checkerboard(screen);
+        break;
+    case 2:
+        fill_display(screen, PIXEL_OFF);
+        break;
+    case 3:
+        draw_checkerboard(screen);
+        fill_display(screen, PIXEL_TOGGLE);
+        break;
+    default:
+        /* top left */
+        ssd1306_draw_pixel(&display, 0, 0, PIXEL_ON);
+        ssd1306_draw_pixel(&display, 4, 1, PIXEL_ON);
+        /* bottom left */
+        ssd1306_draw_pixel(&display, 0, 63, PIXEL_ON);
+        /* bottom right */
+        ssd1306_draw_pixel(&display, 127, 63, PIXEL_TOGGLE);
+        draw_rectangle(screen, 2, 1, 31, 9, PIXEL_TOGGLE);
+        draw_rectangle(screen, 2, 35, 127, 37, PIXEL_TOGGLE);
+        ssd1306_draw_pixel(&display, 4, 1, PIXEL_TOGGLE);
+        break;
+    }
+}
 
 static void setup(void) {
     /* external 8MHz oscillator */
@@ -20,6 +73,7 @@ static void setup(void) {
     systick_setup();
 #ifdef SSD1306_I2C
     i2c_setup();
+    i2c_set_profile(I2C1, I2C_CLOCK_SYSCLK, I2C_FAST);
 #elif defined(SSD1306_SPI)
     spi_setup();
 #endif
@@ -28,63 +82,43 @@ static void setup(void) {
 int main(void) {
     setup();
 
-    ssd1306_init();
-    ssd1306_update_display();
-
-
-    uint32_t delay_time = 200;
-    for (int n = 0; n < 5; n++) {
-        fill_display(PIXEL_ON);
-        ssd1306_update_display();
-        delay(delay_time);
-
-        draw_checkerboard();
-        ssd1306_update_display();
-        delay(delay_time);
-
-        fill_display(PIXEL_OFF);
-        ssd1306_update_display();
-        delay(delay_time);
-
-        draw_checkerboard();
-        fill_display(PIXEL_TOGGLE);
-        ssd1306_update_display();
-        delay(delay_time);
-
-        /* top left */
-        ssd1306_draw_pixel(0, 0, PIXEL_ON);
-        ssd1306_draw_pixel(4, 1, PIXEL_ON);
-        /* bottom left */
-        ssd1306_draw_pixel(0, 63, PIXEL_ON);
-        /* bottom right */
-        ssd1306_draw_pixel(127, 63, PIXEL_TOGGLE);
-        draw_rectangle(2, 1, 31, 9, PIXEL_TOGGLE);
-        draw_rectangle(2, 35, 127, 37, PIXEL_TOGGLE);
-        ssd1306_draw_pixel(4, 1, PIXEL_TOGGLE);
-        ssd1306_update_display();
-        delay(delay_time);
-    }
-
-    fill_display(PIXEL_OFF);
-    ssd1306_update_display();
-
-    draw_line(0, 32, 127, 32, PIXEL_ON); /* horizontal */
-    draw_line(63, 0, 63, 63, PIXEL_ON); /* vertical */
-
-    draw_line(0, 0, 127, 63, PIXEL_ON); /* small positive slope */
-    draw_line(64, 0, 127, 63, PIXEL_ON); /* slope +1 */
-    draw_line(96, 0, 127, 63, PIXEL_ON); /* large positive slope */
-    draw_line(127, 63, 0, 32, PIXEL_ON); /* small positive slope, backwards */
-    draw_line(127, 63, 112, 0, PIXEL_ON); /* large positive slope, backwards */
-
-    draw_line(0, 63, 127, 0, PIXEL_ON); /* small negative slope */
-    draw_line(0, 63, 63, 0, PIXEL_ON); /* slope -1 */
-    draw_line(0, 63, 32, 0, PIXEL_ON); /* large negative slope */
-    draw_line(16, 0, 0, 63, PIXEL_ON); /* large negative slope, backwards */
-    draw_line(127, 32, 0, 63, PIXEL_ON); /* small negative slope, backwards */
-    ssd1306_update_display();
-
-    draw_textbox("two \nlines", 10, 2, 2, 46, 24, PIXEL_OFF, PIXEL_ON);
-    draw_textbox("three\nlines\nnow!", 16, 2, 30, 46, 62, PIXEL_ON, PIXEL_OFF);
-    ssd1306_update_display();
+    ssd1306_init(&display, &config);
+    ssd1306_update_display(&display);
+    surface_t *screen = ssd1306_surface(&display);
+
+
+    /* 5 rounds of the test patterns, 200 ms apart */
+    frame_scheduler_t scheduler;
+    frame_scheduler_init(&scheduler, &display, 5, demo_frame, NULL);
+    frame_scheduler_run(&scheduler, 25);
+
+    while (ssd1306_flush_busy(&display));
+    fill_display(screen, PIXEL_OFF);
+    ssd1306_update_display(&display);
+
+    draw_line(screen, 0, 32, 127, 32, PIXEL_ON); /* horizontal */
+    draw_line(screen, 63, 0, 63, 63, PIXEL_ON); /* vertical */
+
+    draw_line(screen, 0, 0, 127, 63, PIXEL_ON); /* small positive slope */
+    draw_line(screen, 64, 0, 127, 63, PIXEL_ON); /* slope +1 */
+    draw_line(screen, 96, 0, 127, 63, PIXEL_ON); /* large positive slope */
+    /* small positive slope, backwards */
+    draw_line(screen, 127, 63, 0, 32, PIXEL_ON);
+    /* large positive slope, backwards */
+    draw_line(screen, 127, 63, 112, 0, PIXEL_ON);
+
+    draw_line(screen, 0, 63, 127, 0, PIXEL_ON); /* small negative slope */
+    draw_line(screen, 0, 63, 63, 0, PIXEL_ON); /* slope -1 */
+    draw_line(screen, 0, 63, 32, 0, PIXEL_ON); /* large negative slope */
+    /* large negative slope, backwards */
+    draw_line(screen, 16, 0, 0, 63, PIXEL_ON);
+    /* small negative slope, backwards */
+    draw_line(screen, 127, 32, 0, 63, PIXEL_ON);
+    ssd1306_update_display(&display);
+
+    draw_textbox(screen, "two \nlines", 10, 2, 2, 46, 24,
+            PIXEL_OFF, PIXEL_ON);
+    draw_textbox(screen, "three\nlines\nnow!", 16, 2, 30, 46, 62,
+            PIXEL_ON, PIXEL_OFF);
+    ssd1306_update_display(&display);
 }
@@ -0,0 +1,78 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libopencm3/cm3/cortex.h>
+
+#include "profile.h"
+
+static profile_region_t regions[PROFILE_REGIONS];
+static uint32_t nregions;
+
+/* clear a region's timings */
+static void reset_region(profile_region_t *r) {
+    r->count = 0;
+    r->min_ns = UINT32_MAX;
+    r->max_ns = 0;
+    r->total_ns = 0;
+}
+
+/* find a region by name, adding it if it is new */
+profile_region_t *profile_region(const char *name) {
+    profile_region_t *r = NULL;
+
+    uint32_t masked = cm_mask_interrupts(1);
+    for (uint32_t i = 0; i < nregions && !r; i++) {
+        if (!strcmp(regions[i].name, name)) {
+            r = &regions[i];
+        }
+    }
+    if (!r && nregions < PROFILE_REGIONS) {
+        r = &regions[nregions++];
+        r->name = name;
+        reset_region(r);
+    }
+    cm_mask_interrupts(masked);
+
+    return r;
+}
+
+/* add a time to a region (may be NULL) */
+void profile_add(profile_region_t *r, uint64_t ns) {
+    uint32_t t = ns > UINT32_MAX ? UINT32_MAX : (uint32_t) ns;
+    if (!r) {
+        return;
+    }
+
+    uint32_t masked = cm_mask_interrupts(1);
+    r->count++;
+    r->total_ns += t;
+    if (t < r->min_ns) {
+        r->min_ns = t;
+    }
+    if (t > r->max_ns) {
+        r->max_ns = t;
+    }
+    cm_mask_interrupts(masked);
+}
+
+/* mean time of a region (ns), 0 if it has none */
+uint32_t profile_mean_ns(const profile_region_t *r) {
+    return r->count ? (uint32_t) (r->total_ns / r->count) : 0;
+}
+
+/* regions in the order they were first recorded */
+const profile_region_t *profile_regions(uint32_t *n) {
+    *n = nregions;
+    return regions;
+}
+
+/* zero every region's timings, keeping the names */
+void profile_reset(void) {
+    uint32_t masked = cm_mask_interrupts(1);
+    for (uint32_t i = 0; i < nregions; i++) {
+        reset_region(&regions[i]);
+    }
+    cm_mask_interrupts(masked);
+}
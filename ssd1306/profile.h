@@ -0,0 +1,73 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/*
+ * Profiling of code regions
+ *
+ * PROF_BEGIN(name) and PROF_END(name), in one block, time the code between
+ * them with nanos64(): on the target, to a SysTick clock; on the host, from
+ * clock_gettime(), so the numbers compare. Each region name accumulates a
+ * count, minimum, maximum and total in a RAM table of PROFILE_REGIONS
+ * entries; regions beyond that are not recorded.
+ *
+ * The macros compile to nothing unless PROFILE is defined in the makefile.
+ * A region's time includes one nanos64() call, and its first PROF_END looks
+ * the name up in the table; later ones reuse the entry.
+ */
+
+#include "systick.h"
+
+/* regions the table holds */
+#ifndef PROFILE_REGIONS
+#define PROFILE_REGIONS 16
+#endif
+
+/* timings of one region */
+typedef struct {
+    const char *name;
+    uint32_t count;
+    uint32_t min_ns;
+    uint32_t max_ns;
+    uint64_t total_ns;
+} profile_region_t;
+
+#ifdef PROFILE
+#define PROF_BEGIN(name) uint64_t prof_t0_##name = nanos64()
+
+#define PROF_END(name) do { \
+        uint64_t prof_t1 = nanos64(); \
+        static profile_region_t *prof_region; \
+        if (!prof_region) { \
+            prof_region = profile_region(#name); \
+        } \
+        profile_add(prof_region, prof_t1 - prof_t0_##name); \
+    } while (0)
+#else
+#define PROF_BEGIN(name) do { } while (0)
+#define PROF_END(name) do { } while (0)
+#endif
+
+/*
+ * find a region by name, adding it if it is new
+ *
+ * Returns the region, or NULL if the table is full
+ */
+profile_region_t *profile_region(const char *name);
+
+/* add a time to a region (may be NULL); safe from interrupt handlers */
+void profile_add(profile_region_t *region, uint64_t ns);
+
+/* mean time of a region (ns), 0 if it has none */
+uint32_t profile_mean_ns(const profile_region_t *region);
+
+/*
+ * regions in the order they were first recorded
+ *
+ * n: set to the number of regions
+ */
+const profile_region_t *profile_regions(uint32_t *n);
+
+/* zero every region's timings, keeping the names */
+void profile_reset(void);
+
+#endif
@@ -1,38 +1,36 @@
 #include <stddef.h>
+#include <stdint.h>
+#include <libopencm3/cm3/nvic.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
 
 #include "spi.h"
 
+static spi_dma_callback_t dma_callback = NULL;
+
 /*
  * setup SPI peripheral
  *
  * SPI peripheral: SPI1
  * SCK: PB3
  * MOSI: PB5
+ * TX DMA: DMA1 channel 3
  */
 void spi_setup(void) {
     rcc_periph_clock_enable(RCC_SPI1);
+    rcc_periph_clock_enable(RCC_DMA);
     rcc_periph_clock_enable(RCC_GPIOA);
     rcc_periph_clock_enable(RCC_GPIOB);
 
     gpio_mode_setup(SPI_PORT, GPIO_MODE_AF, GPIO_PUPD_NONE, SCK_PIN | MOSI_PIN);
     gpio_set_af(SPI_PORT, GPIO_AF0, SCK_PIN | MOSI_PIN);
 
-    /* TODO: setup for CS, DC, RESET should go into a different function */
-    gpio_mode_setup(CS_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, CS_PIN);
-    gpio_mode_setup(DC_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, DC_PIN);
-    gpio_mode_setup(RESET_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, RESET_PIN);
-    /* initially deselect display, hold it in reset, and set control mode */
-    gpio_set(CS_PORT, CS_PIN);
-    gpio_clear(RESET_PORT, RESET_PIN);
-    gpio_clear(DC_PORT, DC_PIN);
-
+    /* CS, DC and RESET of each display are set up by ssd1306_init() */
 
-    /* TODO: figure out baud rate */
     spi_init_master(SPI1,
-            SPI_CR1_BAUDRATE_FPCLK_DIV_2,
+            SPI_BAUDRATE,
             SPI_CR1_CPOL_CLK_TO_1_WHEN_IDLE,
             SPI_CR1_CPHA_CLK_TRANSITION_2,
             SPI_CR1_MSBFIRST);
@@ -40,6 +38,19 @@ void spi_setup(void) {
     spi_set_nss_high(SPI1); /* set SSI */
     spi_set_data_size(SPI1, SPI_CR2_DS_8BIT); /* set DS[3:0] */
 
+    /* TX DMA: memory -> SPI1_DR, byte at a time. Address and count are set
+     * per transfer */
+    dma_channel_reset(SPI_DMA, SPI_DMA_CHANNEL);
+    dma_set_peripheral_address(SPI_DMA, SPI_DMA_CHANNEL,
+            (uintptr_t) &SPI_DR(SPI1));
+    dma_set_read_from_memory(SPI_DMA, SPI_DMA_CHANNEL);
+    dma_enable_memory_increment_mode(SPI_DMA, SPI_DMA_CHANNEL);
+    dma_set_peripheral_size(SPI_DMA, SPI_DMA_CHANNEL, DMA_CCR_PSIZE_8BIT);
+    dma_set_memory_size(SPI_DMA, SPI_DMA_CHANNEL, DMA_CCR_MSIZE_8BIT);
+    dma_set_priority(SPI_DMA, SPI_DMA_CHANNEL, DMA_CCR_PL_HIGH);
+    dma_enable_transfer_complete_interrupt(SPI_DMA, SPI_DMA_CHANNEL);
+    nvic_enable_irq(NVIC_DMA1_CHANNEL2_3_IRQ);
+
     spi_enable(SPI1);
 }
 
@@ -59,3 +70,74 @@ void spi_write_buffer8(uint32_t spi, uint8_t *w, size_t wn) {
         spi_send8(spi, w[n]);
     }
 }
+
+/*
+ * write a buffer via SPI, two bytes per data register write (8 bit data)
+ *
+ * CS pin must be asserted/deasserted externally
+ *
+ * With 8 bit frames, a 16 bit write to DR puts two frames in the TX FIFO, low
+ * byte first (data packing). spi_send() waits for TXE, which on this SPI
+ * means the 32 bit FIFO is at most half full: there is room for the two
+ * frames, and the FIFO never runs dry while SCK is slower than the loop.
+ *
+ * spi: SPI peripheral, e.g. SPI1
+ * w: pointer to buffer to be written
+ * wn: number of bytes in buffer to be written
+ */
+void spi_write_buffer8_packed(uint32_t spi, const uint8_t *w, size_t wn) {
+    size_t n = 0;
+    for (; n + 1 < wn; n += 2) {
+        spi_send(spi, w[n] | (uint16_t) w[n + 1] << 8);
+    }
+    if (n < wn) {
+        spi_send8(spi, w[n]);
+    }
+}
+
+/*
+ * set the function called when a DMA write completes
+ *
+ * callback: called from interrupt context; may start another DMA write
+ */
+void spi_set_dma_callback(spi_dma_callback_t callback) {
+    dma_callback = callback;
+}
+
+/*
+ * write a buffer via SPI using DMA, bytewise (8 bit data)
+ *
+ * CS pin must be asserted/deasserted externally
+ *
+ * Returns immediately. The DMA callback is called once the last byte has been
+ * handed to the SPI peripheral; use spi_wait_idle() before changing CS/DC.
+ *
+ * spi: SPI peripheral, e.g. SPI1
+ * w: pointer to buffer to be written (must stay valid until completion)
+ * wn: number of bytes in buffer to be written (65535 or fewer)
+ */
+void spi_write_buffer8_dma(uint32_t spi, uint8_t *w, size_t wn) {
+    dma_disable_channel(SPI_DMA, SPI_DMA_CHANNEL);
+    dma_set_memory_address(SPI_DMA, SPI_DMA_CHANNEL, (uintptr_t) w);
+    dma_set_number_of_data(SPI_DMA, SPI_DMA_CHANNEL, wn);
+    spi_enable_tx_dma(spi);
+    dma_enable_channel(SPI_DMA, SPI_DMA_CHANNEL);
+}
+
+/* wait for TX FIFO to drain and the last byte to be shifted out */
+void spi_wait_idle(uint32_t spi) {
+    /* FTLVL_FIFO_FULL covers both FTLVL bits: wait for FTLVL == 0 */
+    while (SPI_SR(spi) & (SPI_SR_FTLVL_FIFO_FULL | SPI_SR_BSY));
+}
+
+/* SPI1 TX DMA transfer complete */
+void dma1_channel2_3_isr(void) {
+    if (dma_get_interrupt_flag(SPI_DMA, SPI_DMA_CHANNEL, DMA_TCIF)) {
+        dma_clear_interrupt_flags(SPI_DMA, SPI_DMA_CHANNEL, DMA_TCIF);
+        dma_disable_channel(SPI_DMA, SPI_DMA_CHANNEL);
+        spi_disable_tx_dma(SPI1);
+        if (dma_callback) {
+            dma_callback();
+        }
+    }
+}
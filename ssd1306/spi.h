@@ -5,6 +5,7 @@
 #define MOSI_PIN GPIO5
 #define SCK_PIN GPIO3
 
+/* default wiring of the display's CS, DC and RESET pins */
 #define CS_PORT GPIOA
 #define CS_PIN GPIO5
 #define DC_PORT GPIOA
@@ -12,12 +13,29 @@
 #define RESET_PORT GPIOA
 #define RESET_PIN GPIO3
 
+/*
+ * baud rate prescaler: SCK = PCLK / 2 (24 MHz at 48 MHz) by default. Override
+ * in makefile, e.g. -DSPI_BAUDRATE=SPI_CR1_BAUDRATE_FPCLK_DIV_8 for 6 MHz,
+ * within the 10 MHz the SSD1306 datasheet specifies; most modules run faster.
+ */
+#ifndef SPI_BAUDRATE
+#define SPI_BAUDRATE SPI_CR1_BAUDRATE_FPCLK_DIV_2
+#endif
+
+/* SPI1_TX DMA request is on DMA1 channel 3 */
+#define SPI_DMA DMA1
+#define SPI_DMA_CHANNEL DMA_CHANNEL3
+
+/* called from the DMA interrupt when a DMA write has been handed to the SPI */
+typedef void (*spi_dma_callback_t)(void);
+
 /*
  * setup SPI peripheral
  *
  * SPI peripheral: SPI1
  * SCK: PB3
  * MOSI: PB5
+ * TX DMA: DMA1 channel 3
  */
 void spi_setup(void);
 
@@ -30,4 +48,38 @@ void spi_setup(void);
  */
 void spi_write_buffer8(uint32_t spi, uint8_t *w, size_t wn);
 
+/*
+ * write a buffer via SPI, two bytes per data register write (8 bit data)
+ *
+ * Bytes are sent in buffer order, as with spi_write_buffer8(), with half as
+ * many waits and register writes.
+ *
+ * spi: SPI peripheral, e.g. SPI1
+ * w: pointer to buffer to be written
+ * wn: number of bytes in buffer to be written
+ */
+void spi_write_buffer8_packed(uint32_t spi, const uint8_t *w, size_t wn);
+
+/*
+ * set the function called when a DMA write completes
+ *
+ * callback: called from interrupt context; may start another DMA write
+ */
+void spi_set_dma_callback(spi_dma_callback_t callback);
+
+/*
+ * write a buffer via SPI using DMA, bytewise (8 bit data)
+ *
+ * Returns immediately. The DMA callback is called once the last byte has been
+ * handed to the SPI peripheral; use spi_wait_idle() before changing CS/DC.
+ *
+ * spi: SPI peripheral, e.g. SPI1
+ * w: pointer to buffer to be written (must stay valid until completion)
+ * wn: number of bytes in buffer to be written (65535 or fewer)
+ */
+void spi_write_buffer8_dma(uint32_t spi, uint8_t *w, size_t wn);
+
+/* wait for TX FIFO to drain and the last byte to be shifted out */
+void spi_wait_idle(uint32_t spi);
+
 #endif
@@ -1,48 +1,92 @@
 /*
  * Driver for SSD1306 OLED display (I2C/SPI)
  *
- * I2C interface enabled by defining SSD1306_I2C in makefile
- * SPI interface enabled by defining SSD1306_SPI in makefile
- * interfaces are mutually exclusive
+ * Bus access goes through the display's transport (ssd1306_transport.h);
+ * SSD1306_I2C or SSD1306_SPI in makefile selects the default one.
  */
 
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+
+#include <libopencm3/cm3/cortex.h>
+
+#include "ssd1306.h"
+#include "ssd1306_transport.h"
+#include "profile.h"
 
 #ifdef SSD1306_I2C
-#include <libopencm3/stm32/i2c.h>
-#include "i2c.h"
+#define DEFAULT_TRANSPORT (&ssd1306_i2c_transport)
+#elif defined(SSD1306_SPI)
+#define DEFAULT_TRANSPORT (&ssd1306_spi_transport)
+#else
+#define DEFAULT_TRANSPORT NULL
 #endif
 
-#ifdef SSD1306_SPI
-#include <libopencm3/stm32/gpio.h>
-#include <libopencm3/stm32/spi.h>
-#include "spi.h"
-#include "systick.h"
-#endif
+static void flush_async_start(ssd1306_t *dev);
 
-#include "ssd1306.h"
+/* framebuffer size, in bytes */
+#define FRAMEBUFFER_SIZE (DISP_WIDTH * DISP_PAGES)
+
+/* mark every page clean */
+static void clear_dirty(ssd1306_t *dev) {
+    for (uint8_t p = 0; p < DISP_PAGES; p++) {
+        dev->dirty_x0[p] = 0xFF;
+        dev->dirty_x1[p] = 0;
+    }
+}
+
+/* wait until no asynchronous flush is using a display's bus */
+static void wait_bus_idle(const ssd1306_t *dev) {
+    const ssd1306_transport_t *t = dev->config.transport;
+    while (t->bus->current) {
+        t->poll(t->bus->current);
+    }
+}
 
-static uint8_t framebuffer[DISP_HEIGHT * DISP_WIDTH / 8] = { 0 };
+/* set up a display, initialize it and turn it on */
+void ssd1306_init(ssd1306_t *dev, const ssd1306_config_t *config) {
+    memset(dev, 0, sizeof(*dev));
+    dev->config = *config;
+    if (!dev->config.transport) {
+        dev->config.transport = DEFAULT_TRANSPORT;
+    }
+    const ssd1306_transport_t *t = dev->config.transport;
+    if (config->buffer) {
+        memset(config->buffer, 0, SSD1306_BUFFER_WORDS * 4);
+        surface_init(&dev->surface, (uint8_t *) config->buffer, DISP_WIDTH,
+                DISP_HEIGHT, DISP_WIDTH);
+        dev->surface.dev = dev;
+#ifdef SSD1306_DOUBLE_BUFFER
+        dev->frontbuffer = dev->surface.buffer + FRAMEBUFFER_SIZE;
+#else
+        dev->frontbuffer = dev->surface.buffer;
+#endif
+    } else {
+        /* nothing to draw into */
+        dev->surface.viewport = (ssd1306_rect_t) { 1, 1, 0, 0 };
+        dev->surface.clip = dev->surface.viewport;
+    }
+    clear_dirty(dev);
 
-/* initialize display and turn it on */
-void ssd1306_init(void) {
-    uint8_t control = CONTROL_BYTE_COMMAND;
     uint8_t init_cmd[] = {
         SSD1306_DISPLAY_OFF,
+        SSD1306_SET_MEM_ADDR_MODE,
+        SSD1306_MEM_ADDR_MODE_HORIZ, /* flush windows rely on this */
         SSD1306_SET_CLOCK_DIV,
         0x80, /* reset value */
         SSD1306_SET_MUX_RATIO,
-        0x3F, /* multiplex ratio for 128x64 */
+        DISP_HEIGHT - 1, /* multiplex ratio */
         SSD1306_SET_DISPLAY_OFFSET,
         0x00,
         SSD1306_SET_DISP_START_LINE | 0x0,
+        SSD1306_SET_COM_HW_CONFIG,
+        DISP_COM_PINS,
         SSD1306_SET_CHARGE_PUMP,
         SSD1306_CHARGE_PUMP_ON,
         /* set segment remap
          * set com output scan direction
-         * set com hardware configuration 0x12
          * set contrast 0xcf
          * set precharge period 0xf1 (internal)
          * set vcomh deselect level 0x40
@@ -54,199 +98,738 @@ void ssd1306_init(void) {
         SSD1306_DISPLAY_ON
     };
 
-#ifdef SSD1306_I2C
-    i2c_write_with_header(DISP_I2C, DISP_ADDR, &control, sizeof(control),
-            init_cmd, sizeof(init_cmd));
-#elif defined(SSD1306_SPI)
-    ssd1306_assert_reset();
-    delay(10);
-    ssd1306_deassert_reset();
-
-    /* gpio_clear(CS_PORT, CS_PIN); */
-    /* spi_send8(DISP_SPI, 0x55); */
-    /* while (SPI_SR(DISP_SPI) & SPI_SR_BSY); */
-    /* gpio_set(CS_PORT, CS_PIN); */
-    ssd1306_spi_write_commands(init_cmd, sizeof(init_cmd));
-#endif
+    wait_bus_idle(dev);
+    t->init(dev);
+    t->begin(dev);
+    t->write_commands(dev, init_cmd, sizeof(init_cmd));
+    t->end(dev);
+
+    /* display RAM contents are unknown, so the first flush sends everything */
+    if (dev->surface.buffer) {
+        ssd1306_mark_dirty(dev, 0, DISP_WIDTH - 1, 0, DISP_PAGES - 1);
+    }
 }
 
-/* set the value of a single pixel */
-void ssd1306_draw_pixel(uint8_t x, uint8_t y, pixel_t color) {
-    if (x >= DISP_WIDTH || y >= DISP_HEIGHT) {
+/* set up an off-screen canvas */
+void surface_init(surface_t *s, uint8_t *buffer, uint8_t width,
+        uint8_t height, uint8_t stride) {
+    if (width > SURFACE_MAX_WIDTH) {
+        width = SURFACE_MAX_WIDTH;
+    }
+    if (stride < width) {
+        stride = width;
+    }
+    *s = (surface_t) {
+        .buffer = buffer,
+        .width = width,
+        .height = height,
+        .stride = stride,
+        .dev = NULL,
+    };
+    s->viewport = (ssd1306_rect_t) { 0, 0, width - 1, height - 1 };
+    s->clip = s->viewport;
+    for (uint8_t p = 0; p < (height + 7) / 8; p++) {
+        memset(&buffer[p * stride], 0, width);
+    }
+}
+
+/* set the value of a single pixel of a surface */
+void surface_draw_pixel(surface_t *s, uint8_t x, uint8_t y, pixel_t color) {
+    if (x >= s->width || y >= s->height) {
         return;
     }
+    surface_draw_pixel_unchecked(s, x, y, color);
+}
 
-    int n = (y / 8) * DISP_WIDTH + x;
-    int s = y % 8;
+/* set the value of a single pixel */
+void ssd1306_draw_pixel(ssd1306_t *dev, uint8_t x, uint8_t y, pixel_t color) {
+    surface_draw_pixel(&dev->surface, x, y, color);
+}
 
-    if (color == PIXEL_OFF) {
-        framebuffer[n] &= ~(0x1 << s);
-    } else if (color == PIXEL_ON) {
-        framebuffer[n] |= (0x1 << s);
-    } else if (color == PIXEL_TOGGLE) {
-        framebuffer[n] ^= (0x1 << s);
+/* set the value of a single page */
+void ssd1306_draw_page(ssd1306_t *dev, uint8_t x, uint8_t p, pixel_t color) {
+    surface_draw_span(&dev->surface, x, x, p, 0xFF, color);
+}
+
+/* ssd1306_draw_span() on a surface */
+void surface_draw_span(surface_t *s, uint8_t x0, uint8_t x1, uint8_t p,
+        uint8_t mask, pixel_t color) {
+    if (x0 >= s->width || p >= (s->height + 7) / 8 || x0 > x1 || !mask) {
+        return;
+    }
+    if (x1 >= s->width) {
+        x1 = s->width - 1;
     }
+    surface_span_unchecked(s, x0, x1, p, mask, color);
 }
 
-/* set the value of a single page */
-void ssd1306_draw_page(uint8_t x, uint8_t p, pixel_t color) {
-    if (x >= DISP_WIDTH || p >= DISP_HEIGHT / 8) {
+/*
+ * set the pixels selected by mask in a horizontal run of one page
+ *
+ * x0:    left-most column
+ * x1:    right-most column
+ * p:     page
+ * mask:  pixels (bits) of each page byte to draw
+ * color: PIXEL_OFF, PIXEL_ON, or PIXEL_TOGGLE
+ */
+void ssd1306_draw_span(ssd1306_t *dev, uint8_t x0, uint8_t x1, uint8_t p,
+        uint8_t mask, pixel_t color) {
+    surface_draw_span(&dev->surface, x0, x1, p, mask, color);
+}
+
+/* ssd1306_draw_columns() on a surface */
+void surface_draw_columns(surface_t *s, uint8_t x, uint8_t p,
+        const uint8_t *masks, uint8_t n, pixel_t color) {
+    if (x >= s->width || p >= (s->height + 7) / 8) {
         return;
     }
+    if (n > s->width - x) {
+        n = s->width - x;
+    }
+
+    /* new = (old & ~(mask & clear)) ^ (mask & set), for every color */
+    uint8_t clear = (color == PIXEL_TOGGLE) ? 0x00 : 0xFF;
+    uint8_t set = (color == PIXEL_OFF) ? 0x00 : 0xFF;
 
-    int n = p * DISP_WIDTH + x;
+    uint8_t *row = &s->buffer[p * s->stride + x];
+    uint8_t first = 0xFF;
+    uint8_t last = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        uint8_t old = row[i];
+        uint8_t new = (old & ~(masks[i] & clear)) ^ (masks[i] & set);
+        if (new != old) {
+            row[i] = new;
+            if (first == 0xFF) {
+                first = i;
+            }
+            last = i;
+        }
+    }
 
-    if (color == PIXEL_OFF) {
-        framebuffer[n] = 0x00;
-    } else if (color == PIXEL_ON) {
-        framebuffer[n] = 0xFF;
-    } else if (color == PIXEL_TOGGLE) {
-        framebuffer[n] ^= 0xFF;
+    if (first != 0xFF) {
+        surface_mark_dirty_column(s, x + first, p);
+        surface_mark_dirty_column(s, x + last, p);
     }
 }
 
-/* write contents of framebuffer to display */
-bool ssd1306_update_display(void) {
-    bool ret = false;
-    uint8_t header[] = {
-        SSD1306_SET_MEM_ADDR_MODE,
-        SSD1306_MEM_ADDR_MODE_HORIZ,
-        SSD1306_SET_COL_ADDR,
-        0, /* start column */
-        127, /* end column */
-        SSD1306_SET_PAGE_ADDR,
-        0, /* start page */
-        7, /* end page */
-    };
-    uint8_t control = CONTROL_BYTE_DATA;
+/*
+ * set the pixels selected by a mask for each of a run of columns of one page
+ *
+ * Columns past the right edge of the display are dropped.
+ *
+ * x:     left-most column
+ * p:     page
+ * masks: pixels (bits) to draw, one byte per column
+ * n:     number of columns
+ * color: PIXEL_OFF, PIXEL_ON, or PIXEL_TOGGLE
+ */
+void ssd1306_draw_columns(ssd1306_t *dev, uint8_t x, uint8_t p,
+        const uint8_t *masks, uint8_t n, pixel_t color) {
+    surface_draw_columns(&dev->surface, x, p, masks, n, color);
+}
 
-    ssd1306_write_command_list(header, sizeof(header));
+/*
+ * framebuffers are 32 bit word aligned, and the width is a multiple of 4, so
+ * every page starts on a word boundary and bulk operations can work a word at
+ * a time
+ */
 
-#ifdef SSD1306_I2C
-    /* need to wait for header transaction to finish before writing the
-     * framebuffer, because the framebuffer transaction sets RELOAD which will
-     * mess up end of header transaction if it hasn't finished */
-    while (i2c_busy(DISP_I2C)); /* TODO: is this still necessary? */
-    ret = i2c_write_with_header(DISP_I2C, DISP_ADDR, &control, sizeof(control),
-            framebuffer, sizeof(framebuffer));
-#elif defined(SSD1306_SPI)
-    ssd1306_spi_write_commands(header, sizeof(header));
-    ssd1306_spi_write_data(framebuffer, sizeof(framebuffer));
-    ret = true; /* SPI can't fail */
-#endif
-    return ret;
+/* words in one page of the framebuffer */
+#define PAGE_WORDS (DISP_WIDTH / 4)
+
+/* words of page p of the framebuffer */
+static inline uint32_t *page_word_ptr(ssd1306_t *dev, uint8_t p) {
+    return (uint32_t *) &dev->surface.buffer[p * DISP_WIDTH];
 }
 
-/* write contents of framebuffer to display, one byte per transaction */
-void ssd1306_update_display_slow(void) {
-    uint8_t header[] = {
-#ifdef SSD1306_I2C
-        CONTROL_BYTE_COMMAND,
-#endif
-        SSD1306_SET_MEM_ADDR_MODE,
-        SSD1306_MEM_ADDR_MODE_HORIZ,
-        SSD1306_SET_COL_ADDR,
-        0, /* start column */
-        127, /* end column */
-        SSD1306_SET_PAGE_ADDR,
-        0, /* start page */
-        7, /* end page */
-    };
+/* mark the columns covered by words w0..w1 of page p as changed */
+static inline void mark_dirty_words(ssd1306_t *dev, uint8_t p, uint8_t w0,
+        uint8_t w1) {
+    if (w0 <= w1) {
+        ssd1306_mark_dirty_column(dev, w0 * 4, p);
+        ssd1306_mark_dirty_column(dev, w1 * 4 + 3, p);
+    }
+}
 
-#ifdef SSD1306_I2C
-    i2c_transfer7(DISP_I2C, DISP_ADDR, header, sizeof(header), 0, 0);
+/* clamp a page range to the display; false if nothing is left */
+static bool clamp_pages(uint8_t p0, uint8_t *p1) {
+    if (p0 > *p1 || p0 >= DISP_PAGES) {
+        return false;
+    }
+    if (*p1 >= DISP_PAGES) {
+        *p1 = DISP_PAGES - 1;
+    }
+    return true;
+}
 
-    uint8_t data[] = {
-        CONTROL_BYTE_DATA,
-        0x00
-    };
+/*
+ * set every byte of a range of pages to a value
+ *
+ * p0:    top-most page
+ * p1:    bottom-most page
+ * value: page byte to write (0x00 to clear, 0xFF to set)
+ */
+void ssd1306_fill_pages(ssd1306_t *dev, uint8_t p0, uint8_t p1,
+        uint8_t value) {
+    uint8_t pattern[4] = { value, value, value, value };
+    ssd1306_fill_pattern(dev, p0, p1, pattern, sizeof(pattern));
+}
 
-    /* TODO: optimize this into 1 I2C transaction for entire buffer */
-    for (size_t i = 0; i < sizeof(framebuffer); i++) {
-        data[1] = framebuffer[i];
-        i2c_transfer7(DISP_I2C, DISP_ADDR, data, sizeof(data), 0, 0);
+/*
+ * invert every pixel of a range of pages
+ *
+ * p0: top-most page
+ * p1: bottom-most page
+ */
+void ssd1306_invert_pages(ssd1306_t *dev, uint8_t p0, uint8_t p1) {
+    if (!clamp_pages(p0, &p1)) {
+        return;
+    }
+
+    uint8_t nwords = PAGE_WORDS;
+    for (uint8_t p = p0; p <= p1; p++) {
+        uint32_t *w = page_word_ptr(dev, p);
+        for (uint8_t i = 0; i < nwords; i++) {
+            w[i] = ~w[i];
+        }
+        mark_dirty_words(dev, p, 0, nwords - 1);
     }
-#elif defined(SSD1306_SPI)
-    ssd1306_spi_write_commands(header, sizeof(header));
-    ssd1306_spi_write_data(framebuffer, sizeof(framebuffer));
-#endif
 }
 
-/* write a single command to display */
-void ssd1306_write_command(uint8_t command) {
-    /* TODO: test */
-#ifdef SSD1306_I2C
-    uint8_t cmd[] = {
-        CONTROL_BYTE_COMMAND,
-        command
-    };
-    i2c_transfer7(DISP_I2C, DISP_ADDR, cmd, sizeof(cmd), 0, 0);
-#elif defined(SSD1306_SPI)
-    ssd1306_spi_write_commands(&command, 1);
-#endif
+/*
+ * fill a range of pages with a repeating horizontal pattern
+ *
+ * p0:      top-most page
+ * p1:      bottom-most page
+ * pattern: page bytes for consecutive columns, repeated across each page
+ *          (the last repeat is cut off at the right edge)
+ * len:     number of bytes in pattern: a multiple of 4, at most 16
+ */
+void ssd1306_fill_pattern(ssd1306_t *dev, uint8_t p0, uint8_t p1,
+        const uint8_t *pattern, uint8_t len) {
+    uint32_t words[4];
+    uint8_t nwords = len / 4;
+    uint8_t row_words = PAGE_WORDS;
+    if (!clamp_pages(p0, &p1) || nwords == 0 || nwords > 4 || len % 4) {
+        return;
+    }
+    memcpy(words, pattern, len);
+
+    for (uint8_t p = p0; p <= p1; p++) {
+        uint32_t *w = page_word_ptr(dev, p);
+        uint8_t first = row_words;
+        uint8_t last = 0;
+        uint8_t k = 0;
+        for (uint8_t i = 0; i < row_words; i++) {
+            if (w[i] != words[k]) {
+                w[i] = words[k];
+                if (first == row_words) {
+                    first = i;
+                }
+                last = i;
+            }
+            if (++k == nwords) {
+                k = 0;
+            }
+        }
+        mark_dirty_words(dev, p, first, last);
+    }
 }
 
-/* write a list of commands to the display */
-void ssd1306_write_command_list(uint8_t *command_list, uint32_t len) {
-    uint8_t control = CONTROL_BYTE_COMMAND;
-#ifdef SSD1306_I2C
-    i2c_write_with_header(DISP_I2C, DISP_ADDR, &control, sizeof(control),
-            command_list, len);
-#elif defined(SSD1306_SPI)
-    ssd1306_spi_write_commands(command_list, len);
-#endif
+/* combine one page of source words into destination words */
+static void blend_page(uint32_t *dst, const uint32_t *src, uint8_t nwords,
+        blend_t op, uint8_t *first, uint8_t *last) {
+    *first = nwords;
+    *last = 0;
+    for (uint8_t i = 0; i < nwords; i++) {
+        uint32_t d = dst[i];
+        if (op == BLEND_OR) {
+            d |= src[i];
+        } else if (op == BLEND_AND) {
+            d &= src[i];
+        } else if (op == BLEND_XOR) {
+            d ^= src[i];
+        } else if (op == BLEND_AND_NOT) {
+            d &= ~src[i];
+        } else {
+            d = src[i];
+        }
+        if (d != dst[i]) {
+            dst[i] = d;
+            if (*first == nwords) {
+                *first = i;
+            }
+            *last = i;
+        }
+    }
 }
 
-#ifdef SSD1306_SPI
-/* set DC (data/command) pin to data mode */
-void ssd1306_set_data(void) {
-    gpio_set(DC_PORT, DC_PIN);
+/*
+ * combine a range of pages onto another range of pages
+ *
+ * Ranges may overlap; the result is as if the source pages were read before
+ * any destination page is written.
+ *
+ * dst: first destination page
+ * src: first source page
+ * n:   number of pages
+ * op:  any blend_t; pages have no mask, so BLEND_MASKED is BLEND_COPY
+ */
+void ssd1306_blend_pages(ssd1306_t *dev, uint8_t dst, uint8_t src, uint8_t n,
+        blend_t op) {
+    if (dst >= DISP_PAGES || src >= DISP_PAGES) {
+        return;
+    }
+    if (n > DISP_PAGES - dst) {
+        n = DISP_PAGES - dst;
+    }
+    if (n > DISP_PAGES - src) {
+        n = DISP_PAGES - src;
+    }
+
+    for (uint8_t k = 0; k < n; k++) {
+        /* moving down: start from the bottom so sources are read first */
+        uint8_t i = (dst > src) ? n - 1 - k : k;
+        uint8_t first, last;
+        blend_page(page_word_ptr(dev, dst + i), page_word_ptr(dev, src + i),
+                PAGE_WORDS, op, &first, &last);
+        mark_dirty_words(dev, dst + i, first, last);
+    }
+}
+
+/*
+ * mark a region of the framebuffer as changed
+ *
+ * x0: left-most column
+ * x1: right-most column
+ * p0: top-most page
+ * p1: bottom-most page
+ */
+void ssd1306_mark_dirty(ssd1306_t *dev, uint8_t x0, uint8_t x1, uint8_t p0,
+        uint8_t p1) {
+    if (x0 >= DISP_WIDTH || p0 >= DISP_PAGES || x0 > x1 || p0 > p1) {
+        return;
+    }
+    if (x1 >= DISP_WIDTH) {
+        x1 = DISP_WIDTH - 1;
+    }
+    if (p1 >= DISP_PAGES) {
+        p1 = DISP_PAGES - 1;
+    }
+
+    for (uint8_t p = p0; p <= p1; p++) {
+        ssd1306_mark_dirty_column(dev, x0, p);
+        ssd1306_mark_dirty_column(dev, x1, p);
+    }
 }
 
-/* set DC (data/command) pin to command mode */
-void ssd1306_set_command(void) {
-    gpio_clear(DC_PORT, DC_PIN);
+/* enable or disable full refresh mode */
+void ssd1306_set_full_refresh(ssd1306_t *dev, bool full) {
+    dev->full_refresh = full;
 }
 
-/* assert reset pin */
-void ssd1306_assert_reset(void) {
-    gpio_clear(RESET_PORT, RESET_PIN);
+/* get framebuffer flush statistics */
+const ssd1306_flush_stats_t *ssd1306_get_flush_stats(const ssd1306_t *dev) {
+    return &dev->flush_stats;
 }
 
-/* deassert reset pin */
-void ssd1306_deassert_reset(void) {
-    gpio_set(RESET_PORT, RESET_PIN);
+/* number of framebuffer bytes covered by a window */
+static uint32_t window_bytes(const ssd1306_window_t *w) {
+    return (uint32_t) (w->x1 - w->x0 + 1) * (w->p1 - w->p0 + 1);
 }
 
 /*
- * write a command buffer via SPI (blocking)
+ * split the dirty pages into address windows
+ *
+ * Walks the pages top to bottom, growing the current window to cover the next
+ * dirty page whenever resending the extra (clean) bytes is cheaper than the
+ * overhead of starting another window.
  *
- * handles asserting/deasserting CS and setting DC appropriately (DC cleared)
+ * w: array of at least DISP_PAGES windows
+ *
+ * Returns the number of windows
+ */
+static uint8_t plan_flush_windows(const ssd1306_t *dev, ssd1306_window_t *w) {
+    const uint8_t *dirty_x0 = dev->dirty_x0;
+    const uint8_t *dirty_x1 = dev->dirty_x1;
+    uint8_t n = 0;
+
+    if (!dev->surface.buffer) {
+        return 0; /* no framebuffer to send */
+    }
+    if (dev->full_refresh) {
+        w[0].x0 = 0;
+        w[0].x1 = DISP_WIDTH - 1;
+        w[0].p0 = 0;
+        w[0].p1 = DISP_PAGES - 1;
+        return 1;
+    }
+
+    for (uint8_t p = 0; p < DISP_PAGES; p++) {
+        if (dirty_x0[p] > dirty_x1[p]) {
+            continue;
+        }
+
+        if (n > 0) {
+            ssd1306_window_t *c = &w[n - 1];
+            uint8_t x0 = dirty_x0[p] < c->x0 ? dirty_x0[p] : c->x0;
+            uint8_t x1 = dirty_x1[p] > c->x1 ? dirty_x1[p] : c->x1;
+            uint32_t merged = (uint32_t) (x1 - x0 + 1) * (p - c->p0 + 1);
+            uint32_t separate = window_bytes(c)
+                + (dirty_x1[p] - dirty_x0[p] + 1)
+                + dev->config.transport->window_overhead;
+            if (merged <= separate) {
+                c->x0 = x0;
+                c->x1 = x1;
+                c->p1 = p;
+                continue;
+            }
+        }
+
+        w[n].x0 = dirty_x0[p];
+        w[n].x1 = dirty_x1[p];
+        w[n].p0 = p;
+        w[n].p1 = p;
+        n++;
+    }
+
+    return n;
+}
+
+/* fill in the 6 address commands that select a window of display RAM */
+static void window_header(uint8_t *header, const ssd1306_window_t *win) {
+    header[0] = SSD1306_SET_COL_ADDR;
+    header[1] = win->x0 + DISP_COL_OFFSET; /* start column */
+    header[2] = win->x1 + DISP_COL_OFFSET; /* end column */
+    header[3] = SSD1306_SET_PAGE_ADDR;
+    header[4] = win->p0; /* start page */
+    header[5] = win->p1; /* end page */
+}
+
+/* first byte of a window in the front buffer, or in the page being sent */
+static uint8_t *window_data(ssd1306_t *dev, const ssd1306_window_t *win) {
+    if (dev->page_data) {
+        return &dev->page_data[win->x0];
+    }
+    return &dev->frontbuffer[win->p0 * DISP_WIDTH + win->x0];
+}
+
+/* write one window of the framebuffer to display RAM, within a transfer */
+static bool write_window(ssd1306_t *dev, const ssd1306_window_t *win) {
+    const ssd1306_transport_t *t = dev->config.transport;
+    uint8_t header[6];
+    window_header(header, win);
+
+    bool ret = t->write_commands(dev, header, sizeof(header));
+    return t->write_data(dev, window_data(dev, win), win->x1 - win->x0 + 1,
+            win->p1 - win->p0 + 1, DISP_WIDTH) && ret;
+}
+
+#ifdef SSD1306_DOUBLE_BUFFER
+/*
+ * make the drawn frame the front buffer
  *
- * w: pointer to buffer of commands
- * wn: number of commands (number of bytes in buffer)
+ * The new back buffer holds the previous frame; the windows that changed are
+ * copied over so that drawing continues from the frame just presented.
  */
-void ssd1306_spi_write_commands(uint8_t *w, size_t wn) {
-    gpio_clear(CS_PORT, CS_PIN);
-    ssd1306_set_command();
-    spi_write_buffer8(DISP_SPI, w, wn);
-    while (SPI_SR(DISP_SPI) & SPI_SR_BSY); /* wait for end before releasing CS */
-    gpio_set(CS_PORT, CS_PIN);
+static void swap_buffers(ssd1306_t *dev, const ssd1306_window_t *w,
+        uint8_t nwindows) {
+    uint8_t *t = dev->frontbuffer;
+    dev->frontbuffer = dev->surface.buffer;
+    dev->surface.buffer = t;
+
+    for (uint8_t i = 0; i < nwindows; i++) {
+        size_t len = w[i].x1 - w[i].x0 + 1;
+        for (uint8_t p = w[i].p0; p <= w[i].p1; p++) {
+            size_t n = p * DISP_WIDTH + w[i].x0;
+            memcpy(&dev->surface.buffer[n], &dev->frontbuffer[n], len);
+        }
+    }
 }
+#endif /* SSD1306_DOUBLE_BUFFER */
 
 /*
- * write a data buffer via SPI (blocking)
+ * plan the windows for a flush, mark the framebuffer clean, and update the
+ * flush statistics. When double buffered, also swap buffers.
+ *
+ * Must not be called while a flush of this display is queued or in progress.
  *
- * handles asserting/deasserting CS and setting DC appropriately (DC set)
+ * w: array of at least DISP_PAGES windows
  *
- * w: pointer to buffer of commands
- * wn: number of commands (number of bytes in buffer)
+ * Returns the number of windows
  */
-void ssd1306_spi_write_data(uint8_t *w, size_t wn) {
-    gpio_clear(CS_PORT, CS_PIN);
-    ssd1306_set_data();
-    spi_write_buffer8(DISP_SPI, w, wn);
-    while (SPI_SR(DISP_SPI) & SPI_SR_BSY); /* wait for end before releasing CS */
-    gpio_set(CS_PORT, CS_PIN);
-}
-#endif /* SSD1306_SPI */
+static uint8_t begin_flush(ssd1306_t *dev, ssd1306_window_t *w) {
+    uint8_t nwindows = plan_flush_windows(dev, w);
+    uint32_t sent = 0;
+
+    dev->page_data = NULL;
+    for (uint8_t i = 0; i < nwindows; i++) {
+        sent += window_bytes(&w[i]);
+    }
+    clear_dirty(dev);
+#ifdef SSD1306_DOUBLE_BUFFER
+    swap_buffers(dev, w, nwindows);
+#endif
+
+    dev->flush_stats.flushes++;
+    dev->flush_stats.bytes_sent += sent;
+    dev->flush_stats.bytes_saved_last = FRAMEBUFFER_SIZE - sent;
+    dev->flush_stats.bytes_saved_total += dev->flush_stats.bytes_saved_last;
+
+    return nwindows;
+}
+
+/*
+ * write a list of windows in one transfer, marking any that fail dirty again
+ * for a retry
+ */
+static bool write_windows(ssd1306_t *dev, const ssd1306_window_t *w,
+        uint8_t nwindows) {
+    const ssd1306_transport_t *t = dev->config.transport;
+    bool ret = true;
+    if (nwindows == 0) {
+        return true;
+    }
+
+    t->begin(dev);
+    for (uint8_t i = 0; i < nwindows; i++) {
+        if (!write_window(dev, &w[i])) {
+            ssd1306_mark_dirty(dev, w[i].x0, w[i].x1, w[i].p0, w[i].p1);
+            ret = false;
+        }
+    }
+    return t->end(dev) && ret;
+}
+
+/* write changed regions of framebuffer to display */
+bool ssd1306_update_display(ssd1306_t *dev) {
+    ssd1306_window_t windows[DISP_PAGES];
+
+    while (ssd1306_flush_busy(dev));
+    wait_bus_idle(dev);
+
+    PROF_BEGIN(flush);
+    uint8_t nwindows = begin_flush(dev, windows);
+    bool ret = write_windows(dev, windows, nwindows);
+    PROF_END(flush);
+    return ret;
+}
+
+/* start the next queued flush on a bus, if any */
+static void flush_queue_next(ssd1306_bus_t *bus) {
+    ssd1306_t *dev = bus->head;
+    if (!dev) {
+        return;
+    }
+    bus->head = dev->next;
+    if (!bus->head) {
+        bus->tail = NULL;
+    }
+    dev->next = NULL;
+    flush_async_start(dev);
+}
+
+/*
+ * finish a display's asynchronous flush, hand the bus to the next queued
+ * display, and notify the caller
+ */
+static void end_flush_async(ssd1306_t *dev, bool success) {
+    ssd1306_bus_t *bus = dev->config.transport->bus;
+    ssd1306_flush_callback_t callback = dev->callback;
+
+    bus->current = NULL;
+    dev->busy = false;
+    flush_queue_next(bus);
+
+    if (callback) {
+        callback(dev, success);
+    }
+}
+
+static void flush_async_next(ssd1306_t *dev, bool success);
+
+/* start sending the address commands for the current async flush window */
+static void flush_async_window(ssd1306_t *dev) {
+    window_header(dev->header, &dev->windows[dev->window]);
+    dev->in_data = false;
+    if (!dev->config.transport->write_commands_async(dev, dev->header,
+                sizeof(dev->header), flush_async_next)) {
+        flush_async_next(dev, false);
+    }
+}
+
+/*
+ * advance the async flush by one write (called from interrupt context)
+ *
+ * Each window is sent as its address commands, then its data, all in one
+ * transfer.
+ */
+static void flush_async_next(ssd1306_t *dev, bool success) {
+    const ssd1306_transport_t *t = dev->config.transport;
+    ssd1306_window_t *win = &dev->windows[dev->window];
+
+    if (!success) {
+        /* resend this and all following windows on the next flush */
+        for (uint8_t i = dev->window; i < dev->nwindows && !dev->page_data;
+                i++) {
+            win = &dev->windows[i];
+            ssd1306_mark_dirty(dev, win->x0, win->x1, win->p0, win->p1);
+        }
+        t->end(dev);
+        end_flush_async(dev, false);
+        return;
+    }
+
+    if (!dev->in_data) {
+        dev->in_data = true;
+        if (!t->write_data_async(dev, window_data(dev, win),
+                    win->x1 - win->x0 + 1, win->p1 - win->p0 + 1, DISP_WIDTH,
+                    flush_async_next)) {
+            flush_async_next(dev, false);
+        }
+        return;
+    }
+
+    if (++dev->window < dev->nwindows) {
+        flush_async_window(dev);
+        return;
+    }
+
+    end_flush_async(dev, t->end(dev));
+}
+
+/* take the bus and start sending a display's planned windows */
+static void flush_async_start(ssd1306_t *dev) {
+    dev->config.transport->bus->current = dev;
+    dev->window = 0;
+
+    if (dev->nwindows == 0) {
+        end_flush_async(dev, true);
+        return;
+    }
+
+    dev->config.transport->begin(dev);
+    flush_async_window(dev);
+}
+
+/* send a display's planned windows now, or queue them if the bus is busy */
+static void flush_async_submit(ssd1306_t *dev) {
+    ssd1306_bus_t *bus = dev->config.transport->bus;
+
+    /*
+     * the interrupt handler that ends a flush also changes the queue, and its
+     * callback may submit another flush: an idle bus is claimed before
+     * interrupts are unmasked
+     */
+    bool idle = false;
+    uint32_t masked = cm_mask_interrupts(1);
+    if (bus->current) {
+        if (bus->tail) {
+            bus->tail->next = dev;
+        } else {
+            bus->head = dev;
+        }
+        bus->tail = dev;
+    } else {
+        bus->current = dev;
+        idle = true;
+    }
+    cm_mask_interrupts(masked);
+
+    if (idle) {
+        flush_async_start(dev);
+    }
+}
+
+/* start writing changed regions of framebuffer to display, and return */
+bool ssd1306_update_display_async(ssd1306_t *dev,
+        ssd1306_flush_callback_t callback) {
+    if (dev->busy) {
+        return false;
+    }
+
+    dev->busy = true;
+    dev->callback = callback;
+    dev->nwindows = begin_flush(dev, dev->windows);
+    flush_async_submit(dev);
+    return true;
+}
+
+/* start writing one page of display RAM from memory, and return */
+bool ssd1306_write_page_async(ssd1306_t *dev, uint8_t p, uint8_t *data,
+        ssd1306_flush_callback_t callback) {
+    if (dev->busy || p >= DISP_PAGES) {
+        return false;
+    }
+
+    dev->busy = true;
+    dev->callback = callback;
+    dev->windows[0] = (ssd1306_window_t) { 0, DISP_WIDTH - 1, p, p };
+    dev->nwindows = 1;
+    dev->page_data = data;
+    flush_async_submit(dev);
+    return true;
+}
+
+/* return true while an asynchronous flush is queued or in progress */
+bool ssd1306_flush_busy(const ssd1306_t *dev) {
+    dev->config.transport->poll(dev);
+    return dev->busy;
+}
+
+/* finish the current frame and start sending it to the display */
+bool ssd1306_present(ssd1306_t *dev, ssd1306_flush_callback_t callback) {
+    while (ssd1306_flush_busy(dev));
+    return ssd1306_update_display_async(dev, callback);
+}
+
+/* write contents of framebuffer to display, one data byte per write */
+void ssd1306_update_display_slow(ssd1306_t *dev) {
+    const ssd1306_transport_t *t = dev->config.transport;
+    uint8_t header[] = {
+        SSD1306_SET_MEM_ADDR_MODE,
+        SSD1306_MEM_ADDR_MODE_HORIZ,
+        SSD1306_SET_COL_ADDR,
+        DISP_COL_OFFSET, /* start column */
+        DISP_COL_OFFSET + DISP_WIDTH - 1, /* end column */
+        SSD1306_SET_PAGE_ADDR,
+        0, /* start page */
+        DISP_PAGES - 1, /* end page */
+    };
+
+    ssd1306_window_t windows[DISP_PAGES];
+    bool full = dev->full_refresh;
+
+    if (!dev->surface.buffer) {
+        return;
+    }
+    while (ssd1306_flush_busy(dev));
+    wait_bus_idle(dev);
+
+    /* the whole frame, planned as a full refresh so that buffers swap */
+    dev->full_refresh = true;
+    begin_flush(dev, windows);
+    dev->full_refresh = full;
+
+    t->begin(dev);
+    t->write_commands(dev, header, sizeof(header));
+    for (size_t i = 0; i < FRAMEBUFFER_SIZE; i++) {
+        t->write_data(dev, &dev->frontbuffer[i], 1, 1, 1);
+    }
+    t->end(dev);
+}
+
+/* write a single command to display */
+void ssd1306_write_command(ssd1306_t *dev, uint8_t command) {
+    ssd1306_write_command_list(dev, &command, 1);
+}
+
+/* write a list of commands to the display */
+void ssd1306_write_command_list(ssd1306_t *dev, uint8_t *command_list,
+        uint32_t len) {
+    const ssd1306_transport_t *t = dev->config.transport;
+    wait_bus_idle(dev);
+    t->begin(dev);
+    t->write_commands(dev, command_list, len);
+    t->end(dev);
+}
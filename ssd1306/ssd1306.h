@@ -4,23 +4,95 @@
 /*
  * Driver for SSD1306 OLED display (I2C/SPI)
  *
- * I2C interface enabled by defining SSD1306_I2C in makefile
- * SPI interface enabled by defining SSD1306_SPI in makefile
- * interfaces are mutually exclusive
+ * Each display is reached through the transport in its config
+ * (ssd1306_transport.h): I2C, SPI, or a mock for host builds. Displays on
+ * different buses can be driven side by side. Defining SSD1306_I2C or
+ * SSD1306_SPI in makefile selects the transport of configs that give none.
+ *
+ * Each display is an ssd1306_t, set up by ssd1306_init() from an
+ * ssd1306_config_t (bus, address or pins, framebuffer memory), and passed to
+ * every drawing and flush call. Several displays can share a bus:
+ * asynchronous flushes to displays on the same bus are queued and sent back
+ * to back, while other buses run independently.
+ *
+ * Panel geometry selected by defining one of SSD1306_128X32, SSD1306_72X40 or
+ * SSD1306_64X48 in makefile (default 128x64). All displays of a build share
+ * it. It sets the framebuffer size, the init sequence and the flush address
+ * windows, and is constant throughout, so smaller panels cost proportionally
+ * less RAM and bus time.
+ *
+ * Double buffering enabled by defining SSD1306_DOUBLE_BUFFER in makefile. This
+ * costs a second framebuffer per display (width * height / 8 bytes of RAM)
+ * but lets drawing continue while the previous frame is being sent.
+ *
+ * A flush is one transfer of address windows: the column/page address
+ * commands, then the window's data. Over SPI, the whole flush is one CS
+ * assertion, with DC switched between commands and data. Over I2C, each
+ * window is a command transaction and a data transaction; defining
+ * SSD1306_I2C_SINGLE_TRANSACTION sends it as one transaction instead, each
+ * command behind a control byte with the continuation bit set. That holds the
+ * bus for the whole window, and saves a START, address byte and STOP, but
+ * costs 6 more bytes per window.
+ *
+ * A display can also be set up without a framebuffer, and drawn a page at a
+ * time from a display list (ssd1306_display_list.h) with
+ * ssd1306_write_page_async().
  *
  * TODO: implement the following controller features:
  * - scrolling
  */
 
-#ifdef SSD1306_I2C
-#define DISP_I2C I2C1
-#define DISP_ADDR 0x3C
-#elif defined(SSD1306_SPI)
-#define DISP_SPI SPI1
-#endif
+/* I2C addresses, selected by the SA0 pin (D/C# pin on most modules) */
+#define SSD1306_ADDR_PRIMARY 0x3C
+#define SSD1306_ADDR_SECONDARY 0x3D
 
+/* size of the controller's display RAM */
+#define SSD1306_RAM_WIDTH 128
+#define SSD1306_RAM_PAGES 8
+
+/*
+ * panel geometry
+ *
+ * DISP_COL_OFFSET: display RAM column shown in the left-most panel column
+ * DISP_COM_PINS:   COM pins hardware configuration (SSD1306_COM_PINS_*)
+ */
+#if defined(SSD1306_128X32)
+#define DISP_WIDTH 128
+#define DISP_HEIGHT 32
+#define DISP_COL_OFFSET 0
+#define DISP_COM_PINS SSD1306_COM_PINS_SEQUENTIAL
+#elif defined(SSD1306_72X40)
+#define DISP_WIDTH 72
+#define DISP_HEIGHT 40
+#define DISP_COL_OFFSET 28
+#define DISP_COM_PINS SSD1306_COM_PINS_ALTERNATIVE
+#elif defined(SSD1306_64X48)
+#define DISP_WIDTH 64
+#define DISP_HEIGHT 48
+#define DISP_COL_OFFSET 32
+#define DISP_COM_PINS SSD1306_COM_PINS_ALTERNATIVE
+#else
 #define DISP_WIDTH 128
 #define DISP_HEIGHT 64
+#define DISP_COL_OFFSET 0
+#define DISP_COM_PINS SSD1306_COM_PINS_ALTERNATIVE
+#endif
+#define DISP_PAGES (DISP_HEIGHT / 8)
+
+#if DISP_WIDTH % 4 || DISP_HEIGHT % 8 \
+        || DISP_COL_OFFSET + DISP_WIDTH > SSD1306_RAM_WIDTH \
+        || DISP_PAGES > SSD1306_RAM_PAGES
+#error "panel geometry does not fit the display RAM"
+#endif
+
+#ifdef SSD1306_DOUBLE_BUFFER
+#define SSD1306_BUFFERS 2
+#else
+#define SSD1306_BUFFERS 1
+#endif
+
+/* number of 32 bit words of framebuffer memory needed for a display */
+#define SSD1306_BUFFER_WORDS (DISP_WIDTH * DISP_HEIGHT / 32 * SSD1306_BUFFERS)
 
 /* Pixel values (colors): black, white, or toggle current value */
 typedef enum {
@@ -29,53 +101,492 @@ typedef enum {
     PIXEL_TOGGLE
 } pixel_t;
 
+/* ways of combining source pixels with destination pixels (raster ops) */
+typedef enum {
+    BLEND_COPY,    /* dst = src */
+    BLEND_OR,      /* dst |= src */
+    BLEND_AND,     /* dst &= src */
+    BLEND_XOR,     /* dst ^= src */
+    BLEND_AND_NOT, /* dst &= ~src */
+    BLEND_MASKED   /* dst = src where the source's mask is set */
+} blend_t;
+
+/* framebuffer flush statistics (framebuffer bytes only, not commands) */
+typedef struct {
+    uint32_t flushes;           /* number of calls to ssd1306_update_display */
+    uint32_t bytes_sent;        /* total framebuffer bytes sent */
+    uint32_t bytes_saved_last;  /* bytes not sent by the last flush */
+    uint32_t bytes_saved_total; /* bytes not sent, summed over all flushes */
+} ssd1306_flush_stats_t;
+
+typedef struct ssd1306 ssd1306_t;
+
+/* bus access functions, see ssd1306_transport.h */
+typedef struct ssd1306_transport ssd1306_transport_t;
+
+/*
+ * called when an asynchronous flush finishes (from interrupt context)
+ *
+ * dev:     display that was flushed
+ * success: true if all data was written to the display
+ */
+typedef void (*ssd1306_flush_callback_t)(ssd1306_t *dev, bool success);
+
+/*
+ * how a display is connected, and the memory for its framebuffer
+ *
+ * Only the fields of the display's transport are used.
+ */
+typedef struct {
+    /* bus, or NULL for the one selected by SSD1306_I2C or SSD1306_SPI */
+    const ssd1306_transport_t *transport;
+
+    /* I2C */
+    uint32_t i2c; /* I2C peripheral, e.g. I2C1 */
+    uint8_t addr; /* 7 bit address */
+
+    /* SPI */
+    uint32_t spi; /* SPI peripheral, e.g. SPI1 */
+    uint32_t cs_port;
+    uint16_t cs_pin;
+    uint32_t dc_port;
+    uint16_t dc_pin;
+    uint32_t reset_port;
+    uint16_t reset_pin;
+
+    uint32_t *buffer; /* SSD1306_BUFFER_WORDS words, or NULL for none */
+} ssd1306_config_t;
+
+/* rectangular area of display RAM, written by one address window + data */
+typedef struct {
+    uint8_t x0;
+    uint8_t x1;
+    uint8_t p0;
+    uint8_t p1;
+} ssd1306_window_t;
+
+/* rectangle of pixels, corners inclusive (empty if x0 > x1 or y0 > y1) */
+typedef struct {
+    uint8_t x0;
+    uint8_t y0;
+    uint8_t x1;
+    uint8_t y1;
+} ssd1306_rect_t;
+
+/* widest surface */
+#define SURFACE_MAX_WIDTH SSD1306_RAM_WIDTH
+
+/* bytes of memory for a surface of w x h pixels */
+#define SURFACE_BYTES(w, h) ((w) * (((h) + 7) / 8))
+
+/*
+ * memory that the graphics functions draw into, in page format: a display's
+ * framebuffer, or an off-screen canvas (see surface_init())
+ *
+ * The graphics viewport and clip rectangle (see ssd1306_graphics.h) are in
+ * surface coordinates. The viewport's top left corner is the origin of the
+ * graphics functions' coordinates; clip is the part of the viewport that may
+ * be drawn to, already trimmed to the surface.
+ */
+typedef struct {
+    uint8_t *buffer; /* page p starts at buffer + p * stride */
+    uint8_t width; /* SURFACE_MAX_WIDTH at most */
+    uint8_t height;
+    uint8_t stride; /* bytes from one page to the next, at least width */
+    ssd1306_t *dev; /* display whose framebuffer this is, or NULL */
+    ssd1306_rect_t viewport;
+    ssd1306_rect_t clip;
+} surface_t;
+
+/*
+ * state of one display
+ *
+ * Set up by ssd1306_init(); the fields are private to the driver.
+ */
+struct ssd1306 {
+    ssd1306_config_t config;
+
+    /*
+     * surface.buffer (the framebuffer) is drawn to; frontbuffer holds the
+     * frame being sent, and is frozen while a flush is in progress. They are
+     * the same buffer unless double buffered.
+     */
+    surface_t surface;
+    uint8_t *frontbuffer;
+
+    /* changed columns of each page since the last flush (clean if x0 > x1) */
+    uint8_t dirty_x0[DISP_PAGES];
+    uint8_t dirty_x1[DISP_PAGES];
+    bool full_refresh;
+    ssd1306_flush_stats_t flush_stats;
+
+    /* asynchronous flush */
+    volatile bool busy; /* flush queued or in progress */
+    ssd1306_flush_callback_t callback;
+    ssd1306_window_t windows[DISP_PAGES];
+    uint8_t nwindows;
+    uint8_t window; /* index of window being sent */
+    bool in_data; /* current window's data is being sent */
+    uint8_t header[6]; /* address commands for current window */
+    uint8_t *page_data; /* page sent by ssd1306_write_page_async(), or NULL */
+    ssd1306_t *next; /* next display waiting for the bus */
+};
+
+/* mark a single column of a page as changed */
+static inline void ssd1306_mark_dirty_column(ssd1306_t *dev, uint8_t x,
+        uint8_t p) {
+    if (x < dev->dirty_x0[p]) {
+        dev->dirty_x0[p] = x;
+    }
+    if (x > dev->dirty_x1[p]) {
+        dev->dirty_x1[p] = x;
+    }
+}
 
-/* initialize display and turn it on */
-void ssd1306_init(void);
+/*
+ * set up a display, initialize it and turn it on
+ *
+ * The bus peripheral (i2c_setup()/spi_setup()) must already be set up. For
+ * SPI, the clocks of the CS/DC/RESET GPIO ports must be enabled.
+ *
+ * dev:    display state to set up
+ * config: connection and framebuffer memory; copied. Without a framebuffer,
+ *         the display's surface is empty and flushes send nothing: it is
+ *         written with ssd1306_write_page_async() only.
+ */
+void ssd1306_init(ssd1306_t *dev, const ssd1306_config_t *config);
+
+/* surface that draws into a display's framebuffer */
+static inline surface_t *ssd1306_surface(ssd1306_t *dev) {
+    return &dev->surface;
+}
+
+/*
+ * set up an off-screen canvas
+ *
+ * The canvas is cleared; its viewport and clip rectangle are the whole
+ * canvas. Canvases are drawn to with the graphics functions, and copied to
+ * other surfaces with blit_surface().
+ *
+ * buffer: SURFACE_BYTES(width, height) bytes, or more for a larger stride
+ * width:  SURFACE_MAX_WIDTH at most
+ * stride: bytes from one page to the next (width, or more)
+ */
+void surface_init(surface_t *s, uint8_t *buffer, uint8_t width,
+        uint8_t height, uint8_t stride);
 
 /* set the value of a single pixel */
-void ssd1306_draw_pixel(uint8_t x, uint8_t y, pixel_t value);
+void ssd1306_draw_pixel(ssd1306_t *dev, uint8_t x, uint8_t y, pixel_t value);
+
+/* set the value of a single pixel of a surface */
+void surface_draw_pixel(surface_t *s, uint8_t x, uint8_t y, pixel_t value);
+
+/*
+ * Unchecked writers
+ *
+ * Inline writers for drawing code that has already clipped its coordinates
+ * to the surface: there are no bounds checks. The pixel writers come in one
+ * version per color, so a primitive can pick one once per call instead of
+ * branching on the color for every pixel; the span writers turn the color
+ * into a pair of masks once per span. All of them mark what they change if
+ * the surface is a display's framebuffer.
+ */
+
+/* mark a single column of a page of a surface as changed */
+static inline void surface_mark_dirty_column(surface_t *s, uint8_t x,
+        uint8_t p) {
+    if (s->dev) {
+        ssd1306_mark_dirty_column(s->dev, x, p);
+    }
+}
+
+static inline void surface_pixel_on(surface_t *s, uint8_t x, uint8_t y) {
+    uint8_t *b = &s->buffer[(y / 8) * s->stride + x];
+    uint8_t bit = 0x1 << (y % 8);
+    if (!(*b & bit)) {
+        *b |= bit;
+        surface_mark_dirty_column(s, x, y / 8);
+    }
+}
+
+static inline void surface_pixel_off(surface_t *s, uint8_t x, uint8_t y) {
+    uint8_t *b = &s->buffer[(y / 8) * s->stride + x];
+    uint8_t bit = 0x1 << (y % 8);
+    if (*b & bit) {
+        *b &= ~bit;
+        surface_mark_dirty_column(s, x, y / 8);
+    }
+}
+
+static inline void surface_pixel_toggle(surface_t *s, uint8_t x,
+        uint8_t y) {
+    s->buffer[(y / 8) * s->stride + x] ^= 0x1 << (y % 8);
+    surface_mark_dirty_column(s, x, y / 8);
+}
+
+/* set the value of a single pixel, branching on the color */
+static inline void surface_draw_pixel_unchecked(surface_t *s, uint8_t x,
+        uint8_t y, pixel_t color) {
+    if (color == PIXEL_OFF) {
+        surface_pixel_off(s, x, y);
+    } else if (color == PIXEL_ON) {
+        surface_pixel_on(s, x, y);
+    } else {
+        surface_pixel_toggle(s, x, y);
+    }
+}
+
+/*
+ * set the pixels selected by mask in columns x0..x1 of page p
+ *
+ * Each byte becomes (old & keep) ^ flip, which covers all three colors.
+ */
+static inline void surface_span_unchecked(surface_t *s, uint8_t x0,
+        uint8_t x1, uint8_t p, uint8_t mask, pixel_t color) {
+    uint8_t keep = (color == PIXEL_TOGGLE) ? 0xFF : (uint8_t) ~mask;
+    uint8_t flip = (color == PIXEL_OFF) ? 0x00 : mask;
+
+    uint8_t *row = &s->buffer[p * s->stride];
+    uint8_t first = 0xFF;
+    uint8_t last = 0;
+    for (uint8_t x = x0; x <= x1; x++) {
+        uint8_t old = row[x];
+        uint8_t new = (old & keep) ^ flip;
+        if (new != old) {
+            row[x] = new;
+            if (first == 0xFF) {
+                first = x;
+            }
+            last = x;
+        }
+    }
+
+    if (first != 0xFF) {
+        surface_mark_dirty_column(s, first, p);
+        surface_mark_dirty_column(s, last, p);
+    }
+}
+
+/* set pixels x0..x1 of row y (x0 <= x1) */
+static inline void surface_hspan_unchecked(surface_t *s, uint8_t x0,
+        uint8_t x1, uint8_t y, pixel_t color) {
+    surface_span_unchecked(s, x0, x1, y / 8, 0x1 << (y % 8), color);
+}
+
+/* set pixels y0..y1 of column x (y0 <= y1), one page byte at a time */
+static inline void surface_vspan_unchecked(surface_t *s, uint8_t x,
+        uint8_t y0, uint8_t y1, pixel_t color) {
+    uint8_t clear = (color == PIXEL_TOGGLE) ? 0x00 : 0xFF;
+    uint8_t set = (color == PIXEL_OFF) ? 0x00 : 0xFF;
+
+    uint8_t p1 = y1 / 8;
+    uint8_t mask = 0xFF << (y0 % 8);
+    for (uint8_t p = y0 / 8; p <= p1; p++) {
+        if (p == p1) {
+            mask &= 0xFF >> (7 - y1 % 8);
+        }
+        uint8_t *b = &s->buffer[p * s->stride + x];
+        uint8_t old = *b;
+        *b = (old & ~(mask & clear)) ^ (mask & set);
+        if (*b != old) {
+            surface_mark_dirty_column(s, x, p);
+        }
+        mask = 0xFF;
+    }
+}
 
 /* set the value of a single page */
-void ssd1306_draw_page(uint8_t x, uint8_t p, pixel_t color);
+void ssd1306_draw_page(ssd1306_t *dev, uint8_t x, uint8_t p, pixel_t color);
 
-/* write contents of framebuffer to display */
-bool ssd1306_update_display(void);
+/*
+ * set the pixels selected by mask in a horizontal run of one page
+ *
+ * Writes whole page bytes, so this is much faster than drawing the same
+ * pixels one at a time.
+ *
+ * x0:    left-most column
+ * x1:    right-most column
+ * p:     page
+ * mask:  pixels (bits) of each page byte to draw
+ * color: PIXEL_OFF, PIXEL_ON, or PIXEL_TOGGLE
+ */
+void ssd1306_draw_span(ssd1306_t *dev, uint8_t x0, uint8_t x1, uint8_t p,
+        uint8_t mask, pixel_t color);
 
-/* write contents of framebuffer to display, one byte per I2C transaction */
-void ssd1306_update_display_slow(void);
+/* ssd1306_draw_span() on a surface */
+void surface_draw_span(surface_t *s, uint8_t x0, uint8_t x1, uint8_t p,
+        uint8_t mask, pixel_t color);
 
-/* write a single command to display */
-void ssd1306_write_command(uint8_t command);
+/*
+ * set the pixels selected by a mask for each of a run of columns of one page
+ *
+ * Columns past the right edge of the display are dropped.
+ *
+ * x:     left-most column
+ * p:     page
+ * masks: pixels (bits) to draw, one byte per column
+ * n:     number of columns
+ * color: PIXEL_OFF, PIXEL_ON, or PIXEL_TOGGLE
+ */
+void ssd1306_draw_columns(ssd1306_t *dev, uint8_t x, uint8_t p,
+        const uint8_t *masks, uint8_t n, pixel_t color);
 
-/* write a list of commands to the display */
-void ssd1306_write_command_list(uint8_t *command_list, uint32_t len);
+/* ssd1306_draw_columns() on a surface */
+void surface_draw_columns(surface_t *s, uint8_t x, uint8_t p,
+        const uint8_t *masks, uint8_t n, pixel_t color);
 
-#ifdef SSD1306_SPI
-/* set DC (data/command) pin to data mode */
-void ssd1306_set_data(void);
+/*
+ * Bulk framebuffer operations
+ *
+ * These work on whole pages a 32 bit word at a time, and only mark the words
+ * they actually change as dirty.
+ */
 
-/* set DC (data/command) pin to command mode */
-void ssd1306_set_command(void);
+/*
+ * set every byte of a range of pages to a value
+ *
+ * p0:    top-most page
+ * p1:    bottom-most page
+ * value: page byte to write (0x00 to clear, 0xFF to set)
+ */
+void ssd1306_fill_pages(ssd1306_t *dev, uint8_t p0, uint8_t p1,
+        uint8_t value);
 
-/* deassert reset pin */
-void ssd1306_deassert_reset(void);
+/*
+ * invert every pixel of a range of pages
+ *
+ * p0: top-most page
+ * p1: bottom-most page
+ */
+void ssd1306_invert_pages(ssd1306_t *dev, uint8_t p0, uint8_t p1);
+
+/*
+ * fill a range of pages with a repeating horizontal pattern
+ *
+ * An 8 byte pattern is an 8x8 pixel tile, repeated across and down.
+ *
+ * p0:      top-most page
+ * p1:      bottom-most page
+ * pattern: page bytes for consecutive columns, repeated across each page
+ *          (the last repeat is cut off at the right edge)
+ * len:     number of bytes in pattern: a multiple of 4, at most 16
+ */
+void ssd1306_fill_pattern(ssd1306_t *dev, uint8_t p0, uint8_t p1,
+        const uint8_t *pattern, uint8_t len);
 
-/* assert reset pin */
-void ssd1306_assert_reset(void);
+/*
+ * combine a range of pages onto another range of pages
+ *
+ * Ranges may overlap; the result is as if the source pages were read before
+ * any destination page is written.
+ *
+ * dst: first destination page
+ * src: first source page
+ * n:   number of pages
+ * op:  any blend_t; pages have no mask, so BLEND_MASKED is BLEND_COPY
+ */
+void ssd1306_blend_pages(ssd1306_t *dev, uint8_t dst, uint8_t src, uint8_t n,
+        blend_t op);
 
 /*
- * write a command buffer via SPI
+ * mark a region of the framebuffer as changed
  *
- * handles asserting/deasserting CS and setting DC appropriately
+ * Drawing through the functions above marks changes automatically; this is
+ * for code that modifies the framebuffer directly.
  *
- * w: pointer to buffer of commands
- * wn: number of commands (number of bytes in buffer)
+ * x0: left-most column
+ * x1: right-most column
+ * p0: top-most page
+ * p1: bottom-most page
  */
-void ssd1306_spi_write_commands(uint8_t *w, size_t wn);
+void ssd1306_mark_dirty(ssd1306_t *dev, uint8_t x0, uint8_t x1, uint8_t p0,
+        uint8_t p1);
 
-void ssd1306_spi_write_data(uint8_t *w, size_t wn);
-#endif /* SSD1306_SPI */
+/*
+ * enable or disable full refresh mode
+ *
+ * In full refresh mode, ssd1306_update_display() sends the whole framebuffer
+ * regardless of what changed. Otherwise (default) only changed regions are
+ * sent.
+ */
+void ssd1306_set_full_refresh(ssd1306_t *dev, bool full);
+
+/* get framebuffer flush statistics */
+const ssd1306_flush_stats_t *ssd1306_get_flush_stats(const ssd1306_t *dev);
+
+/*
+ * write changed regions of framebuffer to display
+ *
+ * Waits for any asynchronous flushes on the bus to finish first.
+ */
+bool ssd1306_update_display(ssd1306_t *dev);
+
+/*
+ * start writing changed regions of framebuffer to display, and return
+ *
+ * The transfer is driven by interrupts (I2C) or DMA (SPI) and completes in
+ * the background. If another display's flush is using the bus, this one is
+ * queued and starts as soon as the bus is free. Single buffered: the
+ * framebuffer regions being sent should not be drawn to until it finishes.
+ * Double buffered: the drawn frame is swapped to the front buffer first, and
+ * drawing can continue immediately.
+ *
+ * callback: called when the flush finishes (may be NULL)
+ *
+ * Returns false if a flush of this display is already queued or in
+ * progress, true otherwise
+ */
+bool ssd1306_update_display_async(ssd1306_t *dev,
+        ssd1306_flush_callback_t callback);
+
+/*
+ * return true while an asynchronous flush is queued or in progress
+ *
+ * Also lets the transport end a write that is stuck (e.g. an I2C timeout),
+ * so waiting on this is bounded, or free a bus it found held. Call it from
+ * thread context.
+ */
+bool ssd1306_flush_busy(const ssd1306_t *dev);
+
+/*
+ * finish the current frame and start sending it to the display
+ *
+ * Waits for the previous flush of this display to finish, then starts an
+ * asynchronous flush (swapping buffers first when double buffered).
+ *
+ * callback: called when the flush finishes (may be NULL)
+ *
+ * Returns true if the flush was started
+ */
+bool ssd1306_present(ssd1306_t *dev, ssd1306_flush_callback_t callback);
+
+/*
+ * start writing one page of display RAM from memory, and return
+ *
+ * For drawing without a framebuffer: the page is rasterized into a page
+ * buffer and sent while the next one is drawn. The transfer is queued and
+ * driven like an asynchronous flush, and leaves the framebuffer and its dirty
+ * regions (if any) alone.
+ *
+ * p:        page
+ * data:     DISP_WIDTH bytes; must not change until the transfer finishes
+ * callback: called when the transfer finishes (may be NULL)
+ *
+ * Returns false if a flush or page of this display is already queued or in
+ * progress, true otherwise
+ */
+bool ssd1306_write_page_async(ssd1306_t *dev, uint8_t p, uint8_t *data,
+        ssd1306_flush_callback_t callback);
+
+/* write contents of framebuffer to display, one data byte per write */
+void ssd1306_update_display_slow(ssd1306_t *dev);
+
+/* write a single command to display */
+void ssd1306_write_command(ssd1306_t *dev, uint8_t command);
+
+/* write a list of commands to the display */
+void ssd1306_write_command_list(ssd1306_t *dev, uint8_t *command_list,
+        uint32_t len);
 
 /*
  * control bytes for commands/data
@@ -89,9 +600,14 @@ void ssd1306_spi_write_data(uint8_t *w, size_t wn);
  *   continuation bit: 0
  *   data/command# bit: 1
  *   (followed by 6 zeroes)
+ * 0x80: the following byte is a command, and the byte after it is another
+ *   control byte
+ *   continuation bit: 1
+ *   data/command# bit: 0
  */
 #define CONTROL_BYTE_COMMAND 0x00
 #define CONTROL_BYTE_DATA 0x40
+#define CONTROL_BYTE_COMMAND_CONTINUED 0x80
 
 
 /*
@@ -222,8 +738,14 @@ void ssd1306_spi_write_data(uint8_t *w, size_t wn);
 #define SSD1306_SET_COM_SCAN_DIR_REMAPPED 0xC8
 /* set display offset; followed by offset byte */
 #define SSD1306_SET_DISPLAY_OFFSET 0xD3
-/* set COM pins hardware configuration; followed by config byte */
+/* set COM pins hardware configuration; followed by config byte
+ *   0x02: sequential COM pin configuration
+ *   0x12: alternative COM pin configuration [reset]
+ *   OR with 0x20 to enable COM left/right remap
+ */
 #define SSD1306_SET_COM_HW_CONFIG 0xDA
+#define SSD1306_COM_PINS_SEQUENTIAL 0x02
+#define SSD1306_COM_PINS_ALTERNATIVE 0x12
 
 
 /*
@@ -0,0 +1,110 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ssd1306.h"
+#include "ssd1306_graphics.h"
+#include "ssd1306_console.h"
+
+static struct {
+    ssd1306_t *dev;
+    uint8_t top; /* page holding the top text row */
+    uint8_t row; /* cursor row on screen; CONSOLE_ROWS = below the bottom */
+    uint8_t col; /* cursor column */
+    bool scrolled; /* start line changed since the last flush */
+} console;
+
+/* clear the display and move the cursor to the top left */
+void console_init(ssd1306_t *dev) {
+    while (ssd1306_flush_busy(dev));
+
+    fill_display(ssd1306_surface(dev), PIXEL_OFF);
+    console.dev = dev;
+    console.top = 0;
+    console.row = 0;
+    console.col = 0;
+    console.scrolled = true;
+}
+
+/* move the top row to the bottom, cleared */
+static void console_scroll(void) {
+#if DISP_PAGES == SSD1306_RAM_PAGES
+    ssd1306_fill_pages(console.dev, console.top, console.top, 0x00);
+    console.top = (console.top + 1) % CONSOLE_ROWS;
+    console.scrolled = true;
+#else
+    ssd1306_blend_pages(console.dev, 0, 1, CONSOLE_ROWS - 1, BLEND_COPY);
+    ssd1306_fill_pages(console.dev, CONSOLE_ROWS - 1, CONSOLE_ROWS - 1, 0x00);
+#endif
+    console.row = CONSOLE_ROWS - 1;
+}
+
+/* write one character at the cursor */
+void console_putc(char c) {
+    if (c == '\n') {
+        /* scrolling waits for the next character, so the bottom row is used */
+        if (console.row >= CONSOLE_ROWS) {
+            console_scroll();
+        }
+        console.row++;
+        console.col = 0;
+        return;
+    }
+    if (c == '\r') {
+        console.col = 0;
+        return;
+    }
+
+    if (console.col >= CONSOLE_COLS) {
+        console.row++;
+        console.col = 0;
+    }
+    if (console.row >= CONSOLE_ROWS) {
+        console_scroll();
+    }
+
+    uint8_t page = (console.top + console.row) % CONSOLE_ROWS;
+    draw_character(ssd1306_surface(console.dev), c, console.col * 8, page * 8,
+            PIXEL_ON);
+    console.col++;
+}
+
+/* write n characters of s */
+void console_write(const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        console_putc(s[i]);
+    }
+}
+
+/* write formatted text (as printf) */
+int console_printf(const char *format, ...) {
+    char buf[CONSOLE_COLS * CONSOLE_ROWS + 1];
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    if (n > 0) {
+        if ((size_t) n >= sizeof(buf)) {
+            n = sizeof(buf) - 1;
+        }
+        console_write(buf, n);
+    }
+    return n;
+}
+
+/* send changes (new text and scroll position) to the display */
+bool console_flush(void) {
+    while (ssd1306_flush_busy(console.dev));
+
+    /* scroll first: the rows above are already on the display */
+    if (console.scrolled) {
+        ssd1306_write_command(console.dev, SSD1306_SET_DISP_START_LINE
+                | (console.top * 8));
+        console.scrolled = false;
+    }
+    return ssd1306_update_display(console.dev);
+}
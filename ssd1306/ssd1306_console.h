@@ -0,0 +1,51 @@
+#ifndef SSD1306_CONSOLE_H
+#define SSD1306_CONSOLE_H
+
+/*
+ * Scrolling text console for SSD1306 display
+ *
+ * The display becomes a grid of 8x8 characters, one text row per page.
+ *
+ * On panels that show all 64 rows of display RAM, the pages are used as a
+ * ring: scrolling clears the top row's page, reuses it as the new bottom row,
+ * and moves the display start line so that the rest of the screen does not
+ * have to be sent again. A flush after a scroll sends only the new row. On
+ * shorter panels the start line would bring rows outside the panel into view,
+ * so scrolling moves the text up a page instead, and the next flush sends the
+ * whole screen.
+ *
+ * There is one console, shown on the display given to console_init(). It owns
+ * that display's whole framebuffer while it is in use: anything else drawn to
+ * it is scrolled along with the text.
+ */
+
+#define CONSOLE_COLS (DISP_WIDTH / 8)
+#define CONSOLE_ROWS DISP_PAGES
+
+/* clear the display and move the cursor to the top left */
+void console_init(ssd1306_t *dev);
+
+/*
+ * write one character at the cursor
+ *
+ * '\n' moves to the start of the next row, '\r' to the start of the current
+ * row. Rows wrap at the right edge. Writing below the bottom row scrolls the
+ * console up by one row.
+ */
+void console_putc(char c);
+
+/* write n characters of s */
+void console_write(const char *s, size_t n);
+
+/*
+ * write formatted text (as printf)
+ *
+ * Returns the number of characters written, or a negative value on error.
+ * Output longer than one screen is truncated.
+ */
+int console_printf(const char *format, ...);
+
+/* send changes (new text and scroll position) to the display */
+bool console_flush(void);
+
+#endif
@@ -0,0 +1,258 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ssd1306.h"
+#include "ssd1306_graphics.h"
+#include "ssd1306_display_list.h"
+#include "profile.h"
+
+/*
+ * Each command is a header, its arguments, and (for text) the characters.
+ * Arguments are copied in and out with memcpy, so the list needs no
+ * alignment.
+ */
+enum {
+    CMD_FILL,
+    CMD_RECTANGLE,
+    CMD_LINE,
+    CMD_TEXT,
+    CMD_BITMAP,
+    CMD_BLIT
+};
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t len; /* bytes of arguments and characters after the header */
+    uint8_t y0; /* rows the command draws to (none outside them) */
+    uint8_t y1;
+} cmd_header_t;
+
+typedef struct {
+    uint8_t x0;
+    uint8_t y0;
+    uint8_t x1;
+    uint8_t y1;
+    uint8_t color;
+} shape_args_t;
+
+typedef struct {
+    uint8_t x;
+    uint8_t y;
+    uint8_t color;
+    uint8_t n; /* characters that follow */
+} text_args_t;
+
+typedef struct {
+    const image_t *image;
+    uint8_t x;
+    uint8_t y;
+    uint8_t op;
+} bitmap_args_t;
+
+typedef struct {
+    const bitmap_t *src;
+    uint8_t sx;
+    uint8_t sy;
+    uint8_t w;
+    uint8_t h;
+    uint8_t x;
+    uint8_t y;
+    uint8_t op;
+} blit_args_t;
+
+/* set up an empty display list */
+void display_list_init(display_list_t *dl, uint8_t *buffer, uint16_t size) {
+    dl->data = buffer;
+    dl->size = size;
+    dl->len = 0;
+}
+
+/* remove all commands, to record the next frame */
+void display_list_clear(display_list_t *dl) {
+    dl->len = 0;
+}
+
+/* last row covered by n rows from y, limited to the coordinate range */
+static uint8_t last_row(uint8_t y, uint16_t n) {
+    return y + n - 1 > 0xFF ? 0xFF : y + n - 1;
+}
+
+/* append a command covering rows y0..y1; false if it doesn't fit */
+static bool put(display_list_t *dl, uint8_t cmd, uint8_t y0, uint8_t y1,
+        const void *args, uint8_t nargs, const char *s, uint8_t n) {
+    cmd_header_t h = { cmd, nargs + n, y0, y1 };
+    if ((size_t) (dl->size - dl->len) < sizeof(h) + nargs + n) {
+        return false;
+    }
+    uint8_t *d = &dl->data[dl->len];
+    memcpy(d, &h, sizeof(h));
+    memcpy(d + sizeof(h), args, nargs);
+    if (n) {
+        memcpy(d + sizeof(h) + nargs, s, n); /* s is NULL with no text */
+    }
+    dl->len += sizeof(h) + nargs + n;
+    return true;
+}
+
+/* fill_display() */
+bool display_list_fill(display_list_t *dl, pixel_t color) {
+    uint8_t c = color;
+    return put(dl, CMD_FILL, 0, 0xFF, &c, sizeof(c), NULL, 0);
+}
+
+/* draw_rectangle() */
+bool display_list_rectangle(display_list_t *dl, uint8_t x0, uint8_t y0,
+        uint8_t x1, uint8_t y1, pixel_t color) {
+    shape_args_t a = { x0, y0, x1, y1, color };
+    if (x0 > x1 || y0 > y1) {
+        return true; /* draws nothing */
+    }
+    return put(dl, CMD_RECTANGLE, y0, y1, &a, sizeof(a), NULL, 0);
+}
+
+/* draw_line() */
+bool display_list_line(display_list_t *dl, uint8_t x0, uint8_t y0,
+        uint8_t x1, uint8_t y1, pixel_t color) {
+    shape_args_t a = { x0, y0, x1, y1, color };
+    return put(dl, CMD_LINE, y0 < y1 ? y0 : y1, y0 < y1 ? y1 : y0, &a,
+            sizeof(a), NULL, 0);
+}
+
+/* draw_character() for each of n characters of s, left to right from (x, y) */
+bool display_list_text(display_list_t *dl, const char *s, uint8_t n,
+        uint8_t x, uint8_t y, pixel_t color) {
+    uint8_t max = (0xFF - x) / 8 + 1;
+    if (n > max) {
+        n = max;
+    }
+    text_args_t a = { x, y, color, n };
+    return put(dl, CMD_TEXT, y, last_row(y, 8), &a, sizeof(a), s, n);
+}
+
+/* draw_bitmap() */
+bool display_list_bitmap(display_list_t *dl, const image_t *image, uint8_t x,
+        uint8_t y, blend_t op) {
+    bitmap_args_t a = { image, x, y, op };
+    if (image->height == 0) {
+        return true;
+    }
+    return put(dl, CMD_BITMAP, y, last_row(y, image->height), &a, sizeof(a),
+            NULL, 0);
+}
+
+/* blit() */
+bool display_list_blit(display_list_t *dl, const bitmap_t *src, uint8_t sx,
+        uint8_t sy, uint8_t w, uint8_t h, uint8_t x, uint8_t y, blend_t op) {
+    blit_args_t a = { src, sx, sy, w, h, x, y, op };
+    if (sy >= src->height || h == 0) {
+        return true;
+    }
+    if (h > src->height - sy) {
+        h = src->height - sy;
+    }
+    return put(dl, CMD_BLIT, y, last_row(y, h), &a, sizeof(a), NULL, 0);
+}
+
+/* draw the commands of a display list into a surface */
+void display_list_draw(const display_list_t *dl, surface_t *dst) {
+    const ssd1306_rect_t *c = &dst->clip;
+    if (c->x0 > c->x1 || c->y0 > c->y1) {
+        return;
+    }
+
+    for (uint16_t i = 0; i < dl->len; ) {
+        cmd_header_t h;
+        memcpy(&h, &dl->data[i], sizeof(h));
+        const uint8_t *args = &dl->data[i + sizeof(h)];
+        i += sizeof(h) + h.len;
+
+        /* skip commands above or below the clip rectangle */
+        if (dst->viewport.y0 + h.y0 > c->y1
+                || dst->viewport.y0 + h.y1 < c->y0) {
+            continue;
+        }
+
+        if (h.cmd == CMD_FILL) {
+            fill_display(dst, args[0]);
+        } else if (h.cmd == CMD_RECTANGLE || h.cmd == CMD_LINE) {
+            shape_args_t a;
+            memcpy(&a, args, sizeof(a));
+            if (h.cmd == CMD_RECTANGLE) {
+                draw_rectangle(dst, a.x0, a.y0, a.x1, a.y1, a.color);
+            } else {
+                draw_line(dst, a.x0, a.y0, a.x1, a.y1, a.color);
+            }
+        } else if (h.cmd == CMD_TEXT) {
+            text_args_t a;
+            memcpy(&a, args, sizeof(a));
+            const uint8_t *s = args + sizeof(a);
+            for (uint8_t k = 0; k < a.n; k++) {
+                draw_character(dst, s[k], a.x + 8 * k, a.y, a.color);
+            }
+        } else if (h.cmd == CMD_BITMAP) {
+            bitmap_args_t a;
+            memcpy(&a, args, sizeof(a));
+            draw_bitmap(dst, a.image, a.x, a.y, a.op);
+        } else if (h.cmd == CMD_BLIT) {
+            blit_args_t a;
+            memcpy(&a, args, sizeof(a));
+            blit(dst, a.src, a.sx, a.sy, a.w, a.h, a.x, a.y, a.op);
+        }
+    }
+}
+
+/* cleared by a page that failed to reach the display */
+static volatile bool render_ok;
+
+static void page_sent(ssd1306_t *dev, bool success) {
+    (void) dev;
+    if (!success) {
+        render_ok = false;
+    }
+}
+
+/* draw a display list to a display, one page at a time (blocking) */
+bool display_list_render(const display_list_t *dl, ssd1306_t *dev,
+        uint8_t *pages, uint8_t npages) {
+    /*
+     * Every page of the band is the same page buffer (stride 0), and the
+     * clip rectangle holds drawing to the rows of the page being rendered,
+     * so the graphics functions rasterize one page in display coordinates.
+     */
+    surface_t band = {
+        .width = DISP_WIDTH,
+        .height = DISP_HEIGHT,
+        .stride = 0,
+        .dev = NULL,
+        .viewport = { 0, 0, DISP_WIDTH - 1, DISP_HEIGHT - 1 },
+    };
+    if (npages == 0) {
+        return false;
+    }
+
+    render_ok = true;
+    for (uint8_t p = 0; p < DISP_PAGES; p++) {
+        band.buffer = &pages[(npages > 1 ? p % 2 : 0) * DISP_WIDTH];
+        band.clip = (ssd1306_rect_t) { 0, p * 8, DISP_WIDTH - 1, p * 8 + 7 };
+
+        /* one buffer: it is on the bus until the previous page is sent */
+        if (npages == 1) {
+            while (ssd1306_flush_busy(dev));
+        }
+        PROF_BEGIN(render_page);
+        memset(band.buffer, 0, DISP_WIDTH);
+        display_list_draw(dl, &band);
+        PROF_END(render_page);
+
+        while (ssd1306_flush_busy(dev));
+        if (!ssd1306_write_page_async(dev, p, band.buffer, page_sent)) {
+            render_ok = false;
+            break;
+        }
+    }
+    while (ssd1306_flush_busy(dev));
+
+    return render_ok;
+}
@@ -0,0 +1,99 @@
+#ifndef SSD1306_DISPLAY_LIST_H
+#define SSD1306_DISPLAY_LIST_H
+
+/*
+ * Display lists for SSD1306 display
+ *
+ * Draw calls are recorded into a display list, a compact byte buffer, instead
+ * of being drawn. Rendering the list rasterizes the display one page at a
+ * time into a DISP_WIDTH byte page buffer, and sends each page while the next
+ * one is rasterized, so a display can be driven without a framebuffer (see
+ * ssd1306_init()). Every command is stored with the rows it covers, and a
+ * page only replays the commands that reach it.
+ *
+ * Coordinates are display coordinates, with the graphics functions' meaning.
+ * Each page starts cleared, and commands are drawn in the order they were
+ * recorded. Text is copied into the list; images and bitmaps are referenced,
+ * and must stay valid until the list is rendered.
+ */
+
+/* recorded draw calls */
+typedef struct {
+    uint8_t *data;
+    uint16_t size; /* bytes of data */
+    uint16_t len; /* bytes used */
+} display_list_t;
+
+/*
+ * set up an empty display list
+ *
+ * buffer: memory for the commands
+ * size:   bytes of buffer
+ */
+void display_list_init(display_list_t *dl, uint8_t *buffer, uint16_t size);
+
+/* remove all commands, to record the next frame */
+void display_list_clear(display_list_t *dl);
+
+/*
+ * Recording
+ *
+ * Each function records a call of the graphics function it is named after.
+ * Returns false if the list is full; the command is dropped.
+ */
+
+/* fill_display() */
+bool display_list_fill(display_list_t *dl, pixel_t color);
+
+/* draw_rectangle() */
+bool display_list_rectangle(display_list_t *dl, uint8_t x0, uint8_t y0,
+        uint8_t x1, uint8_t y1, pixel_t color);
+
+/* draw_line() */
+bool display_list_line(display_list_t *dl, uint8_t x0, uint8_t y0,
+        uint8_t x1, uint8_t y1, pixel_t color);
+
+/*
+ * draw_character() for each of n characters of s, left to right from (x, y)
+ *
+ * Characters that would start past column 255 are dropped.
+ */
+bool display_list_text(display_list_t *dl, const char *s, uint8_t n,
+        uint8_t x, uint8_t y, pixel_t color);
+
+/* draw_bitmap() */
+bool display_list_bitmap(display_list_t *dl, const image_t *image, uint8_t x,
+        uint8_t y, blend_t op);
+
+/* blit() */
+bool display_list_blit(display_list_t *dl, const bitmap_t *src, uint8_t sx,
+        uint8_t sy, uint8_t w, uint8_t h, uint8_t x, uint8_t y, blend_t op);
+
+/*
+ * Rendering
+ */
+
+/*
+ * draw the commands of a display list into a surface
+ *
+ * Coordinates are relative to the surface's viewport, and commands entirely
+ * above or below its clip rectangle are skipped.
+ */
+void display_list_draw(const display_list_t *dl, surface_t *dst);
+
+/*
+ * draw a display list to a display, one page at a time (blocking)
+ *
+ * Each page is rasterized into a page buffer and written with
+ * ssd1306_write_page_async(). With two page buffers, the next page is
+ * rasterized while the previous one is on the bus.
+ *
+ * pages:  npages * DISP_WIDTH bytes of page buffers
+ * npages: 1, or 2 to overlap rasterizing with sending
+ *
+ * Returns true if every page was written to the display
+ */
+bool display_list_render(const display_list_t *dl, ssd1306_t *dev,
+        uint8_t *pages, uint8_t npages);
+
+#endif
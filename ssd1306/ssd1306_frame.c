@@ -0,0 +1,91 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libopencm3/cm3/cortex.h>
+
+#include "systick.h"
+#include "ssd1306.h"
+#include "ssd1306_frame.h"
+
+/* set up a scheduler; the first frame is due at once */
+void frame_scheduler_init(frame_scheduler_t *fs, ssd1306_t *dev, uint32_t fps,
+        frame_render_t render, void *ctx) {
+    memset(fs, 0, sizeof(*fs));
+    fs->dev = dev;
+    fs->render = render;
+    fs->ctx = ctx;
+    fs->period_us = 1000000 / (fps ? fps : 1);
+    fs->due_us = micros64();
+}
+
+/* count the interval since the last frame in the histogram */
+static void record_interval(frame_scheduler_t *fs, uint64_t now) {
+    if (fs->have_last) {
+        uint64_t quarters = (now - fs->last_us) * 4 / fs->period_us;
+        uint32_t bin = quarters < FRAME_HISTOGRAM_BINS - 1
+            ? (uint32_t) quarters : FRAME_HISTOGRAM_BINS - 1;
+        fs->stats.histogram[bin]++;
+    }
+    fs->last_us = now;
+    fs->have_last = true;
+}
+
+/* wait for the next frame to be due, render it and start presenting it */
+bool frame_scheduler_step(frame_scheduler_t *fs) {
+    uint64_t now = micros64();
+    while (now < fs->due_us) {
+        __WFI();
+        now = micros64();
+    }
+
+    /* a period or more late: drop the missed frames, render the current one */
+    uint64_t late = now - fs->due_us;
+    if (late >= fs->period_us) {
+        uint32_t missed = (uint32_t) (late / fs->period_us);
+        fs->stats.dropped += missed;
+        fs->frame += missed;
+        fs->due_us += (uint64_t) missed * fs->period_us;
+    }
+    fs->due_us += fs->period_us;
+    record_interval(fs, now);
+
+#ifndef SSD1306_DOUBLE_BUFFER
+    /* the framebuffer is on the bus until the previous frame is sent */
+    while (ssd1306_flush_busy(fs->dev));
+#endif
+    uint64_t t0 = micros64();
+    fs->render(ssd1306_surface(fs->dev), fs->frame++, fs->ctx);
+    uint32_t render_us = (uint32_t) (micros64() - t0);
+    if (render_us > fs->stats.render_max_us) {
+        fs->stats.render_max_us = render_us;
+    }
+
+    if (!ssd1306_present(fs->dev, NULL)) {
+        return false;
+    }
+    fs->stats.frames++;
+    return true;
+}
+
+/* run n frames (forever if n is 0) */
+bool frame_scheduler_run(frame_scheduler_t *fs, uint32_t n) {
+    for (uint32_t i = 0; n == 0 || i < n; i++) {
+        if (!frame_scheduler_step(fs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* frame timing statistics since init or the last clear */
+const frame_stats_t *frame_scheduler_stats(const frame_scheduler_t *fs) {
+    return &fs->stats;
+}
+
+/* zero the frame timing statistics */
+void frame_scheduler_clear_stats(frame_scheduler_t *fs) {
+    memset(&fs->stats, 0, sizeof(fs->stats));
+    fs->have_last = false;
+}
@@ -0,0 +1,87 @@
+#ifndef SSD1306_FRAME_H
+#define SSD1306_FRAME_H
+
+/*
+ * Frame scheduler for SSD1306 display
+ *
+ * Calls a render function at a fixed frame rate and presents each frame
+ * (ssd1306_present()). Frames are due on a grid of whole periods from
+ * frame_scheduler_init(), so time spent rendering and flushing doesn't make
+ * the rate drift. The scheduler sleeps (WFI) until a frame is due; SysTick
+ * wakes it every millisecond.
+ *
+ * With SSD1306_DOUBLE_BUFFER, a frame is rendered while the previous one is
+ * still being sent; otherwise rendering waits for the flush to finish.
+ *
+ * If a frame is late by one period or more, the periods missed are dropped:
+ * the next frame rendered is the one for the current period, so animation
+ * driven by the frame number keeps time under overload.
+ */
+
+/* buckets of the frame interval histogram, each a quarter period wide */
+#ifndef FRAME_HISTOGRAM_BINS
+#define FRAME_HISTOGRAM_BINS 16
+#endif
+
+/*
+ * draw a frame
+ *
+ * screen: the display's surface
+ * frame:  periods since frame_scheduler_init(); skips the dropped ones
+ * ctx:    as given to frame_scheduler_init()
+ */
+typedef void (*frame_render_t)(surface_t *screen, uint32_t frame, void *ctx);
+
+/* frame timing statistics */
+typedef struct {
+    uint32_t frames; /* presented */
+    uint32_t dropped; /* periods skipped under overload */
+    uint32_t render_max_us; /* longest render function call */
+
+    /*
+     * time between consecutive frames: bucket i counts intervals of i to i+1
+     * quarter periods, the last bucket all longer ones. Bucket 4 is on time.
+     */
+    uint32_t histogram[FRAME_HISTOGRAM_BINS];
+} frame_stats_t;
+
+typedef struct {
+    ssd1306_t *dev;
+    frame_render_t render;
+    void *ctx;
+    uint32_t period_us;
+    uint64_t due_us; /* micros64() when the next frame is due */
+    uint64_t last_us; /* when the last frame was rendered */
+    bool have_last; /* false until a frame since init or clear */
+    uint32_t frame; /* number of the next frame */
+    frame_stats_t stats;
+} frame_scheduler_t;
+
+/*
+ * set up a scheduler; the first frame is due at once
+ *
+ * dev:    display the frames are presented on
+ * fps:    frames per second, at least 1
+ * render: draws each frame
+ * ctx:    passed to render (may be NULL)
+ */
+void frame_scheduler_init(frame_scheduler_t *fs, ssd1306_t *dev, uint32_t fps,
+        frame_render_t render, void *ctx);
+
+/*
+ * wait for the next frame to be due, render it and start presenting it
+ *
+ * Returns false if the flush could not be started
+ */
+bool frame_scheduler_step(frame_scheduler_t *fs);
+
+/* run n frames (forever if n is 0); false if a flush could not be started */
+bool frame_scheduler_run(frame_scheduler_t *fs, uint32_t n);
+
+/* frame timing statistics since init or the last clear */
+const frame_stats_t *frame_scheduler_stats(const frame_scheduler_t *fs);
+
+/* zero the frame timing statistics */
+void frame_scheduler_clear_stats(frame_scheduler_t *fs);
+
+#endif
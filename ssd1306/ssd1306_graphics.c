@@ -1,25 +1,141 @@
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <libopencm3/stm32/i2c.h>
 
 #include "ssd1306.h"
 #include "ssd1306_graphics.h"
-#include "font8x8_basic.h"
+#include "font8x8_columns.h"
 
-/* fill framebuffer with solid color (PIXEL_OFF, PIXEL_ON, or PIXEL_TOGGLE) */
-void fill_display(pixel_t color) {
-    for (uint32_t j = 0; j < DISP_HEIGHT / 8; j++) {
-        for (uint32_t i = 0; i < DISP_WIDTH; i++) {
-            ssd1306_draw_page(i, j, color);
+/* true if nothing can be drawn */
+static inline bool clip_empty(const ssd1306_rect_t *c) {
+    return c->x0 > c->x1 || c->y0 > c->y1;
+}
+
+/* true if dst is a display's framebuffer, and the clip rectangle all of it */
+static inline bool clip_whole_display(const surface_t *dst) {
+    const ssd1306_rect_t *c = &dst->clip;
+    return dst->dev && c->x0 == 0 && c->y0 == 0 && c->x1 == DISP_WIDTH - 1
+        && c->y1 == DISP_HEIGHT - 1;
+}
+
+/* limit drawing to a rectangle of the viewport */
+void set_clip(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1) {
+    const ssd1306_rect_t *v = &dst->viewport;
+    uint16_t cx0 = v->x0 + x0;
+    uint16_t cy0 = v->y0 + y0;
+    uint16_t cx1 = v->x0 + x1;
+    uint16_t cy1 = v->y0 + y1;
+    if (cx1 > v->x1) {
+        cx1 = v->x1;
+    }
+    if (cy1 > v->y1) {
+        cy1 = v->y1;
+    }
+    if (cx1 > dst->width - 1) {
+        cx1 = dst->width - 1;
+    }
+    if (cy1 > dst->height - 1) {
+        cy1 = dst->height - 1;
+    }
+
+    if (x0 > x1 || y0 > y1 || cx0 > cx1 || cy0 > cy1 || !dst->width
+            || !dst->height) {
+        dst->clip = (ssd1306_rect_t) { 1, 1, 0, 0 };
+    } else {
+        dst->clip = (ssd1306_rect_t) { cx0, cy0, cx1, cy1 };
+    }
+}
+
+/* set the area of the surface that the drawing functions draw into */
+void set_viewport(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1) {
+    dst->viewport = (ssd1306_rect_t) { x0, y0, x1, y1 };
+    set_clip(dst, 0, 0, 0xFF, 0xFF);
+}
+
+/* make the viewport the whole surface, and remove the clip rectangle */
+void reset_viewport(surface_t *dst) {
+    set_viewport(dst, 0, 0, dst->width - 1, dst->height - 1);
+}
+
+/* fill a rectangle that is known to be on the surface */
+static void fill_rectangle(surface_t *dst, uint8_t x0, uint8_t y0,
+        uint8_t x1, uint8_t y1, pixel_t color) {
+    /* partial masks for the top and bottom pages; pages between are whole */
+    uint8_t p0 = y0 / 8;
+    uint8_t p1 = y1 / 8;
+    uint8_t top = 0xFF << (y0 % 8);
+    uint8_t bottom = 0xFF >> (7 - y1 % 8);
+
+    if (p0 == p1) {
+        surface_draw_span(dst, x0, x1, p0, top & bottom, color);
+        return;
+    }
+    surface_draw_span(dst, x0, x1, p0, top, color);
+    for (uint8_t p = p0 + 1; p < p1; p++) {
+        surface_draw_span(dst, x0, x1, p, 0xFF, color);
+    }
+    surface_draw_span(dst, x0, x1, p1, bottom, color);
+}
+
+/* fill the clip rectangle with solid color (PIXEL_OFF, ON, or TOGGLE) */
+void fill_display(surface_t *dst, pixel_t color) {
+    const ssd1306_rect_t *c = &dst->clip;
+    if (!clip_whole_display(dst)) {
+        if (!clip_empty(c)) {
+            fill_rectangle(dst, c->x0, c->y0, c->x1, c->y1, color);
         }
+        return;
+    }
+
+    if (color == PIXEL_TOGGLE) {
+        ssd1306_invert_pages(dst->dev, 0, DISP_PAGES - 1);
+    } else {
+        ssd1306_fill_pages(dst->dev, 0, DISP_PAGES - 1,
+                color == PIXEL_ON ? 0xFF : 0x00);
     }
 }
 
-/* draw an 8px * 8px checkerboard to framebuffer */
-void draw_checkerboard(void) {
-    for (uint32_t j = 0; j <= DISP_HEIGHT; j++) {
-        for (uint32_t i = 0; i <= DISP_WIDTH; i++) {
-            ssd1306_draw_pixel(i, j, ((i/8) % 2 == (j/8) % 2));
+/* draw an 8px * 8px checkerboard to the clip rectangle */
+void draw_checkerboard(surface_t *dst) {
+    /* squares start lit on even pages; odd pages are the inverse */
+    static const uint8_t squares[16] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    static const uint8_t inverse[16] = {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+    };
+    const ssd1306_rect_t *c = &dst->clip;
+    if (clip_whole_display(dst)) {
+        for (uint8_t p = 0; p < DISP_PAGES; p++) {
+            ssd1306_fill_pattern(dst->dev, p, p, p % 2 ? inverse : squares,
+                    sizeof(squares));
+        }
+        return;
+    }
+    if (clip_empty(c)) {
+        return;
+    }
+
+    /* one span per square, masked to the clipped rows of each page */
+    for (uint8_t p = c->y0 / 8; p <= c->y1 / 8; p++) {
+        uint8_t mask = 0xFF;
+        if (p == c->y0 / 8) {
+            mask &= 0xFF << (c->y0 % 8);
+        }
+        if (p == c->y1 / 8) {
+            mask &= 0xFF >> (7 - c->y1 % 8);
+        }
+        for (uint8_t x = c->x0; x <= c->x1; x = (x | 7) + 1) {
+            uint8_t x1 = (x | 7) < c->x1 ? (x | 7) : c->x1;
+            bool lit = (x / 8) % 2 == p % 2;
+            surface_draw_span(dst, x, x1, p, mask,
+                    lit ? PIXEL_ON : PIXEL_OFF);
         }
     }
 }
@@ -33,101 +149,1063 @@ void draw_checkerboard(void) {
  * y1:    lower-most y coordinate of box
  * color: color of rectangle (PIXEL_OFF, PIXEL_ON, PIXEL_TOGGLE)
  */
-void draw_rectangle(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1,
+void draw_rectangle(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1, pixel_t color) {
+    const ssd1306_rect_t *c = &dst->clip;
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+
+    /* to surface coordinates, trimmed to the clip rectangle */
+    uint16_t cx0 = dst->viewport.x0 + x0;
+    uint16_t cy0 = dst->viewport.y0 + y0;
+    uint16_t cx1 = dst->viewport.x0 + x1;
+    uint16_t cy1 = dst->viewport.y0 + y1;
+    if (cx0 < c->x0) {
+        cx0 = c->x0;
+    }
+    if (cy0 < c->y0) {
+        cy0 = c->y0;
+    }
+    if (cx1 > c->x1) {
+        cx1 = c->x1;
+    }
+    if (cy1 > c->y1) {
+        cy1 = c->y1;
+    }
+    if (cx0 > cx1 || cy0 > cy1) {
+        return;
+    }
+
+    fill_rectangle(dst, cx0, cy0, cx1, cy1, color);
+}
+
+/*
+ * Bresenham loops for lines with m <= 1 (small slope) and m > 1 (large
+ * slope), instantiated once per color so that each writes its pixels through
+ * an inline writer without branching on the color
+ *
+ * Both walk a line from (u, v) along its major axis, du major and dv minor
+ * steps in total (vstep being +1 or -1), and draw steps i0..i1 of it. The
+ * error term at step i has a closed form, so a clipped line starts where the
+ * whole line would be at step i0: it draws exactly the pixels of the whole
+ * line that are inside the clip rectangle.
+ */
+#define DEFINE_LINE_HELPERS(color, plot) \
+static void draw_line_small_slope_##color(surface_t *dst, int32_t u, \
+        int32_t v, int32_t du, int32_t dv, int32_t vstep, int32_t i0, \
+        int32_t i1) { \
+    int32_t j = (2 * i0 * dv + du) / (2 * du); \
+    int32_t error = i0 * dv - j * du; \
+    int32_t a = 2 * dv - du; \
+    uint8_t y = v + vstep * j; \
+    for (int32_t x = u + i0; x <= u + i1; x++) { \
+        plot(dst, x, y); \
+        if (2 * error + a < 0) { \
+            error += dv; \
+        } else { \
+            error += dv - du; \
+            y += vstep; \
+        } \
+    } \
+} \
+\
+static void draw_line_large_slope_##color(surface_t *dst, int32_t u, \
+        int32_t v, int32_t du, int32_t dv, int32_t vstep, int32_t i0, \
+        int32_t i1) { \
+    int32_t j = (2 * i0 * dv + du) / (2 * du); \
+    int32_t error = i0 * dv - j * du; \
+    int32_t a = 2 * dv - du; \
+    uint8_t x = v + vstep * j; \
+    for (int32_t y = u + i0; y <= u + i1; y++) { \
+        plot(dst, x, y); \
+        if (2 * error + a < 0) { \
+            error += dv; \
+        } else { \
+            error += dv - du; \
+            x += vstep; \
+        } \
+    } \
+}
+
+DEFINE_LINE_HELPERS(off, surface_pixel_off)
+DEFINE_LINE_HELPERS(on, surface_pixel_on)
+DEFINE_LINE_HELPERS(toggle, surface_pixel_toggle)
+
+typedef void (*line_helper_t)(surface_t *dst, int32_t u, int32_t v,
+        int32_t du, int32_t dv, int32_t vstep, int32_t i0, int32_t i1);
+
+static const line_helper_t small_slope[] = {
+    [PIXEL_OFF] = draw_line_small_slope_off,
+    [PIXEL_ON] = draw_line_small_slope_on,
+    [PIXEL_TOGGLE] = draw_line_small_slope_toggle,
+};
+
+static const line_helper_t large_slope[] = {
+    [PIXEL_OFF] = draw_line_large_slope_off,
+    [PIXEL_ON] = draw_line_large_slope_on,
+    [PIXEL_TOGGLE] = draw_line_large_slope_toggle,
+};
+
+/*
+ * draw line from (x0, y0) to (x1, y1)
+ * Uses Bresenham's algorithm, see:
+ * https://www.cs.helsinki.fi/group/goa/mallinnus/lines/bresenh.html
+ * https://www.en.wikipedia.org/wiki/Bresenham%27s_line_algorithm
+ *
+ * The line is clipped and its color chosen once, up front, so the pixel
+ * loops run unchecked and without branching on the color. Clipping keeps the
+ * pixels of the unclipped line, so a line drawn in pieces (one clip
+ * rectangle at a time) is the same as the line drawn whole.
+ */
+void draw_line(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1,
         pixel_t color) {
-    for (uint32_t j = y0; j <= y1; j++) {
-        for (uint32_t i = x0; i <= x1; i++) {
-            ssd1306_draw_pixel(i, j, color);
+    const ssd1306_rect_t *c = &dst->clip;
+    int32_t ax = dst->viewport.x0 + x0;
+    int32_t ay = dst->viewport.y0 + y0;
+    int32_t bx = dst->viewport.x0 + x1;
+    int32_t by = dst->viewport.y0 + y1;
+    if (color > PIXEL_TOGGLE || clip_empty(c)) {
+        return;
+    }
+
+    /* horizontal and vertical lines are spans */
+    if (ay == by || ax == bx) {
+        int32_t lx = ax < bx ? ax : bx;
+        int32_t hx = ax < bx ? bx : ax;
+        int32_t ly = ay < by ? ay : by;
+        int32_t hy = ay < by ? by : ay;
+        lx = lx > c->x0 ? lx : c->x0;
+        hx = hx < c->x1 ? hx : c->x1;
+        ly = ly > c->y0 ? ly : c->y0;
+        hy = hy < c->y1 ? hy : c->y1;
+        if (lx > hx || ly > hy) {
+            return;
+        }
+        if (ay == by) {
+            surface_hspan_unchecked(dst, lx, hx, ly, color);
+        } else {
+            surface_vspan_unchecked(dst, lx, ly, hy, color);
+        }
+        return;
+    }
+
+    /* walk along the major axis (y for large slopes) from its lower end */
+    bool steep = abs(by - ay) > abs(bx - ax);
+    if (steep ? by < ay : bx < ax) {
+        int32_t t = ax;
+        ax = bx;
+        bx = t;
+        t = ay;
+        ay = by;
+        by = t;
+    }
+    int32_t u = steep ? ay : ax;
+    int32_t v = steep ? ax : ay;
+    int32_t du = steep ? by - ay : bx - ax;
+    int32_t dv = steep ? bx - ax : by - ay;
+    int32_t vstep = dv < 0 ? -1 : 1;
+    dv = abs(dv);
+
+    /* minor steps j inside the clip rectangle */
+    int32_t cv0 = steep ? c->x0 : c->y0;
+    int32_t cv1 = steep ? c->x1 : c->y1;
+    int32_t jlo = vstep > 0 ? cv0 - v : v - cv1;
+    int32_t jhi = vstep > 0 ? cv1 - v : v - cv0;
+    if (jlo > jhi || jhi < 0 || jlo > dv) {
+        return;
+    }
+
+    /*
+     * major steps inside the clip rectangle, and taking minor steps jlo..jhi
+     * (step i takes minor step (2 * i * dv + du) / (2 * du))
+     */
+    int32_t i0 = (steep ? c->y0 : c->x0) - u;
+    int32_t i1 = (steep ? c->y1 : c->x1) - u;
+    i0 = i0 > 0 ? i0 : 0;
+    i1 = i1 < du ? i1 : du;
+    if (jlo > 0) {
+        int32_t i = ((2 * jlo - 1) * du + 2 * dv - 1) / (2 * dv);
+        i0 = i > i0 ? i : i0;
+    }
+    if (jhi < dv) {
+        int32_t i = ((2 * jhi + 1) * du - 1) / (2 * dv);
+        i1 = i < i1 ? i : i1;
+    }
+    if (i0 > i1) {
+        return;
+    }
+
+    if (steep) {
+        large_slope[color](dst, u, v, du, dv, vstep, i0, i1);
+    } else {
+        small_slope[color](dst, u, v, du, dv, vstep, i0, i1);
+    }
+}
+
+/*
+ * Span accumulator
+ *
+ * Collects the pixels of horizontal spans one page at a time, in row order,
+ * and writes each column of the page once when the spans move on to the next
+ * page. Spans are ORed together, so pixels covered by more than one span are
+ * still drawn once. It lives on the stack of the function drawing the shape
+ * (about 140 bytes).
+ */
+typedef struct {
+    surface_t *dst;
+    pixel_t color;
+    uint8_t page; /* page being collected (0xFF before the first span) */
+    uint8_t x0; /* columns with pixels to draw (none if x0 > x1) */
+    uint8_t x1;
+    uint8_t masks[SURFACE_MAX_WIDTH];
+} span_acc_t;
+
+static void acc_init(span_acc_t *acc, surface_t *dst, pixel_t color) {
+    acc->dst = dst;
+    acc->color = color;
+    acc->page = 0xFF;
+    acc->x0 = 0xFF;
+    acc->x1 = 0;
+    memset(acc->masks, 0, sizeof(acc->masks));
+}
+
+/* write the collected pixels of the current page */
+static void acc_flush(span_acc_t *acc) {
+    if (acc->x0 > acc->x1) {
+        return;
+    }
+    uint8_t n = acc->x1 - acc->x0 + 1;
+    surface_draw_columns(acc->dst, acc->x0, acc->page, &acc->masks[acc->x0],
+            n, acc->color);
+    memset(&acc->masks[acc->x0], 0, n);
+    acc->x0 = 0xFF;
+    acc->x1 = 0;
+}
+
+/* add pixels x0..x1 of row y (surface coordinates), trimmed to the clip */
+static void acc_span(span_acc_t *acc, int16_t x0, int16_t x1, int16_t y) {
+    const ssd1306_rect_t *c = &acc->dst->clip;
+    if (y < c->y0 || y > c->y1) {
+        return;
+    }
+    if (x0 < c->x0) {
+        x0 = c->x0;
+    }
+    if (x1 > c->x1) {
+        x1 = c->x1;
+    }
+    if (x0 > x1) {
+        return;
+    }
+
+    if (y / 8 != acc->page) {
+        acc_flush(acc);
+        acc->page = y / 8;
+    }
+    uint8_t bit = 0x1 << (y % 8);
+    for (int16_t x = x0; x <= x1; x++) {
+        acc->masks[x] |= bit;
+    }
+    if (x0 < acc->x0) {
+        acc->x0 = x0;
+    }
+    if (x1 > acc->x1) {
+        acc->x1 = x1;
+    }
+}
+
+/* largest ellipse radius; keeps the midpoint decision values in 32 bits */
+#define MAX_RADIUS 127
+
+/* record an outline pixel of an ellipse quadrant */
+static inline void quadrant_plot(uint8_t *lo, uint8_t *hi, uint8_t rx,
+        int32_t x, int32_t y) {
+    if (x > rx) {
+        x = rx;
+    }
+    if (x < lo[y]) {
+        lo[y] = x;
+    }
+    if (x > hi[y]) {
+        hi[y] = x;
+    }
+}
+
+/*
+ * quarter of an ellipse outline (midpoint algorithm)
+ *
+ * For each row dy = 0..ry away from the centre, sets lo[dy]..hi[dy] to the
+ * columns (counted from the centre) that the outline covers on that row.
+ * hi[] never increases with dy.
+ */
+static void ellipse_quadrant(uint8_t rx, uint8_t ry, uint8_t *lo,
+        uint8_t *hi) {
+    if (rx == 0 || ry == 0) {
+        /* degenerate: a horizontal or vertical line */
+        for (uint8_t i = 0; i <= ry; i++) {
+            lo[i] = 0;
+            hi[i] = rx;
         }
+        return;
+    }
+    for (uint8_t i = 0; i <= ry; i++) {
+        lo[i] = 0xFF;
+        hi[i] = 0;
     }
+
+    int32_t rx2 = rx * rx;
+    int32_t ry2 = ry * ry;
+    int32_t x = 0;
+    int32_t y = ry;
+    int32_t px = 0; /* 2 * ry2 * x */
+    int32_t py = 2 * rx2 * y; /* 2 * rx2 * y */
+
+    /* region 1: slope above -1, step in x (decisions are scaled by 4) */
+    int32_t d = 4 * ry2 - 4 * rx2 * ry + rx2;
+    while (px < py) {
+        quadrant_plot(lo, hi, rx, x, y);
+        x++;
+        px += 2 * ry2;
+        if (d < 0) {
+            d += 4 * (ry2 + px);
+        } else {
+            y--;
+            py -= 2 * rx2;
+            d += 4 * (ry2 + px - py);
+        }
+    }
+
+    /* region 2: slope below -1, step in y */
+    d = ry2 * (2 * x + 1) * (2 * x + 1) + 4 * rx2 * (y - 1) * (y - 1)
+        - 4 * rx2 * ry2;
+    while (y >= 0) {
+        quadrant_plot(lo, hi, rx, x, y);
+        y--;
+        py -= 2 * rx2;
+        if (d > 0) {
+            d += 4 * (rx2 - py);
+        } else {
+            x++;
+            px += 2 * ry2;
+            d += 4 * (rx2 - py + px);
+        }
+    }
+
+    /* flat ellipses can finish region 2 short of the end of the axis */
+    hi[0] = rx;
 }
 
-/* draw line with m <= 1 (helper function) */
-static void draw_line_small_slope(uint8_t x0, uint8_t y0,
-        uint8_t x1, uint8_t y1, pixel_t color) {
-    int32_t dx = x1 - x0;
-    int32_t dy = y1 - y0;
-    int32_t error = 0;
-    int32_t ystep = 1;
-    uint8_t y = y0;
-    if (dy < 0) {
-        ystep = -1;
-        dy = -dy;
-    }
-    int32_t a = 2 * dy - dx;
-    for (uint8_t x = x0; x <= x1; x++) {
-        ssd1306_draw_pixel(x, y, color);
-        if (2 * error + a < 0) {
-            error += dy;
+/* draw the outline of an ellipse (midpoint algorithm) */
+void draw_ellipse(surface_t *dst, uint8_t x, uint8_t y, uint8_t rx,
+        uint8_t ry, pixel_t color) {
+    const ssd1306_rect_t *c = &dst->clip;
+    if (rx > MAX_RADIUS || ry > MAX_RADIUS || color > PIXEL_TOGGLE
+            || clip_empty(c)) {
+        return;
+    }
+    uint8_t lo[MAX_RADIUS + 1]; /* 256 bytes of stack with hi[] */
+    uint8_t hi[MAX_RADIUS + 1];
+    ellipse_quadrant(rx, ry, lo, hi);
+
+    int16_t cx = dst->viewport.x0 + x;
+    int16_t cy = dst->viewport.y0 + y;
+    int16_t top = cy - ry > c->y0 ? cy - ry : c->y0;
+    int16_t bottom = cy + ry < c->y1 ? cy + ry : c->y1;
+
+    /* one or two spans per row, mirrored about the centre */
+    span_acc_t acc;
+    acc_init(&acc, dst, color);
+    for (int16_t row = top; row <= bottom; row++) {
+        uint8_t dy = row < cy ? cy - row : row - cy;
+        if (lo[dy] == 0) {
+            acc_span(&acc, cx - hi[dy], cx + hi[dy], row);
         } else {
-            error += dy - dx;
-            y += ystep;
+            acc_span(&acc, cx - hi[dy], cx - lo[dy], row);
+            acc_span(&acc, cx + lo[dy], cx + hi[dy], row);
         }
     }
+    acc_flush(&acc);
 }
 
-/* draw line with m > 1 (helper function) */
-static void draw_line_large_slope(uint8_t x0, uint8_t y0,
-        uint8_t x1, uint8_t y1, pixel_t color) {
-    int32_t dx = x1 - x0;
-    int32_t dy = y1 - y0;
-    int32_t error = 0;
-    int32_t xstep = 1;
-    uint8_t x = x0;
-    if (dx < 0) {
-        xstep = -1;
-        dx = -dx;
-    }
-    int32_t a = 2 * dx - dy;
-    for (uint8_t y = y0; y <= y1; y++) {
-        ssd1306_draw_pixel(x, y, color);
-        if (2 * error + a < 0) {
-            error += dx;
+/* draw a filled ellipse */
+void fill_ellipse(surface_t *dst, uint8_t x, uint8_t y, uint8_t rx,
+        uint8_t ry, pixel_t color) {
+    const ssd1306_rect_t *c = &dst->clip;
+    if (rx > MAX_RADIUS || ry > MAX_RADIUS || color > PIXEL_TOGGLE
+            || clip_empty(c)) {
+        return;
+    }
+    uint8_t height[MAX_RADIUS + 1]; /* 256 bytes of stack with hi[] */
+    uint8_t hi[MAX_RADIUS + 1];
+    ellipse_quadrant(rx, ry, height, hi);
+
+    /* half height of each column: the last row whose outline reaches it */
+    uint8_t dy = ry;
+    for (uint8_t dx = 0; dx <= rx; dx++) {
+        while (hi[dy] < dx) {
+            dy--;
+        }
+        height[dx] = dy;
+    }
+
+    /* one vertical span per column */
+    int16_t cx = dst->viewport.x0 + x;
+    int16_t cy = dst->viewport.y0 + y;
+    int16_t left = cx - rx > c->x0 ? cx - rx : c->x0;
+    int16_t right = cx + rx < c->x1 ? cx + rx : c->x1;
+    for (int16_t col = left; col <= right; col++) {
+        uint8_t h = height[col < cx ? cx - col : col - cx];
+        int16_t y0 = cy - h > c->y0 ? cy - h : c->y0;
+        int16_t y1 = cy + h < c->y1 ? cy + h : c->y1;
+        if (y0 <= y1) {
+            surface_vspan_unchecked(dst, col, y0, y1, color);
+        }
+    }
+}
+
+/* draw the outline of a circle */
+void draw_circle(surface_t *dst, uint8_t x, uint8_t y, uint8_t r,
+        pixel_t color) {
+    draw_ellipse(dst, x, y, r, r, color);
+}
+
+/* draw a filled circle */
+void fill_circle(surface_t *dst, uint8_t x, uint8_t y, uint8_t r,
+        pixel_t color) {
+    fill_ellipse(dst, x, y, r, r, color);
+}
+
+/* Bresenham walk along a polygon edge, top to bottom, a row at a time */
+typedef struct {
+    int16_t x; /* next pixel */
+    int16_t y;
+    int16_t x1; /* last pixel */
+    int16_t y1;
+    int16_t dx; /* |x1 - x0| */
+    int16_t dy; /* -(y1 - y0) */
+    int16_t sx; /* x step */
+    int16_t err;
+} edge_walk_t;
+
+static void walk_init(edge_walk_t *w, int16_t x0, int16_t y0, int16_t x1,
+        int16_t y1) {
+    if (y0 > y1) {
+        int16_t t = x0;
+        x0 = x1;
+        x1 = t;
+        t = y0;
+        y0 = y1;
+        y1 = t;
+    }
+    w->x = x0;
+    w->y = y0;
+    w->x1 = x1;
+    w->y1 = y1;
+    w->dx = x1 > x0 ? x1 - x0 : x0 - x1;
+    w->dy = y0 - y1;
+    w->sx = x0 < x1 ? 1 : -1;
+    w->err = w->dx + w->dy;
+}
+
+/* columns xa..xb of the edge on the walk's current row; moves to the next */
+static void walk_row(edge_walk_t *w, int16_t *xa, int16_t *xb) {
+    int16_t row = w->y;
+    *xa = w->x;
+    *xb = w->x;
+    while (w->y == row) {
+        if (w->x < *xa) {
+            *xa = w->x;
+        }
+        if (w->x > *xb) {
+            *xb = w->x;
+        }
+        if (w->x == w->x1 && w->y == w->y1) {
+            w->y++; /* finished */
+            break;
+        }
+        int16_t e2 = 2 * w->err;
+        if (e2 >= w->dy) {
+            w->err += w->dy;
+            w->x += w->sx;
+        }
+        if (e2 <= w->dx) {
+            w->err += w->dx;
+            w->y++;
+        }
+    }
+}
+
+/* draw the outline of a closed polygon */
+void draw_polygon(surface_t *dst, const point_t *points, uint8_t n,
+        pixel_t color) {
+    const ssd1306_rect_t *c = &dst->clip;
+    if (n == 0 || n > POLYGON_MAX_VERTICES || color > PIXEL_TOGGLE
+            || clip_empty(c)) {
+        return;
+    }
+
+    edge_walk_t walks[POLYGON_MAX_VERTICES];
+    int16_t top = INT16_MAX;
+    int16_t bottom = INT16_MIN;
+    for (uint8_t i = 0; i < n; i++) {
+        const point_t *a = &points[i];
+        const point_t *b = &points[i + 1 < n ? i + 1 : 0];
+        walk_init(&walks[i], dst->viewport.x0 + a->x, dst->viewport.y0 + a->y,
+                dst->viewport.x0 + b->x, dst->viewport.y0 + b->y);
+        if (walks[i].y < top) {
+            top = walks[i].y;
+        }
+        if (walks[i].y1 > bottom) {
+            bottom = walks[i].y1;
+        }
+    }
+    if (bottom > c->y1) {
+        bottom = c->y1;
+    }
+
+    /* every edge's pixels on each row, row by row */
+    span_acc_t acc;
+    acc_init(&acc, dst, color);
+    for (int16_t row = top; row <= bottom; row++) {
+        for (uint8_t i = 0; i < n; i++) {
+            if (walks[i].y == row && row <= walks[i].y1) {
+                int16_t xa;
+                int16_t xb;
+                walk_row(&walks[i], &xa, &xb);
+                acc_span(&acc, xa, xb, row);
+            }
+        }
+    }
+    acc_flush(&acc);
+}
+
+/* polygon edge in the scanline fill's edge table */
+typedef struct {
+    int16_t y0; /* first row whose centre the edge crosses */
+    int16_t y1; /* row below the last one */
+    int16_t x0; /* top end */
+    int16_t dx;
+    int16_t dy; /* > 0 */
+    int16_t x; /* crossing on the current row: x + num / dy */
+    int16_t num;
+} edge_t;
+
+/* division rounding towards minus infinity (d > 0) */
+static inline int32_t floor_div(int32_t n, int32_t d) {
+    return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+/* draw a filled polygon (even-odd rule) */
+void fill_polygon(surface_t *dst, const point_t *points, uint8_t n,
+        pixel_t color) {
+    const ssd1306_rect_t *c = &dst->clip;
+    if (n < 3 || n > POLYGON_MAX_VERTICES || color > PIXEL_TOGGLE
+            || clip_empty(c)) {
+        return;
+    }
+
+    /* edge table, sorted by first row; horizontal edges cross no rows */
+    edge_t edges[POLYGON_MAX_VERTICES];
+    uint8_t nedges = 0;
+    int16_t bottom = INT16_MIN;
+    for (uint8_t i = 0; i < n; i++) {
+        const point_t *a = &points[i];
+        const point_t *b = &points[i + 1 < n ? i + 1 : 0];
+        if (a->y == b->y) {
+            continue;
+        }
+        if (a->y > b->y) {
+            const point_t *t = a;
+            a = b;
+            b = t;
+        }
+        edge_t e = {
+            .y0 = dst->viewport.y0 + a->y,
+            .y1 = dst->viewport.y0 + b->y,
+            .x0 = dst->viewport.x0 + a->x,
+            .dx = b->x - a->x,
+            .dy = b->y - a->y,
+        };
+        uint8_t k = nedges++;
+        while (k > 0 && edges[k - 1].y0 > e.y0) {
+            edges[k] = edges[k - 1];
+            k--;
+        }
+        edges[k] = e;
+        if (e.y1 > bottom) {
+            bottom = e.y1;
+        }
+    }
+    if (nedges == 0) {
+        return;
+    }
+    int16_t top = edges[0].y0 > c->y0 ? edges[0].y0 : c->y0;
+    bottom = bottom - 1 < c->y1 ? bottom - 1 : c->y1;
+
+    edge_t *active[POLYGON_MAX_VERTICES];
+    uint8_t nactive = 0;
+    uint8_t next = 0;
+    span_acc_t acc;
+    acc_init(&acc, dst, color);
+    for (int16_t row = top; row <= bottom; row++) {
+        /* drop edges that ended above this row, add those that start */
+        uint8_t k = 0;
+        for (uint8_t i = 0; i < nactive; i++) {
+            if (active[i]->y1 > row) {
+                active[k++] = active[i];
+            }
+        }
+        nactive = k;
+        while (next < nedges && edges[next].y0 <= row) {
+            edge_t *e = &edges[next++];
+            if (e->y1 <= row) {
+                continue;
+            }
+            int32_t t = (int32_t) (row - e->y0) * e->dx;
+            int32_t q = floor_div(t, e->dy);
+            e->x = e->x0 + q;
+            e->num = t - q * e->dy;
+            active[nactive++] = e;
+        }
+
+        /* first pixel right of each crossing, sorted */
+        int16_t xs[POLYGON_MAX_VERTICES];
+        for (uint8_t i = 0; i < nactive; i++) {
+            int16_t x = active[i]->x + (active[i]->num > 0);
+            uint8_t j = i;
+            while (j > 0 && xs[j - 1] > x) {
+                xs[j] = xs[j - 1];
+                j--;
+            }
+            xs[j] = x;
+        }
+        /* inside between each pair of crossings */
+        for (uint8_t i = 0; i + 1 < nactive; i += 2) {
+            if (xs[i] < xs[i + 1]) {
+                acc_span(&acc, xs[i], xs[i + 1] - 1, row);
+            }
+        }
+
+        /* move the crossings down a row */
+        for (uint8_t i = 0; i < nactive; i++) {
+            edge_t *e = active[i];
+            e->num += e->dx;
+            while (e->num >= e->dy) {
+                e->num -= e->dy;
+                e->x++;
+            }
+            while (e->num < 0) {
+                e->num += e->dy;
+                e->x--;
+            }
+        }
+    }
+    acc_flush(&acc);
+}
+
+/* draw the outline of a triangle */
+void draw_triangle(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1, uint8_t x2, uint8_t y2, pixel_t color) {
+    point_t points[3] = { { x0, y0 }, { x1, y1 }, { x2, y2 } };
+    draw_polygon(dst, points, 3, color);
+}
+
+/* draw a filled triangle */
+void fill_triangle(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1, uint8_t x2, uint8_t y2, pixel_t color) {
+    point_t points[3] = { { x0, y0 }, { x1, y1 }, { x2, y2 } };
+    fill_polygon(dst, points, 3, color);
+}
+
+/* columns changed in a page, for marking it dirty once (none if x0 > x1) */
+typedef struct {
+    uint8_t x0;
+    uint8_t x1;
+} changed_t;
+
+static inline void changed_add(changed_t *c, uint8_t x0, uint8_t x1) {
+    if (x0 < c->x0) {
+        c->x0 = x0;
+    }
+    if (x1 > c->x1) {
+        c->x1 = x1;
+    }
+}
+
+static inline void mark_changed(surface_t *dst, const changed_t *c,
+        uint8_t p) {
+    if (c->x0 <= c->x1) {
+        surface_mark_dirty_column(dst, c->x0, p);
+        surface_mark_dirty_column(dst, c->x1, p);
+    }
+}
+
+/*
+ * combine n source bytes into page row from column x
+ *
+ * The source bytes are src[i] (or value, if src is NULL), masked by msrc[i]
+ * for BLEND_MASKED (if not NULL), limited to the rows in rows, and moved
+ * down by shift rows (up by -shift) onto this page.
+ */
+static void blit_bytes(uint8_t *row, uint8_t x, const uint8_t *src,
+        uint8_t value, const uint8_t *msrc, uint8_t n, uint8_t rows,
+        int8_t shift, blend_t op, changed_t *changed) {
+    uint8_t down = 8 - shift; /* b << shift, or b >> -shift, as one shift */
+    uint8_t mask = ((uint16_t) rows << 8) >> down;
+    if (mask == 0) {
+        return;
+    }
+    row += x;
+    if (op != BLEND_MASKED) {
+        msrc = NULL;
+    }
+
+    /* whole page bytes: copied, or set, as they are */
+    if ((op == BLEND_COPY || (op == BLEND_MASKED && !msrc)) && mask == 0xFF) {
+        uint8_t diff = 0;
+        if (src) {
+            for (uint8_t i = 0; i < n; i++) {
+                diff |= row[i] ^ src[i];
+                row[i] = src[i];
+            }
         } else {
-            error += dx - dy;
-            x += xstep;
+            for (uint8_t i = 0; i < n; i++) {
+                diff |= row[i] ^ value;
+                row[i] = value;
+            }
+        }
+        if (diff) {
+            changed_add(changed, x, x + n - 1);
+        }
+        return;
+    }
+
+    /*
+     * new = (old & keep) ^ flip, for every op: rows outside the mask m are
+     * kept; inside it, COPY and MASKED keep nothing, OR and AND_NOT keep the
+     * source's unset pixels, AND its set pixels, and XOR all of them; AND and
+     * AND_NOT flip nothing
+     */
+    uint8_t keep_set = (op == BLEND_AND || op == BLEND_XOR) ? 0xFF : 0x00;
+    uint8_t keep_unset = (op == BLEND_OR || op == BLEND_XOR
+            || op == BLEND_AND_NOT) ? 0xFF : 0x00;
+    uint8_t flip_set = (op == BLEND_AND || op == BLEND_AND_NOT) ? 0x00 : 0xFF;
+    uint8_t first = 0xFF;
+    uint8_t last = 0;
+    if (!src) {
+        /* a repeat: the same keep and flip for every byte */
+        uint8_t b = (((uint16_t) value << 8) >> down) & mask;
+        uint8_t keep = (uint8_t) ~mask | (b & keep_set)
+            | (~b & mask & keep_unset);
+        uint8_t flip = b & flip_set;
+        for (uint8_t i = 0; i < n; i++) {
+            uint8_t d = (row[i] & keep) ^ flip;
+            if (d != row[i]) {
+                row[i] = d;
+                if (first == 0xFF) {
+                    first = i;
+                }
+                last = i;
+            }
+        }
+    }
+    for (uint8_t i = 0; src && i < n; i++) {
+        uint8_t m = msrc ? (((uint16_t) msrc[i] << 8) >> down) & mask : mask;
+        uint8_t b = (((uint16_t) src[i] << 8) >> down) & m;
+        uint8_t keep = (uint8_t) ~m | (b & keep_set) | (~b & m & keep_unset);
+        uint8_t d = (row[i] & keep) ^ (b & flip_set);
+        if (d != row[i]) {
+            row[i] = d;
+            if (first == 0xFF) {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    if (first != 0xFF) {
+        changed_add(changed, x + first, x + last);
+    }
+}
+
+/* page format source of a blit */
+typedef struct {
+    const uint8_t *data;
+    const uint8_t *mask; /* or NULL */
+    uint8_t stride; /* bytes from one page to the next */
+    uint8_t width;
+    uint8_t height;
+} blit_src_t;
+
+/* copy a rectangle of page format pixels, top left pixel at (x, y) */
+static void blit_pages(surface_t *dst, const blit_src_t *src, uint8_t sx,
+        uint8_t sy, uint8_t w, uint8_t h, uint8_t x, uint8_t y, blend_t op) {
+    const ssd1306_rect_t *c = &dst->clip;
+    if (sx >= src->width || sy >= src->height || w == 0 || h == 0
+            || op > BLEND_MASKED || clip_empty(c)) {
+        return;
+    }
+    if (w > src->width - sx) {
+        w = src->width - sx;
+    }
+    if (h > src->height - sy) {
+        h = src->height - sy;
+    }
+
+    /* destination rectangle, trimmed to the clip rectangle */
+    int16_t dx = dst->viewport.x0 + x;
+    int16_t dy = dst->viewport.y0 + y;
+    int16_t x0 = dx > c->x0 ? dx : c->x0;
+    int16_t x1 = dx + w - 1 < c->x1 ? dx + w - 1 : c->x1;
+    int16_t y0 = dy > c->y0 ? dy : c->y0;
+    int16_t y1 = dy + h - 1 < c->y1 ? dy + h - 1 : c->y1;
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+
+    /* source row r is surface row r + delta, s rows into its page */
+    int16_t delta = dy - sy;
+    uint8_t s = delta & 0x7;
+    int16_t r0 = y0 - delta;
+    int16_t r1 = y1 - delta;
+    uint16_t col = sx + (x0 - dx);
+    uint8_t n = x1 - x0 + 1;
+    for (int16_t q = r0 / 8; q <= r1 / 8; q++) {
+        /* rows of source page q inside the rectangle */
+        uint8_t rows = 0xFF;
+        if (q * 8 < r0) {
+            rows &= 0xFF << (r0 - q * 8);
+        }
+        if (q * 8 + 7 > r1) {
+            rows &= 0xFF >> (q * 8 + 7 - r1);
+        }
+
+        const uint8_t *data = &src->data[q * src->stride + col];
+        const uint8_t *mask = src->mask ? &src->mask[q * src->stride + col]
+            : NULL;
+        int16_t p = (q * 8 + delta - s) / 8;
+        if (p >= 0) {
+            changed_t changed = { 0xFF, 0 };
+            blit_bytes(&dst->buffer[p * dst->stride], x0, data, 0, mask,
+                    n, rows, s, op, &changed);
+            mark_changed(dst, &changed, p);
+        }
+        if (s && p + 1 < (dst->height + 7) / 8) {
+            changed_t changed = { 0xFF, 0 };
+            blit_bytes(&dst->buffer[(p + 1) * dst->stride], x0, data, 0,
+                    mask, n, rows, s - 8, op, &changed);
+            mark_changed(dst, &changed, p + 1);
         }
     }
 }
 
+/* copy a rectangle of a bitmap, top left pixel at (x, y) */
+void blit(surface_t *dst, const bitmap_t *src, uint8_t sx, uint8_t sy,
+        uint8_t w, uint8_t h, uint8_t x, uint8_t y, blend_t op) {
+    const blit_src_t pages = {
+        src->data, src->mask, src->width, src->width, src->height
+    };
+    blit_pages(dst, &pages, sx, sy, w, h, x, y, op);
+}
+
+/* copy a rectangle of one surface to another, top left pixel at (x, y) */
+void blit_surface(surface_t *dst, const surface_t *src, uint8_t sx,
+        uint8_t sy, uint8_t w, uint8_t h, uint8_t x, uint8_t y, blend_t op) {
+    const blit_src_t pages = {
+        src->buffer, NULL, src->stride, src->width, src->height
+    };
+    blit_pages(dst, &pages, sx, sy, w, h, x, y, op);
+}
+
+/* run-length decoder state */
+typedef struct {
+    const uint8_t *data; /* next control byte */
+    const uint8_t *literal; /* rest of the current literal run, or NULL */
+    uint8_t value; /* byte of the current repeat run */
+    uint8_t left; /* bytes left in the current run */
+} rle_reader_t;
+
 /*
- * draw line from (x0, y0) to (x1, y1)
- * Uses Bresenham's algorithm, see:
- * https://www.cs.helsinki.fi/group/goa/mallinnus/lines/bresenh.html
- * https://www.en.wikipedia.org/wiki/Bresenham%27s_line_algorithm
+ * next piece of the current run, max bytes at most
+ *
+ * Returns its length. *bytes points to the literal bytes, or is NULL for
+ * repeats of r->value.
  */
-void draw_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, pixel_t color) {
-    if (abs(y1 - y0) > abs(x1 - x0)) {
-        /* large slope: 1 < m < inf */
-        if (y1 > y0) {
-            /* iterate y0 -> y1 */
-            draw_line_large_slope(x0, y0, x1, y1, color);
+static uint8_t rle_next(rle_reader_t *r, uint8_t max, const uint8_t **bytes) {
+    if (r->left == 0) {
+        uint8_t c = *r->data++;
+        if (c < IMAGE_RLE_REPEAT) {
+            r->left = c + 1;
+            r->literal = r->data;
+            r->data += r->left;
         } else {
-            /* iterate y1 -> y0 */
-            draw_line_large_slope(x1, y1, x0, y0, color);
+            r->left = c - IMAGE_RLE_REPEAT + IMAGE_RLE_MIN_REPEAT;
+            r->literal = NULL;
+            r->value = *r->data++;
         }
-    } else {
-        /* small slope: 0 <= m <= 1 */
-        if (x1 > x0) {
-            /* iterate x0 -> x1 */
-            draw_line_small_slope(x0, y0, x1, y1, color);
+    }
+
+    uint8_t n = r->left < max ? r->left : max;
+    *bytes = r->literal;
+    if (r->literal) {
+        r->literal += n;
+    }
+    r->left -= n;
+    return n;
+}
+
+/*
+ * set n bytes to v, a word at a time where aligned (as the framebuffer's bulk
+ * operations are)
+ *
+ * Returns non-zero if any of them changed
+ */
+static uint32_t fill_bytes(uint8_t *d, uint8_t v, uint8_t n) {
+    uint32_t diff = 0;
+    while (n && ((uintptr_t) d & 0x3)) {
+        diff |= *d ^ v;
+        *d++ = v;
+        n--;
+    }
+    uint32_t v4 = v * 0x01010101U;
+    for (; n >= 4; n -= 4, d += 4) {
+        uint32_t *w = (uint32_t *) d;
+        diff |= *w ^ v4;
+        *w = v4;
+    }
+    while (n--) {
+        diff |= *d ^ v;
+        *d++ = v;
+    }
+    return diff;
+}
+
+/*
+ * decode one image page straight into a page row, where the decoded bytes
+ * replace the row's: the rows line up with the page, all of them are drawn,
+ * and op copies (BLEND_COPY, or BLEND_MASKED without a mask)
+ *
+ * Literal runs are copied and repeats filled a run at a time, with no
+ * shifting or masking; a run is marked changed only if a byte of it changed.
+ *
+ * row:    the page row under image column 0, which is surface column x
+ * i0, i1: image columns inside the clip rectangle
+ */
+static void rle_copy_page(rle_reader_t *r, uint8_t *row, uint8_t w,
+        uint8_t i0, uint8_t i1, uint8_t x, changed_t *changed) {
+    for (uint8_t i = 0; i < w; ) {
+        const uint8_t *bytes;
+        uint8_t n = rle_next(r, w - i, &bytes);
+        uint8_t a = i > i0 ? i : i0;
+        uint8_t b = i + n - 1 < i1 ? i + n - 1 : i1;
+        i += n;
+        if (a > b) {
+            continue;
+        }
+
+        uint8_t len = b - a + 1;
+        uint8_t *d = &row[a];
+        uint32_t diff = 0;
+        if (bytes) {
+            const uint8_t *src = bytes + (a - (i - n));
+            for (uint8_t k = 0; k < len; k++) {
+                diff |= d[k] ^ src[k];
+                d[k] = src[k];
+            }
         } else {
-            /* iterate x1 -> x0 */
-            draw_line_small_slope(x1, y1, x0, y0, color);
+            diff = fill_bytes(d, r->value, len);
+        }
+        if (diff) {
+            changed_add(changed, x + a, x + b);
         }
     }
 }
 
-/* draw one 8x8 character, top left pixel at (x, y) */
-void draw_character(char c, uint8_t x, uint8_t y, pixel_t color) {
-    for (uint8_t row = 0; row < 8; row++) {
-        uint8_t pixels = font8x8_basic[(size_t) c][row];
-        for (uint8_t col = 0; col < 8; col++) {
-            if ((pixels >> col) & 0x1) {
-                ssd1306_draw_pixel(x + col, y + row, color);
+/* draw an image, top left pixel at (x, y) */
+void draw_bitmap(surface_t *dst, const image_t *image, uint8_t x, uint8_t y,
+        blend_t op) {
+    const ssd1306_rect_t *c = &dst->clip;
+    uint8_t w = image->width;
+    uint8_t h = image->height;
+    int16_t ix = dst->viewport.x0 + x;
+    int16_t iy = dst->viewport.y0 + y;
+    if (clip_empty(c) || w == 0 || h == 0 || op > BLEND_MASKED
+            || ix > c->x1 || iy > c->y1 || ix + w - 1 < c->x0
+            || iy + h - 1 < c->y0) {
+        return;
+    }
+
+    /* image columns inside the clip rectangle */
+    uint8_t i0 = ix < c->x0 ? c->x0 - ix : 0;
+    uint8_t i1 = ix + w - 1 > c->x1 ? c->x1 - ix : w - 1;
+
+    /* image page k lands on surface pages p and p + 1, s rows down */
+    uint8_t s = iy % 8;
+    bool whole_bytes = op == BLEND_COPY || op == BLEND_MASKED;
+    uint8_t pages = (h + 7) / 8;
+    rle_reader_t rle = { .data = image->data };
+    for (uint8_t k = 0; k < pages; k++) {
+        int16_t top = iy + 8 * k;
+        uint8_t p = top / 8;
+        if (top > c->y1) {
+            break; /* the rest of the image is below the clip */
+        }
+
+        /* rows of this image page inside the image and the clip */
+        uint8_t rows = 0xFF;
+        if (k == pages - 1 && h % 8) {
+            rows >>= 8 - h % 8;
+        }
+        if (top + 7 < c->y0) {
+            rows = 0;
+        } else if (top < c->y0) {
+            rows &= 0xFF << (c->y0 - top);
+        }
+        if (top + 7 > c->y1) {
+            rows &= 0xFF >> (top + 7 - c->y1);
+        }
+
+        uint8_t *upper = &dst->buffer[p * dst->stride];
+        uint8_t *lower = upper + dst->stride;
+        changed_t changed_upper = { 0xFF, 0 };
+        changed_t changed_lower = { 0xFF, 0 };
+        if (whole_bytes && s == 0 && rows == 0xFF) {
+            rle_copy_page(&rle, upper + ix, w, i0, i1, ix, &changed_upper);
+            mark_changed(dst, &changed_upper, p);
+            continue;
+        }
+        for (uint8_t i = 0; i < w; ) {
+            const uint8_t *bytes;
+            uint8_t n = rle_next(&rle, w - i, &bytes);
+            uint8_t a = i > i0 ? i : i0;
+            uint8_t b = i + n - 1 < i1 ? i + n - 1 : i1;
+            if (rows && a <= b) {
+                const uint8_t *src = bytes ? bytes + (a - i) : NULL;
+                blit_bytes(upper, ix + a, src, rle.value, NULL, b - a + 1,
+                        rows, s, op, &changed_upper);
+                if (s) {
+                    blit_bytes(lower, ix + a, src, rle.value, NULL, b - a + 1,
+                            rows, s - 8, op, &changed_lower);
+                }
             }
+            i += n;
         }
+
+        mark_changed(dst, &changed_upper, p);
+        mark_changed(dst, &changed_lower, p + 1);
+    }
+}
+
+/* draw one 8x8 character, top left pixel at (x, y), with blit() */
+void draw_character(surface_t *dst, char c, uint8_t x, uint8_t y,
+        pixel_t color) {
+    static const blend_t ops[] = { BLEND_AND_NOT, BLEND_OR, BLEND_XOR };
+    if (color > PIXEL_TOGGLE) {
+        return;
     }
+    /* glyph columns are page bytes */
+    const bitmap_t glyph = { 8, 8, font8x8_columns[(uint8_t) c & 0x7F], NULL };
+    blit(dst, &glyph, 0, 0, 8, 8, x, y, ops[color]);
 }
 
 #define CHAR_HEIGHT 8U
@@ -151,10 +1229,11 @@ void draw_character(char c, uint8_t x, uint8_t y, pixel_t color) {
  * x1 = x0 + 4 + 8*chars_in_longest_line
  * y1 = y0 + 4 + 8*number_of_lines + 2*(number_of_lines - 1)
  */
-void draw_textbox(char *s, uint32_t nchars, uint32_t x0, uint32_t y0,
-        uint32_t x1, uint32_t y1, pixel_t bgcolor, pixel_t fgcolor) {
+void draw_textbox(surface_t *dst, char *s, uint32_t nchars, uint32_t x0,
+        uint32_t y0, uint32_t x1, uint32_t y1, pixel_t bgcolor,
+        pixel_t fgcolor) {
 
-    draw_rectangle(x0, y0, x1, y1, bgcolor);
+    draw_rectangle(dst, x0, y0, x1, y1, bgcolor);
 
     uint8_t x = x0 + XPAD;
     uint8_t y = y0 + YPAD;
@@ -170,11 +1249,13 @@ void draw_textbox(char *s, uint32_t nchars, uint32_t x0, uint32_t y0,
                 continue;
             }
         }
-        if (y + CHAR_HEIGHT + YPAD > y1) {
+        if (y + CHAR_HEIGHT + YPAD > y1
+                || dst->viewport.y0 + y > dst->clip.y1) {
+            /* out of room, or the rest is below the clip rectangle */
             break;
         }
 
-        draw_character(*s++, x, y, fgcolor);
+        draw_character(dst, *s++, x, y, fgcolor);
         x += CHAR_WIDTH;
         n++;
     }
@@ -5,21 +5,51 @@
  * Graphics drawing functions for SSD1306 display
  *
  * unimplemented functions (ideas):
- * - draw_circle()
- * - draw_triangle()
- * - draw_polygon()
- * - fill_shape()
  * - textbox with and without parameters (have a sane default option)
+ *
+ * Every function draws into a surface_t: a display's framebuffer
+ * (ssd1306_surface()), or an off-screen canvas (surface_init()) that widgets
+ * can be rendered into once and then composited with blit_surface().
+ *
+ * Coordinates are relative to the top left corner of the surface's viewport
+ * (the whole surface by default), and drawing is limited to the clip
+ * rectangle. Each function trims its shape to the clip rectangle once, up
+ * front, so the pixel loops run without bounds checks, and shapes that are
+ * mostly off-screen cost only what is visible.
  */
 
-/* fill framebuffer with solid color (PIXEL_OFF, PIXEL_ON, or PIXEL_TOGGLE) */
-void fill_display(pixel_t color);
+/*
+ * set the area of the surface that the drawing functions draw into
+ *
+ * (x0, y0) becomes the origin of their coordinates, so widgets can be drawn
+ * in local coordinates. Also resets the clip rectangle to the viewport.
+ *
+ * x0, y0: top left corner, in surface coordinates
+ * x1, y1: bottom right corner, in surface coordinates
+ */
+void set_viewport(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1);
 
-/* draw an 8px * 8px checkerboard to framebuffer */
-void draw_checkerboard(void);
+/* make the viewport the whole surface, and remove the clip rectangle */
+void reset_viewport(surface_t *dst);
 
 /*
- * draw a rectangle to the framebuffer
+ * limit drawing to a rectangle of the viewport
+ *
+ * x0, y0: top left corner, in viewport coordinates
+ * x1, y1: bottom right corner, in viewport coordinates
+ */
+void set_clip(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1);
+
+/* fill the clip rectangle with solid color (PIXEL_OFF, ON, or TOGGLE) */
+void fill_display(surface_t *dst, pixel_t color);
+
+/* draw an 8px * 8px checkerboard to the clip rectangle */
+void draw_checkerboard(surface_t *dst);
+
+/*
+ * draw a rectangle
  *
  * x0:    left-most x coordinate of box
  * y0:    upper-most y coordinate of box
@@ -27,18 +57,182 @@ void draw_checkerboard(void);
  * y1:    lower-most y coordinate of box
  * color: color of rectangle (PIXEL_OFF, PIXEL_ON, PIXEL_TOGGLE)
  */
-void draw_rectangle(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1,
-        pixel_t color);
+void draw_rectangle(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1, pixel_t color);
 
 /*
  * draw line from (x0, y0) to (x1, y1)
  * Uses Bresenham's algorithm, see:
  * https://www.cs.helsinki.fi/group/goa/mallinnus/lines/bresenh.html
  */
-void draw_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, pixel_t color);
+void draw_line(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1,
+        pixel_t color);
+
+/*
+ * Shapes
+ *
+ * Shapes are rasterized into spans with integer arithmetic only. Filled
+ * ellipses and circles are written as one vertical span per column, which is
+ * one masked byte per page. Outlines and polygons are collected a page at a
+ * time, so each column of each page is written once and no pixel is drawn
+ * twice: PIXEL_TOGGLE inverts every pixel of a shape exactly once.
+ *
+ * They work in tables on the stack rather than in static memory: the ellipse
+ * functions keep the outline of a quadrant (256 bytes), and outlines and
+ * polygons a page of column masks (SURFACE_MAX_WIDTH bytes) and their edges.
+ * The stack use given for each is on the Cortex-M0.
+ */
 
-/* draw one 8x8 character, top left pixel at (x, y) */
-void draw_character(char c, uint8_t x, uint8_t y, pixel_t color);
+/* vertex of a polygon */
+typedef struct {
+    uint8_t x;
+    uint8_t y;
+} point_t;
+
+/* most vertices in a polygon */
+#define POLYGON_MAX_VERTICES 16
+
+/*
+ * draw the outline of an ellipse (midpoint algorithm)
+ *
+ * Uses about 430 bytes of stack.
+ *
+ * x, y:   centre
+ * rx, ry: horizontal and vertical radius, 127 at most
+ */
+void draw_ellipse(surface_t *dst, uint8_t x, uint8_t y, uint8_t rx,
+        uint8_t ry, pixel_t color);
+
+/*
+ * draw a filled ellipse; the outline from draw_ellipse() is its edge
+ *
+ * Uses about 300 bytes of stack.
+ */
+void fill_ellipse(surface_t *dst, uint8_t x, uint8_t y, uint8_t rx,
+        uint8_t ry, pixel_t color);
+
+/* draw the outline of a circle of radius r (127 at most) centred at (x, y) */
+void draw_circle(surface_t *dst, uint8_t x, uint8_t y, uint8_t r,
+        pixel_t color);
+
+/* draw a filled circle; the outline from draw_circle() is its edge */
+void fill_circle(surface_t *dst, uint8_t x, uint8_t y, uint8_t r,
+        pixel_t color);
+
+/*
+ * draw the outline of a closed polygon
+ *
+ * Each edge is drawn as a line; where edges meet or cross, pixels are drawn
+ * once. Uses about 430 bytes of stack.
+ *
+ * points: vertices, in order
+ * n:      number of vertices (POLYGON_MAX_VERTICES at most)
+ */
+void draw_polygon(surface_t *dst, const point_t *points, uint8_t n,
+        pixel_t color);
+
+/*
+ * draw a filled polygon (even-odd rule)
+ *
+ * A pixel is filled if its centre is inside the polygon. Centres exactly on
+ * a left or top edge are inside, on a right or bottom edge outside, so
+ * polygons that share an edge neither overlap nor leave a gap between them.
+ * Uses about 500 bytes of stack.
+ *
+ * points: vertices, in order; the polygon may be concave or self-intersecting
+ * n:      number of vertices (POLYGON_MAX_VERTICES at most)
+ */
+void fill_polygon(surface_t *dst, const point_t *points, uint8_t n,
+        pixel_t color);
+
+/* draw the outline of a triangle */
+void draw_triangle(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1, uint8_t x2, uint8_t y2, pixel_t color);
+
+/* draw a filled triangle (fill rule as fill_polygon()) */
+void fill_triangle(surface_t *dst, uint8_t x0, uint8_t y0, uint8_t x1,
+        uint8_t y1, uint8_t x2, uint8_t y2, pixel_t color);
+
+/*
+ * Blitter
+ *
+ * Copies rectangles of pixels from page format bitmaps into a surface,
+ * at any source and destination row, a page byte at a time: each source page
+ * is shifted onto the one or two surface pages it lands on. Characters are
+ * drawn with it too.
+ */
+
+/* monochrome bitmap in page format, the layout of the framebuffer */
+typedef struct {
+    uint8_t width; /* bytes per page */
+    uint8_t height;
+    const uint8_t *data; /* page bytes, bit n being row n of the page */
+    const uint8_t *mask; /* same layout: pixels drawn by BLEND_MASKED */
+} bitmap_t;
+
+/*
+ * copy a rectangle of a bitmap, top left pixel at (x, y)
+ *
+ * src:    bitmap; without a mask, BLEND_MASKED is BLEND_COPY
+ * sx, sy: top left corner of the rectangle in the bitmap
+ * w, h:   size of the rectangle, trimmed to the bitmap
+ * op:     BLEND_COPY, BLEND_OR (set pixels are turned on), BLEND_AND (unset
+ *         pixels are turned off), BLEND_XOR (set pixels are toggled),
+ *         BLEND_AND_NOT (set pixels are turned off), or BLEND_MASKED
+ */
+void blit(surface_t *dst, const bitmap_t *src, uint8_t sx, uint8_t sy,
+        uint8_t w, uint8_t h, uint8_t x, uint8_t y, blend_t op);
+
+/*
+ * copy a rectangle of one surface to another, top left pixel at (x, y)
+ *
+ * As blit(), from a surface without a mask. sx and sy are in src's own
+ * coordinates (its viewport is ignored); src and dst must not share memory.
+ */
+void blit_surface(surface_t *dst, const surface_t *src, uint8_t sx,
+        uint8_t sy, uint8_t w, uint8_t h, uint8_t x, uint8_t y, blend_t op);
+
+/*
+ * Images
+ *
+ * Images are stored run-length encoded, as their page bytes (8 pixels of a
+ * column, least significant bit at the top) in framebuffer order: the first
+ * page from left to right, then the next page. The data is a sequence of
+ * runs, each starting with a control byte c:
+ * - c < 0x80:  c + 1 literal bytes follow
+ * - c >= 0x80: one byte follows, repeated c - 0x80 + 3 times
+ * Runs carry on from one page to the next. host/pbm2rle converts PBM images
+ * to C arrays in this format.
+ */
+
+/* run-length encoded monochrome image */
+typedef struct {
+    uint8_t width;
+    uint8_t height;
+    const uint8_t *data;
+} image_t;
+
+/* control byte of a repeat run, and the shortest and longest runs */
+#define IMAGE_RLE_REPEAT 0x80
+#define IMAGE_RLE_MIN_REPEAT 3
+#define IMAGE_RLE_MAX_REPEAT (0x7F + IMAGE_RLE_MIN_REPEAT)
+#define IMAGE_RLE_MAX_LITERAL 0x80
+
+/*
+ * draw an image, top left pixel at (x, y)
+ *
+ * The image is decoded straight into the surface. Where its rows line up
+ * with the pages, every decoded byte is one page byte, and copies write whole
+ * runs: repeats are filled a word at a time.
+ *
+ * op: as for blit(); images have no mask, so BLEND_MASKED is BLEND_COPY
+ */
+void draw_bitmap(surface_t *dst, const image_t *image, uint8_t x, uint8_t y,
+        blend_t op);
+
+/* draw one 8x8 character, top left pixel at (x, y), with blit() */
+void draw_character(surface_t *dst, char c, uint8_t x, uint8_t y,
+        pixel_t color);
 
 /*
  * draw a textbox with a solid background, filled with text (8x8 pixel chars)
@@ -56,6 +250,7 @@ void draw_character(char c, uint8_t x, uint8_t y, pixel_t color);
  * x1 = x0 + 4 + 8*chars_in_longest_line
  * y1 = y0 + 4 + 8*number_of_lines + 2*(number_of_lines - 1)
  */
-void draw_textbox(char *s, uint32_t nchars, uint32_t x0, uint32_t y0,
-        uint32_t x1, uint32_t y1, pixel_t bgcolor, pixel_t fgcolor);
+void draw_textbox(surface_t *dst, char *s, uint32_t nchars, uint32_t x0,
+        uint32_t y0, uint32_t x1, uint32_t y1, pixel_t bgcolor,
+        pixel_t fgcolor);
 #endif
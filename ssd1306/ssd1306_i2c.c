@@ -0,0 +1,187 @@
+/*
+ * I2C transport for SSD1306 displays
+ *
+ * Commands and data go out as I2C transactions on the engine in i2c.c, each
+ * starting with a control byte. Transfers only matter with
+ * SSD1306_I2C_SINGLE_TRANSACTION, which holds commands back until the data
+ * that follows them.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libopencm3/stm32/i2c.h>
+
+#include "i2c.h"
+#include "ssd1306.h"
+#include "ssd1306_transport.h"
+
+static const uint8_t control_command = CONTROL_BYTE_COMMAND;
+static const uint8_t control_data = CONTROL_BYTE_DATA;
+
+static ssd1306_bus_t bus;
+
+/* display and callback of the asynchronous write in progress */
+static ssd1306_t *async_dev;
+static ssd1306_transport_callback_t async_callback;
+
+#ifdef SSD1306_I2C_SINGLE_TRANSACTION
+/* most commands held back for the data that follows them */
+#define PENDING_COMMANDS 6
+
+/* held back commands, each behind a control byte, and room for the data's */
+static uint8_t pending[2 * PENDING_COMMANDS + 1];
+static size_t npending; /* bytes */
+static bool in_transfer;
+#endif
+
+/* set up the display's pins: nothing to do on I2C */
+static void transport_init(ssd1306_t *dev) {
+    (void) dev;
+}
+
+/* start a transfer */
+static void transport_begin(ssd1306_t *dev) {
+    (void) dev;
+#ifdef SSD1306_I2C_SINGLE_TRANSACTION
+    in_transfer = true;
+#endif
+}
+
+/* end a transfer, sending any commands still held back */
+static bool transport_end(ssd1306_t *dev) {
+    bool ret = true;
+#ifdef SSD1306_I2C_SINGLE_TRANSACTION
+    in_transfer = false;
+    if (npending) {
+        ret = i2c_write_with_header(dev->config.i2c, dev->config.addr,
+                pending, npending, NULL, 0);
+        npending = 0;
+    }
+#else
+    (void) dev;
+#endif
+    return ret;
+}
+
+#ifdef SSD1306_I2C_SINGLE_TRANSACTION
+/* hold commands back for the data that follows; false if they don't fit */
+static bool hold_commands(uint8_t *w, size_t n) {
+    if (!in_transfer || npending || n > PENDING_COMMANDS) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        pending[2 * i] = CONTROL_BYTE_COMMAND_CONTINUED;
+        pending[2 * i + 1] = w[i];
+    }
+    pending[2 * n] = CONTROL_BYTE_DATA;
+    npending = 2 * n;
+    return true;
+}
+
+/*
+ * the held back commands with the data control byte, to start the data that
+ * follows them, or NULL if there are none
+ *
+ * hn: set to the number of bytes
+ */
+static uint8_t *take_pending(size_t *hn) {
+    if (!npending) {
+        return NULL;
+    }
+    *hn = npending + 1;
+    npending = 0;
+    return pending;
+}
+#else
+static bool hold_commands(uint8_t *w, size_t n) {
+    (void) w;
+    (void) n;
+    return false;
+}
+
+static uint8_t *take_pending(size_t *hn) {
+    (void) hn;
+    return NULL;
+}
+#endif
+
+/* write commands (blocking) */
+static bool transport_write_commands(ssd1306_t *dev, uint8_t *w, size_t n) {
+    uint8_t control = CONTROL_BYTE_COMMAND;
+    if (hold_commands(w, n)) {
+        return true;
+    }
+    return i2c_write_with_header(dev->config.i2c, dev->config.addr, &control,
+            sizeof(control), w, n);
+}
+
+/* write display RAM data (blocking) */
+static bool transport_write_data(ssd1306_t *dev, uint8_t *w, size_t row_len,
+        size_t rows, size_t stride) {
+    uint8_t control = CONTROL_BYTE_DATA;
+    size_t hn = sizeof(control);
+    uint8_t *h = take_pending(&hn);
+    return i2c_write_with_header_2d(dev->config.i2c, dev->config.addr,
+            h ? h : &control, hn, w, row_len, rows, stride);
+}
+
+/* end of an asynchronous transaction (from I2C interrupt) */
+static void async_done(i2c_xfer_status_t status) {
+    async_callback(async_dev, status == I2C_XFER_OK);
+}
+
+/* write commands (asynchronous) */
+static bool transport_write_commands_async(ssd1306_t *dev, uint8_t *w,
+        size_t n, ssd1306_transport_callback_t callback) {
+    if (hold_commands(w, n)) {
+        callback(dev, true);
+        return true;
+    }
+    async_dev = dev;
+    async_callback = callback;
+    return i2c_write_with_header_2d_async(dev->config.i2c, dev->config.addr,
+            &control_command, 1, w, n, 1, n, async_done);
+}
+
+/* write display RAM data (asynchronous) */
+static bool transport_write_data_async(ssd1306_t *dev, uint8_t *w,
+        size_t row_len, size_t rows, size_t stride,
+        ssd1306_transport_callback_t callback) {
+    size_t hn = 1;
+    const uint8_t *h = take_pending(&hn);
+    async_dev = dev;
+    async_callback = callback;
+    return i2c_write_with_header_2d_async(dev->config.i2c, dev->config.addr,
+            h ? h : &control_data, hn, w, row_len, rows, stride, async_done);
+}
+
+/* time out a stuck asynchronous write */
+static void transport_poll(const ssd1306_t *dev) {
+    i2c_check_timeout(dev->config.i2c);
+}
+
+/*
+ * an extra window costs its commands in their own transaction, and the
+ * address and control bytes of a second one; or the commands and their
+ * control bytes, in one
+ */
+#ifdef SSD1306_I2C_SINGLE_TRANSACTION
+#define WINDOW_OVERHEAD 14
+#else
+#define WINDOW_OVERHEAD 10
+#endif
+
+const ssd1306_transport_t ssd1306_i2c_transport = {
+    .init = transport_init,
+    .begin = transport_begin,
+    .end = transport_end,
+    .write_commands = transport_write_commands,
+    .write_data = transport_write_data,
+    .write_commands_async = transport_write_commands_async,
+    .write_data_async = transport_write_data_async,
+    .poll = transport_poll,
+    .window_overhead = WINDOW_OVERHEAD,
+    .bus = &bus,
+};
@@ -0,0 +1,137 @@
+/*
+ * Mock transport for SSD1306 displays
+ *
+ * Records transfers and writes in a trace instead of sending them; see
+ * ssd1306_transport.h.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ssd1306.h"
+#include "ssd1306_transport.h"
+
+static ssd1306_bus_t bus;
+static ssd1306_mock_t *mock;
+
+/* set up the mock bus */
+void ssd1306_mock_setup(ssd1306_mock_t *m, ssd1306_mock_event_t *trace,
+        uint32_t size, uint32_t ns_per_byte, uint32_t ns_per_transfer) {
+    mock = m;
+    mock->trace = trace;
+    mock->size = size;
+    mock->ns_per_byte = ns_per_byte;
+    mock->ns_per_transfer = ns_per_transfer;
+    mock->fail = false;
+    ssd1306_mock_clear(mock);
+}
+
+/* empty the trace, and zero the counters and the modelled time */
+void ssd1306_mock_clear(ssd1306_mock_t *m) {
+    m->len = 0;
+    m->now_ns = 0;
+    m->transfers = 0;
+    m->command_bytes = 0;
+    m->data_bytes = 0;
+}
+
+/* advance the modelled time past an operation and record it */
+static void record(const ssd1306_t *dev, ssd1306_mock_op_t op, size_t len,
+        bool async) {
+    if (op == MOCK_BEGIN) {
+        mock->now_ns += mock->ns_per_transfer;
+        mock->transfers++;
+    } else if (op == MOCK_COMMANDS) {
+        mock->command_bytes += len;
+    } else if (op == MOCK_DATA) {
+        mock->data_bytes += len;
+    }
+    mock->now_ns += (uint64_t) len * mock->ns_per_byte;
+
+    if (mock->len < mock->size) {
+        mock->trace[mock->len] = (ssd1306_mock_event_t) {
+            .t_ns = mock->now_ns,
+            .dev = dev,
+            .len = len,
+            .op = op,
+            .async = async,
+        };
+    }
+    mock->len++;
+}
+
+/* nothing to set up */
+static void transport_init(ssd1306_t *dev) {
+    (void) dev;
+}
+
+static void transport_begin(ssd1306_t *dev) {
+    record(dev, MOCK_BEGIN, 0, false);
+}
+
+static bool transport_end(ssd1306_t *dev) {
+    record(dev, MOCK_END, 0, false);
+    return true;
+}
+
+static bool transport_write_commands(ssd1306_t *dev, uint8_t *w, size_t n) {
+    (void) w;
+    if (mock->fail) {
+        return false;
+    }
+    record(dev, MOCK_COMMANDS, n, false);
+    return true;
+}
+
+static bool transport_write_data(ssd1306_t *dev, uint8_t *w, size_t row_len,
+        size_t rows, size_t stride) {
+    (void) w;
+    (void) stride;
+    if (mock->fail) {
+        return false;
+    }
+    record(dev, MOCK_DATA, row_len * rows, false);
+    return true;
+}
+
+/* asynchronous writes end before returning */
+static bool transport_write_commands_async(ssd1306_t *dev, uint8_t *w,
+        size_t n, ssd1306_transport_callback_t callback) {
+    (void) w;
+    if (!mock->fail) {
+        record(dev, MOCK_COMMANDS, n, true);
+    }
+    callback(dev, !mock->fail);
+    return true;
+}
+
+static bool transport_write_data_async(ssd1306_t *dev, uint8_t *w,
+        size_t row_len, size_t rows, size_t stride,
+        ssd1306_transport_callback_t callback) {
+    (void) w;
+    (void) stride;
+    if (!mock->fail) {
+        record(dev, MOCK_DATA, row_len * rows, true);
+    }
+    callback(dev, !mock->fail);
+    return true;
+}
+
+/* nothing is ever in progress */
+static void transport_poll(const ssd1306_t *dev) {
+    (void) dev;
+}
+
+const ssd1306_transport_t ssd1306_mock_transport = {
+    .init = transport_init,
+    .begin = transport_begin,
+    .end = transport_end,
+    .write_commands = transport_write_commands,
+    .write_data = transport_write_data,
+    .write_commands_async = transport_write_commands_async,
+    .write_data_async = transport_write_data_async,
+    .poll = transport_poll,
+    .window_overhead = 6,
+    .bus = &bus,
+};
@@ -0,0 +1,223 @@
+/*
+ * SPI transport for SSD1306 displays
+ *
+ * Commands and data go out on SPI1 (spi.c), with the display's DC pin
+ * telling them apart. CS is asserted for a whole transfer. Asynchronous
+ * writes use DMA, one transfer per row, or a single one if the rows are
+ * contiguous.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+
+#include "spi.h"
+#include "systick.h"
+#include "ssd1306.h"
+#include "ssd1306_transport.h"
+
+static ssd1306_bus_t bus;
+
+/* asynchronous write in progress: its display, callback and remaining rows */
+static ssd1306_t *async_dev;
+static ssd1306_transport_callback_t async_callback;
+static uint8_t *async_w;
+static size_t async_row_len;
+static size_t async_rows;
+static size_t async_stride;
+
+/* set up the display's pins, deselect it and reset it */
+static void transport_init(ssd1306_t *dev) {
+    const ssd1306_config_t *config = &dev->config;
+    gpio_mode_setup(config->cs_port, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE,
+            config->cs_pin);
+    gpio_mode_setup(config->dc_port, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE,
+            config->dc_pin);
+    gpio_mode_setup(config->reset_port, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE,
+            config->reset_pin);
+    gpio_set(config->cs_port, config->cs_pin);
+    ssd1306_set_command(dev);
+
+    ssd1306_assert_reset(dev);
+    delay(10);
+    ssd1306_deassert_reset(dev);
+}
+
+/* start a transfer: select the display */
+static void transport_begin(ssd1306_t *dev) {
+    gpio_clear(dev->config.cs_port, dev->config.cs_pin);
+}
+
+/* end a transfer: deselect the display once the last byte is out */
+static bool transport_end(ssd1306_t *dev) {
+    spi_wait_idle(dev->config.spi);
+    gpio_set(dev->config.cs_port, dev->config.cs_pin);
+    return true;
+}
+
+/* write commands (blocking) */
+static bool transport_write_commands(ssd1306_t *dev, uint8_t *w, size_t n) {
+    uint32_t spi = dev->config.spi;
+    spi_wait_idle(spi); /* DC must not change until the previous write is out */
+    ssd1306_set_command(dev);
+    spi_write_buffer8(spi, w, n);
+    return true; /* SPI can't fail */
+}
+
+/* write display RAM data (blocking) */
+static bool transport_write_data(ssd1306_t *dev, uint8_t *w, size_t row_len,
+        size_t rows, size_t stride) {
+    uint32_t spi = dev->config.spi;
+    spi_wait_idle(spi);
+    ssd1306_set_data(dev);
+    for (size_t r = 0; r < rows; r++) {
+        spi_write_buffer8_packed(spi, w + r * stride, row_len);
+    }
+    return true;
+}
+
+/* start the next DMA transfer of the asynchronous write */
+static void async_next_rows(void) {
+    size_t n = async_row_len;
+    if (async_row_len == async_stride) {
+        n *= async_rows; /* contiguous: the rest in one transfer */
+    }
+    uint8_t *w = async_w;
+    async_w += n / async_row_len * async_stride;
+    async_rows -= n / async_row_len;
+    spi_write_buffer8_dma(async_dev->config.spi, w, n);
+}
+
+/*
+ * end of a DMA transfer (from DMA interrupt)
+ *
+ * The last bytes may still be in the TX FIFO: the next row chunk can follow
+ * them, and whatever changes DC or CS next waits for them first.
+ */
+static void dma_done(void) {
+    if (async_rows) {
+        async_next_rows();
+        return;
+    }
+    async_callback(async_dev, true);
+}
+
+/* start an asynchronous write of rows with DC already set */
+static bool write_async(ssd1306_t *dev, uint8_t *w, size_t row_len,
+        size_t rows, size_t stride, ssd1306_transport_callback_t callback) {
+    if (row_len == 0 || rows == 0) {
+        return false;
+    }
+    async_dev = dev;
+    async_callback = callback;
+    async_w = w;
+    async_row_len = row_len;
+    async_rows = rows;
+    async_stride = stride;
+    spi_set_dma_callback(dma_done);
+    async_next_rows();
+    return true;
+}
+
+/* write commands (asynchronous) */
+static bool transport_write_commands_async(ssd1306_t *dev, uint8_t *w,
+        size_t n, ssd1306_transport_callback_t callback) {
+    spi_wait_idle(dev->config.spi);
+    ssd1306_set_command(dev);
+    return write_async(dev, w, n, 1, n, callback);
+}
+
+/* write display RAM data (asynchronous) */
+static bool transport_write_data_async(ssd1306_t *dev, uint8_t *w,
+        size_t row_len, size_t rows, size_t stride,
+        ssd1306_transport_callback_t callback) {
+    spi_wait_idle(dev->config.spi);
+    ssd1306_set_data(dev);
+    return write_async(dev, w, row_len, rows, stride, callback);
+}
+
+/* SPI writes always end: nothing to time out */
+static void transport_poll(const ssd1306_t *dev) {
+    (void) dev;
+}
+
+/* an extra window costs only its address commands */
+const ssd1306_transport_t ssd1306_spi_transport = {
+    .init = transport_init,
+    .begin = transport_begin,
+    .end = transport_end,
+    .write_commands = transport_write_commands,
+    .write_data = transport_write_data,
+    .write_commands_async = transport_write_commands_async,
+    .write_data_async = transport_write_data_async,
+    .poll = transport_poll,
+    .window_overhead = 6,
+    .bus = &bus,
+};
+
+/* set DC (data/command) pin to data mode */
+void ssd1306_set_data(ssd1306_t *dev) {
+    gpio_set(dev->config.dc_port, dev->config.dc_pin);
+}
+
+/* set DC (data/command) pin to command mode */
+void ssd1306_set_command(ssd1306_t *dev) {
+    gpio_clear(dev->config.dc_port, dev->config.dc_pin);
+}
+
+/* assert reset pin */
+void ssd1306_assert_reset(ssd1306_t *dev) {
+    gpio_clear(dev->config.reset_port, dev->config.reset_pin);
+}
+
+/* deassert reset pin */
+void ssd1306_deassert_reset(ssd1306_t *dev) {
+    gpio_set(dev->config.reset_port, dev->config.reset_pin);
+}
+
+/*
+ * write a command buffer via SPI (blocking)
+ *
+ * handles asserting/deasserting CS and setting DC appropriately (DC cleared)
+ *
+ * w: pointer to buffer of commands
+ * wn: number of commands (number of bytes in buffer)
+ */
+void ssd1306_spi_write_commands(ssd1306_t *dev, uint8_t *w, size_t wn) {
+    transport_begin(dev);
+    transport_write_commands(dev, w, wn);
+    transport_end(dev);
+}
+
+/*
+ * write a data buffer via SPI (blocking)
+ *
+ * handles asserting/deasserting CS and setting DC appropriately (DC set)
+ *
+ * w: pointer to buffer of commands
+ * wn: number of commands (number of bytes in buffer)
+ */
+void ssd1306_spi_write_data(ssd1306_t *dev, uint8_t *w, size_t wn) {
+    ssd1306_spi_write_data_2d(dev, w, wn, 1, wn);
+}
+
+/*
+ * write a strided 2D data buffer via SPI (blocking)
+ *
+ * handles asserting/deasserting CS and setting DC appropriately (DC set). All
+ * rows are sent with CS asserted once.
+ *
+ * w:       pointer to first byte of first row
+ * row_len: number of bytes in each row
+ * rows:    number of rows
+ * stride:  distance (in bytes) between the starts of consecutive rows
+ */
+void ssd1306_spi_write_data_2d(ssd1306_t *dev, uint8_t *w, size_t row_len,
+        size_t rows, size_t stride) {
+    transport_begin(dev);
+    transport_write_data(dev, w, row_len, rows, stride);
+    transport_end(dev);
+}
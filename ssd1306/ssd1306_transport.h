@@ -0,0 +1,199 @@
+#ifndef SSD1306_TRANSPORT_H
+#define SSD1306_TRANSPORT_H
+
+/*
+ * Bus access for SSD1306 displays
+ *
+ * The driver reaches a display only through the transport in its config: a
+ * table of functions that write commands and display RAM data over one bus.
+ * ssd1306_i2c_transport (I2C1), ssd1306_spi_transport (SPI1 with DMA) and
+ * ssd1306_mock_transport (memory only, for host builds and tests) are
+ * provided; displays on different transports can be driven by one image.
+ *
+ * Writes are grouped into transfers, begin() .. end(): e.g. over SPI, CS is
+ * asserted for the whole transfer and DC switches between commands and data.
+ * A transfer is either blocking or asynchronous throughout. An asynchronous
+ * write returns at once and calls its callback when it ends, from interrupt
+ * context; the callback may start the next write, or end the transfer.
+ *
+ * The driver runs one transfer at a time per transport: asynchronous flushes
+ * of displays sharing a transport are queued on its ssd1306_bus_t.
+ */
+
+/* called when an asynchronous write ends (from interrupt context) */
+typedef void (*ssd1306_transport_callback_t)(ssd1306_t *dev, bool success);
+
+/*
+ * displays sharing a bus: the one whose asynchronous flush is being sent,
+ * and the ones waiting for it to finish (linked through ssd1306_t.next)
+ */
+typedef struct {
+    ssd1306_t *volatile current;
+    ssd1306_t *head;
+    ssd1306_t *tail;
+} ssd1306_bus_t;
+
+struct ssd1306_transport {
+    /* set up the display's pins and reset it, before the init commands */
+    void (*init)(ssd1306_t *dev);
+
+    /* start a transfer */
+    void (*begin)(ssd1306_t *dev);
+
+    /* end a transfer; false if a write it held back failed */
+    bool (*end)(ssd1306_t *dev);
+
+    /* write commands and their parameters (blocking); false on failure */
+    bool (*write_commands)(ssd1306_t *dev, uint8_t *w, size_t n);
+
+    /*
+     * write display RAM data from a strided 2D buffer (blocking)
+     *
+     * w:       pointer to first byte of first row
+     * row_len: number of bytes in each row
+     * rows:    number of rows
+     * stride:  distance (in bytes) between the starts of consecutive rows
+     *
+     * Returns false on failure
+     */
+    bool (*write_data)(ssd1306_t *dev, uint8_t *w, size_t row_len,
+            size_t rows, size_t stride);
+
+    /*
+     * asynchronous versions: start the write and return; the buffer must
+     * stay valid until the callback. Return false if it couldn't be started
+     * (the callback is not called).
+     */
+    bool (*write_commands_async)(ssd1306_t *dev, uint8_t *w, size_t n,
+            ssd1306_transport_callback_t callback);
+    bool (*write_data_async)(ssd1306_t *dev, uint8_t *w, size_t row_len,
+            size_t rows, size_t stride, ssd1306_transport_callback_t callback);
+
+    /*
+     * called from thread context while the driver waits for an asynchronous
+     * write, or checks for one: lets the transport end one that is stuck,
+     * calling its callback with failure, or free a bus it found held
+     */
+    void (*poll)(const ssd1306_t *dev);
+
+    /*
+     * approximate cost (in bytes on the bus) of an extra flush window: its
+     * address commands plus any extra framing
+     */
+    uint8_t window_overhead;
+
+    ssd1306_bus_t *bus;
+};
+
+/*
+ * I2C1, through the interrupt driven engine in i2c.c (i2c_setup() first)
+ *
+ * Each write is one transaction, bounded by the engine's timeout: a stuck
+ * write fails and the bus is recovered (see i2c_check_timeout()), also
+ * asynchronously once the driver polls. A write that finds the bus held by a
+ * slave fails, and the bus is recovered at the next poll. With
+ * SSD1306_I2C_SINGLE_TRANSACTION, up to 6 commands written in a transfer are
+ * held back and sent in one transaction with the data written after them,
+ * each behind a control byte with the continuation bit set (or at end()).
+ */
+extern const ssd1306_transport_t ssd1306_i2c_transport;
+
+/*
+ * SPI1 with DMA for asynchronous writes (spi_setup() first)
+ *
+ * The CS/DC/RESET GPIO port clocks must be enabled. A transfer asserts CS.
+ */
+extern const ssd1306_transport_t ssd1306_spi_transport;
+
+/* set DC (data/command) pin to data mode */
+void ssd1306_set_data(ssd1306_t *dev);
+
+/* set DC (data/command) pin to command mode */
+void ssd1306_set_command(ssd1306_t *dev);
+
+/* deassert reset pin */
+void ssd1306_deassert_reset(ssd1306_t *dev);
+
+/* assert reset pin */
+void ssd1306_assert_reset(ssd1306_t *dev);
+
+/*
+ * write a command buffer via SPI
+ *
+ * handles asserting/deasserting CS and setting DC appropriately
+ *
+ * w: pointer to buffer of commands
+ * wn: number of commands (number of bytes in buffer)
+ */
+void ssd1306_spi_write_commands(ssd1306_t *dev, uint8_t *w, size_t wn);
+
+void ssd1306_spi_write_data(ssd1306_t *dev, uint8_t *w, size_t wn);
+
+/*
+ * write a strided 2D data buffer via SPI, with CS asserted once
+ *
+ * w:       pointer to first byte of first row
+ * row_len: number of bytes in each row
+ * rows:    number of rows
+ * stride:  distance (in bytes) between the starts of consecutive rows
+ */
+void ssd1306_spi_write_data_2d(ssd1306_t *dev, uint8_t *w, size_t row_len,
+        size_t rows, size_t stride);
+
+/*
+ * Mock transport
+ *
+ * Keeps no display RAM: each transfer boundary and write is recorded in a
+ * trace, with the time it ends on a modelled bus (a fixed time per byte and
+ * per transfer), so that flushes can be counted and timed without hardware.
+ * Asynchronous writes complete, and call their callback, before returning.
+ */
+
+/* kinds of mock trace events */
+typedef enum {
+    MOCK_BEGIN,
+    MOCK_END,
+    MOCK_COMMANDS,
+    MOCK_DATA
+} ssd1306_mock_op_t;
+
+/* one recorded operation */
+typedef struct {
+    uint64_t t_ns; /* modelled time when it ended */
+    const ssd1306_t *dev;
+    uint16_t len; /* bytes written */
+    uint8_t op; /* ssd1306_mock_op_t */
+    bool async;
+} ssd1306_mock_event_t;
+
+/* state of the mock bus */
+typedef struct {
+    ssd1306_mock_event_t *trace;
+    uint32_t size; /* events the trace holds; later ones are only counted */
+    uint32_t len; /* events recorded, including those that didn't fit */
+    uint32_t ns_per_byte;
+    uint32_t ns_per_transfer;
+    uint64_t now_ns; /* modelled time */
+    uint32_t transfers;
+    uint32_t command_bytes;
+    uint32_t data_bytes;
+    bool fail; /* writes fail while set */
+} ssd1306_mock_t;
+
+extern const ssd1306_transport_t ssd1306_mock_transport;
+
+/*
+ * set up the mock bus
+ *
+ * mock:            bus state; used until the next call
+ * trace:           size events of memory for the trace
+ * ns_per_byte:     modelled time to write a byte
+ * ns_per_transfer: modelled time to begin and end a transfer
+ */
+void ssd1306_mock_setup(ssd1306_mock_t *mock, ssd1306_mock_event_t *trace,
+        uint32_t size, uint32_t ns_per_byte, uint32_t ns_per_transfer);
+
+/* empty the trace, and zero the counters and the modelled time */
+void ssd1306_mock_clear(ssd1306_mock_t *mock);
+
+#endif
@@ -1,10 +1,15 @@
+#include <stdint.h>
+
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/scb.h>
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/stm32/rcc.h>
 
 #include "systick.h"
 
-static volatile uint32_t counter = 0;
+/* milliseconds since systick_setup(); only sys_tick_handler() writes it */
+static volatile uint64_t counter = 0;
 
 /* increment systick counter variable on each systick interrupt */
 void sys_tick_handler(void) {
@@ -13,13 +18,57 @@ void sys_tick_handler(void) {
 
 /* return current value of milliseconds counter (since systick initialized) */
 uint32_t millis(void) {
-    return counter;
+    return (uint32_t) counter;
+}
+
+/*
+ * read the time as whole milliseconds and SysTick clocks into the current
+ * one, consistently
+ *
+ * If the SysTick counter has reloaded but its interrupt hasn't been taken
+ * yet (interrupts masked, or a handler running), the millisecond counter is
+ * one behind: the pending flag tells, and the count is read again after it so
+ * that it belongs to the new millisecond.
+ *
+ * Returns the SysTick clocks per millisecond
+ */
+static uint32_t read_time(uint64_t *ms, uint32_t *clocks) {
+    uint32_t reload = STK_RVR + 1;
+
+    uint32_t masked = cm_mask_interrupts(1);
+    *ms = counter;
+    uint32_t cvr = STK_CVR;
+    if (SCB_ICSR & SCB_ICSR_PENDSTSET) {
+        cvr = STK_CVR;
+        ++*ms;
+    }
+    cm_mask_interrupts(masked);
+
+    *clocks = reload - 1 - cvr; /* counts down */
+    return reload;
+}
+
+/* return microseconds since systick initialized (does not wrap) */
+uint64_t micros64(void) {
+    uint64_t ms;
+    uint32_t clocks;
+    uint32_t per_us = read_time(&ms, &clocks) / 1000;
+    return ms * 1000 + clocks / per_us;
+}
+
+/* return nanoseconds since systick initialized, to a SysTick clock */
+uint64_t nanos64(void) {
+    uint64_t ms;
+    uint32_t clocks;
+    uint32_t per_us = read_time(&ms, &clocks) / 1000;
+    /* at most 1 ms of clocks: fits 32 bits below ~4 GHz */
+    return ms * 1000000 + clocks * 1000 / per_us;
 }
 
 /* delay (blocking) for ms milliseconds */
 void delay(uint32_t ms) {
     uint32_t t0 = millis();
-    while (millis() < t0 + ms);
+    while (millis() - t0 < ms); /* unsigned difference survives the wrap */
 }
 
 /* setup systick to fire every 1 ms */
@@ -1,9 +1,23 @@
 #ifndef SYSTICK_H
 #define SYSTICK_H
 
+#include <stdint.h>
+
 /* return current value of milliseconds counter (since systick initialized) */
 uint32_t millis(void);
 
+/*
+ * return microseconds since systick initialized
+ *
+ * Combines the millisecond counter with the SysTick current value, so it is
+ * as fine as the SysTick clock allows and does not wrap (unlike millis(),
+ * after 49 days). Safe from interrupt handlers.
+ */
+uint64_t micros64(void);
+
+/* as micros64(), in nanoseconds: resolution one SysTick clock (21 ns) */
+uint64_t nanos64(void);
+
 /* delay (blocking) for ms milliseconds */
 void delay(uint32_t ms);
 